@@ -0,0 +1,745 @@
+#!/bin/bash
+# Golden-output checks for 'Aprog', 'Tprog', 'libpullet16', and the
+# daemon.
+#
+# Each job below, an a.out, a data file, and the output it must write,
+# is run every way there is.  Each run must write the golden output and
+# the same log as the plain run of its kind: the full log of the plain
+# run, which is checked against the golden log where the job has one,
+# less the 'MAIN:' lines that name the files.
+#
+# Run by 'make check' from the top directory; the exit status is the
+# number of checks that failed.
+
+cd "$(dirname "$0")/.." || exit 1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failures=0
+
+# The jobs: the sample program, a loop that writes its input and counts
+# down to 1, for 3 and for 100, and a loop that uses STC to write over
+# the code it runs next, so that a decoded or compiled copy of the
+# program goes stale.
+names=(sample countdown_3 countdown_100 selfmod)
+programs=(adotout4 Tests/countdown Tests/countdown Tests/selfmod)
+datas=(zzin.txt Tests/countdown_3.txt Tests/countdown_100.txt
+       Tests/countdown_3.txt)
+outputs=(xsample_output.txt Tests/countdown_3_output.txt
+         Tests/countdown_100_output.txt Tests/selfmod_output.txt)
+logs=(xsample_log.txt Tests/countdown_3_log.txt "" Tests/selfmod_log.txt)
+
+# Report the check 'name' as passed if the rest of the line succeeds.
+check() {
+  local name=$1
+  shift
+  if "$@"; then
+    echo "PASS $name"
+  else
+    echo "FAIL $name"
+    failures=$((failures + 1))
+  fi
+}
+
+run() {
+  ./Aprog "$@" > /dev/null
+}
+
+# Whether the files 'log' and 'golden' are the same, less the 'MAIN:'
+# lines of each.
+same_log() {
+  cmp -s <(grep -v '^MAIN:' "$1") <(grep -v '^MAIN:' "$2")
+}
+
+# Whether no line of the file 'log' matches 'pattern'.
+no_lines() {
+  ! grep -q "$1" "$2"
+}
+
+# The lines of the 'k'th 'MACHINE IS NOW' dump in the file 'log'.
+machine_at() {
+  awk -v k="$1" '/^MACHINE IS NOW/ { ++seen }
+                 seen == k && /^(MACHINE IS NOW|PC |ACCUM |MEM )/' "$2"
+}
+
+# Run job 'n' with the options given, check its output, and check its
+# log against the full log of the plain run.
+check_run() {
+  local n=$1
+  shift
+  rm -f "$work/out.txt" "$work/log.txt"
+  run "$@" "${programs[n]}" "${datas[n]}" "$work/out.txt" "$work/log.txt"
+  check "${names[n]} $* output" cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} $* log" same_log "$work/log.txt" "$work/log_$n.txt"
+}
+
+# Run job 'n' with '-log summary' and the options given, check its
+# output, and check its summary line against that of the plain
+# '-log summary' run.
+check_summary() {
+  local n=$1
+  shift
+  rm -f "$work/out.txt" "$work/log.txt"
+  run -log summary "$@" "${programs[n]}" "${datas[n]}" "$work/out.txt" \
+      "$work/log.txt"
+  check "${names[n]} -log summary $* output" \
+    cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} -log summary $* summary" \
+    [ "$(grep '^SUMMARY:' "$work/log.txt")" = "${summaries[n]}" ]
+}
+
+# Check that the batch run with the options given, which exited with
+# 'status', wrote the output of each job of the manifest, and exited
+# with 1 for the job that ran out of data.
+check_batch_outputs() {
+  local status=$1 n
+  shift
+  check "$* exit status" [ $status -eq 1 ]
+  for n in "${!names[@]}"; do
+    check "$* output ${names[n]}" cmp -s "$work/out_$n.txt" "${outputs[n]}"
+  done
+  check "$* output on no data" cmp -s "$work/out_empty.txt" Tests/empty.txt
+}
+
+# Check a sweep of the a.out 'program' over the data files given, each
+# run of which must write the output and summary of the plain run on its
+# data; a run stopped in an infinite loop, which the plain run logs as
+# stopped by an error, is logged as stopped in a loop.
+check_sweep() {
+  local program=$1 lane=0 data same=true
+  shift
+  rm -f "$work/sweep.txt" "$work/sweep_golden_summary.txt"
+  for data in "$@"; do
+    lane=$((lane + 1))
+    echo "$data $work/out_lane_$lane.txt" >> "$work/sweep.txt"
+    run -log summary "$program" "$data" "$work/out_plain_$lane.txt" \
+        "$work/log.txt"
+    grep '^SUMMARY:' "$work/log.txt" \
+      | sed 's/, stopped by an error$/, stopped in an infinite loop/' \
+      >> "$work/sweep_golden_summary.txt"
+  done
+  run -log summary -sweep "$work/sweep.txt" "$program" "$work/log.txt"
+  check "-sweep $program exit status" [ $? -eq 1 ]
+  for ((lane = 1; lane <= $#; ++lane)); do
+    cmp -s "$work/out_lane_$lane.txt" "$work/out_plain_$lane.txt" \
+      || same=false
+  done
+  check "-sweep $program outputs" $same
+  check "-sweep $program summaries" \
+    cmp -s <(grep '^SUMMARY:' "$work/log.txt") \
+           "$work/sweep_golden_summary.txt"
+}
+
+# The daemon's 'RESULT' line for a run that finished with the summary
+# line given.
+finished_result() {
+  echo "$1" | sed -e 's/^SUMMARY: \([0-9]*\) [a-z ]*, /RESULT finished \1 /' \
+                  -e 's/PC \([0-9]*\) ACC /\1 /'
+}
+
+# The plain run of each job, whose full log the other runs must write.
+for n in "${!names[@]}"; do
+  run "${programs[n]}" "${datas[n]}" "$work/out.txt" "$work/log_$n.txt"
+  check "${names[n]} plain output" cmp -s "$work/out.txt" "${outputs[n]}"
+  if [ -n "${logs[n]}" ]; then
+    check "${names[n]} plain log" same_log "$work/log_$n.txt" "${logs[n]}"
+  fi
+done
+
+# The ways to run a job that must write the same full log as the plain
+# run.
+for options in "-engine threaded" "-fuse no" "-engine threaded -fuse no" \
+               "-log async" "-loopcheck 0" "-loopcheck 1"; do
+  for n in "${!names[@]}"; do
+    check_run $n $options
+  done
+done
+
+# The ISA tables, through which every word must disassemble, assemble
+# back, and decode as it did.
+check "opcode table round trip" ./Tests/opcodes
+
+# The plain '-log summary' run of each job, whose summary line the other
+# runs must write.
+summaries=()
+for n in "${!names[@]}"; do
+  run -log summary "${programs[n]}" "${datas[n]}" "$work/out.txt" \
+      "$work/log.txt"
+  summaries[n]=$(grep '^SUMMARY:' "$work/log.txt")
+  check "${names[n]} -log summary output" \
+    cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} -log summary has a summary" [ -n "${summaries[n]}" ]
+done
+
+# The 'jit' engine, which must count every instruction its code runs,
+# and go back to the interpreter for code that an 'STC' changes.  It runs
+# only with loop checks off, and the 'switch' engine runs otherwise.
+for n in "${!names[@]}"; do
+  check_summary $n -engine jit -loopcheck 0
+  check_summary $n -engine jit
+done
+
+# A binary trace, which 'Tprog' must turn back into the full log.
+for n in "${!names[@]}"; do
+  rm -f "$work/out.txt" "$work/trace.bin" "$work/log_again.txt"
+  run -bintrace "$work/trace.bin" "${programs[n]}" "${datas[n]}" \
+      "$work/out.txt" "$work/log.txt"
+  ./Tprog "$work/trace.bin" "$work/log_again.txt" > /dev/null
+  check "${names[n]} -bintrace output" cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} -bintrace Tprog log" \
+    same_log "$work/log_again.txt" "$work/log_$n.txt"
+done
+# A trace of one 'STC' whose address is past the end of memory, which
+# 'Tprog' must read as truncated.
+printf 'P16T\001\001\000\000\100' > "$work/trace.bin"
+printf '\000\000\100\000\000\210\100\001\000' >> "$work/trace.bin"
+./Tprog "$work/trace.bin" "$work/log_again.txt" > "$work/result.txt"
+check "corrupt -bintrace Tprog" grep -q 'trace is truncated' "$work/result.txt"
+
+# '-log summary' and '-log none' write nothing for each instruction, and
+# '-log none' no summary either.
+for n in "${!names[@]}"; do
+  rm -f "$work/out.txt" "$work/log.txt"
+  run -log none "${programs[n]}" "${datas[n]}" "$work/out.txt" "$work/log.txt"
+  check "${names[n]} -log none output" cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} -log none log" \
+    no_lines '^SUMMARY:\|^MACHINE IS NOW\|^EXECUTE:' "$work/log.txt"
+  run -log summary "${programs[n]}" "${datas[n]}" "$work/out.txt" \
+      "$work/log.txt"
+  check "${names[n]} -log summary log" \
+    no_lines '^MACHINE IS NOW\|^EXECUTE:' "$work/log.txt"
+done
+
+# The ways to run a job that must write the same summary as the plain
+# run; the plain run records the loop of Tests/countdown on 100, which
+# goes round more than 64 times, as a hot trace and runs it to the end.
+for options in "-hottrace no" "-fuse no" "-hottrace no -fuse no" \
+               "-engine threaded"; do
+  for n in "${!names[@]}"; do
+    check_summary $n $options
+  done
+done
+
+# The diff log, which must have a 'STEP' or 'KEYFRAME' line for each
+# instruction the plain run counted, and from which 'Tprog -step' must
+# rebuild the machine the full log dumps after the first, the middle,
+# and the last instruction.
+for n in "${!names[@]}"; do
+  rm -f "$work/out.txt" "$work/log.txt"
+  run -log diff "${programs[n]}" "${datas[n]}" "$work/out.txt" "$work/log.txt"
+  count=$(echo "${summaries[n]}" | sed 's/^SUMMARY: \([0-9]*\).*/\1/')
+  check "${names[n]} -log diff output" cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} -log diff steps" \
+    [ "$(grep -c '^STEP\|^KEYFRAME' "$work/log.txt")" = "$count" ]
+  for step in 1 $((count / 2)) $count; do
+    ./Tprog -step $step "$work/log.txt" > "$work/step.txt"
+    check "${names[n]} -log diff Tprog -step $step" \
+      cmp -s <(machine_at 1 "$work/step.txt") \
+             <(machine_at $((step + 1)) "$work/log_$n.txt")
+  done
+done
+
+# Snapshots, each of which must be the machine the plain full log dumps
+# at its step, and after which the log must end with the plain summary.
+for options in "-snapevery 5" "-snapat 3,7" "-snapevery 7 -snapat 1"; do
+  for n in "${!names[@]}"; do
+    rm -f "$work/out.txt" "$work/log.txt"
+    run $options "${programs[n]}" "${datas[n]}" "$work/out.txt" \
+        "$work/log.txt"
+    check "${names[n]} $options output" cmp -s "$work/out.txt" "${outputs[n]}"
+    check "${names[n]} $options summary" \
+      [ "$(grep '^SUMMARY:' "$work/log.txt")" = "${summaries[n]}" ]
+    snapshot=0
+    same=true
+    for step in $(sed -n 's/^SNAPSHOT STEP //p' "$work/log.txt"); do
+      snapshot=$((snapshot + 1))
+      cmp -s <(machine_at $snapshot "$work/log.txt") \
+             <(machine_at $((step + 1)) "$work/log_$n.txt") || same=false
+    done
+    [ $snapshot -gt 0 ] || same=false
+    check "${names[n]} $options snapshots" $same
+  done
+done
+for options in "-snapevery 3 -log summary" "-log summary -snapevery 3" \
+               "-snapat 3 -log none" "-bintrace $work/trace.bin -log full" \
+               "-snapms 5 -bintrace $work/trace.bin"; do
+  run $options Tests/countdown Tests/countdown_3.txt "$work/out.txt" \
+      "$work/log.txt"
+  check "$options is refused" [ $? -eq 1 ]
+done
+
+# Batches of every job, with a job that runs out of data after the
+# second, which must write each job's output and log just as the plain
+# runs do, one after another, and exit with 1 for the job that ran out.
+run Tests/countdown Tests/empty.txt "$work/out.txt" "$work/log_empty.txt"
+run -log summary Tests/countdown Tests/empty.txt "$work/out.txt" \
+    "$work/log.txt"
+empty_summary=$(grep '^SUMMARY:' "$work/log.txt")
+check "countdown on no data summary" \
+  grep -q ', ran out of data$' "$work/log.txt"
+rm -f "$work/manifest.txt" "$work/batch_golden_log.txt" \
+      "$work/batch_golden_summary.txt"
+for n in "${!names[@]}"; do
+  echo "${programs[n]} ${datas[n]} $work/out_$n.txt" >> "$work/manifest.txt"
+  cat "$work/log_$n.txt" >> "$work/batch_golden_log.txt"
+  echo "${summaries[n]}" >> "$work/batch_golden_summary.txt"
+  if [ $n -eq 1 ]; then
+    echo "Tests/countdown Tests/empty.txt $work/out_empty.txt" \
+      >> "$work/manifest.txt"
+    cat "$work/log_empty.txt" >> "$work/batch_golden_log.txt"
+    echo "$empty_summary" >> "$work/batch_golden_summary.txt"
+  fi
+done
+
+rm -f "$work"/out_*.txt
+run -batch "$work/manifest.txt" "$work/log.txt"
+check_batch_outputs $? -batch
+check "-batch log" same_log "$work/log.txt" "$work/batch_golden_log.txt"
+rm -f "$work"/out_*.txt
+run -log summary -batch "$work/manifest.txt" "$work/batch_log.txt"
+check_batch_outputs $? -log summary -batch
+check "-log summary -batch summary" \
+  cmp -s <(grep '^SUMMARY:' "$work/batch_log.txt") \
+         "$work/batch_golden_summary.txt"
+
+# Batches run on more than one thread, whose log must be the same as
+# from one, job by job in the order of the manifest.
+for options in "-threads 2" "-threads 3" "-threads 0"; do
+  rm -f "$work"/out_*.txt
+  run -log summary $options -batch "$work/manifest.txt" "$work/log.txt"
+  check_batch_outputs $? -log summary $options -batch
+  check "-log summary $options -batch log" \
+    cmp -s "$work/log.txt" "$work/batch_log.txt"
+done
+rm -f "$work"/out_*.txt
+run -threads 2 -batch "$work/manifest.txt" "$work/log.txt"
+check_batch_outputs $? -threads 2 -batch
+check "-threads 2 -batch log" \
+  same_log "$work/log.txt" "$work/batch_golden_log.txt"
+
+# Sweeps of more than eight runs at once, which go separate ways at each
+# 'BAN': Tests/countdown runs for as long as its input says, or not at
+# all with no data, and Tests/spin loops for good on a negative input.
+check_sweep Tests/countdown Tests/countdown_3.txt Tests/countdown_100.txt \
+  Tests/empty.txt Tests/plus_one.txt Tests/seven.txt Tests/minus_one.txt \
+  Tests/countdown_3.txt Tests/seven.txt Tests/plus_one.txt \
+  Tests/countdown_100.txt
+check_sweep Tests/spin Tests/minus_one.txt Tests/plus_one.txt \
+  Tests/seven.txt Tests/minus_one.txt
+check "-sweep Tests/spin loops stopped" \
+  [ "$(grep -c ', stopped in an infinite loop$' "$work/log.txt")" = 2 ]
+for options in "" "-log full" "-log none" "-snapevery 10" "-engine jit" \
+               "-fuse no" "-threads 2"; do
+  run ${options:--log full} -sweep "$work/sweep.txt" Tests/spin \
+      "$work/log.txt"
+  check "-sweep ${options:-with no -log} is refused" [ $? -eq 1 ]
+done
+
+# A batch that runs each program two or three times in a row, so that
+# each job after the first starts from a copy of the machine as loaded,
+# which must not have the stores of Tests/selfmod, or the count of
+# Tests/countdown, left over from the job before.
+restore_jobs=(0 0 1 2 1 3 3 3)
+for i in "${!restore_jobs[@]}"; do
+  n=${restore_jobs[i]}
+  echo "${programs[n]} ${datas[n]} $work/out_restore_$i.txt" \
+    >> "$work/restore.txt"
+  cat "$work/log_$n.txt" >> "$work/restore_golden_log.txt"
+  echo "${summaries[n]}" >> "$work/restore_golden_summary.txt"
+done
+for options in "" "-log summary"; do
+  rm -f "$work"/out_restore_*.txt
+  run $options -batch "$work/restore.txt" "$work/log.txt"
+  same=true
+  for i in "${!restore_jobs[@]}"; do
+    cmp -s "$work/out_restore_$i.txt" "${outputs[restore_jobs[i]]}" \
+      || same=false
+  done
+  check "${options:+$options }-batch restore outputs" $same
+  if [ -z "$options" ]; then
+    check "-batch restore log" \
+      same_log "$work/log.txt" "$work/restore_golden_log.txt"
+  else
+    check "$options -batch restore summary" \
+      cmp -s <(grep '^SUMMARY:' "$work/log.txt") \
+             "$work/restore_golden_summary.txt"
+  fi
+done
+
+# A cache of runs, which must keep one run for each job and set of
+# options that changes the log, and give back its output and summary.
+# A run stopped in an infinite loop is not kept, and is run again each
+# time, with the '-loopcheck' given.
+for options in "-cache $work/cache" "-cache $work/cache" \
+               "-engine jit -cache $work/cache"; do
+  for n in "${!names[@]}"; do
+    check_summary $n $options
+  done
+done
+check "-cache runs kept" \
+  [ "$(ls "$work/cache" | grep -c '\.run$')" = $((2 * ${#names[@]})) ]
+for options in "-loopcheck 100" "-loopcheck 50" "-loopcheck 100"; do
+  run -log summary $options Tests/spin Tests/minus_one.txt \
+      "$work/out.txt" "$work/log.txt"
+  run -log summary $options -cache "$work/cache" Tests/spin \
+      Tests/minus_one.txt "$work/out.txt" "$work/log_cached.txt"
+  check "-cache $options Tests/spin summary" \
+    cmp -s <(grep '^SUMMARY:' "$work/log.txt") \
+           <(grep '^SUMMARY:' "$work/log_cached.txt")
+done
+run -log summary Tests/countdown Tests/seven.txt "$work/out.txt" \
+    "$work/log.txt"
+for options in "-log none" "-log summary"; do
+  run $options -cache "$work/cache" Tests/countdown Tests/seven.txt \
+      "$work/out.txt" "$work/log_cached.txt"
+done
+check "-cache -log none then -log summary summary" \
+  cmp -s <(grep '^SUMMARY:' "$work/log.txt") \
+         <(grep '^SUMMARY:' "$work/log_cached.txt")
+check "-cache runs kept for each option" \
+  [ "$(ls "$work/cache" | grep -c '\.run$')" = $((2 * ${#names[@]} + 2)) ]
+
+# Runs that run less or none of each program ahead to its first 'RD' or
+# 'WRT' as it is loaded, which must count the same instructions.
+for options in "-prefix 0" "-prefix 1" "-prefix 2"; do
+  for n in "${!names[@]}"; do
+    check_summary $n $options
+  done
+  rm -f "$work"/out_restore_*.txt
+  run -log summary $options -batch "$work/restore.txt" "$work/log.txt"
+  check "-log summary $options -batch restore summary" \
+    cmp -s <(grep '^SUMMARY:' "$work/log.txt") \
+           "$work/restore_golden_summary.txt"
+done
+
+# Tests/spin on a negative input, which must be stopped in its loop with
+# the golden 'LOOP:' and summary lines and exit status 1, however it is
+# run; on a positive one it finishes.  Tests/countdown on -1 goes round
+# its loop 4095 times, never in the same state, and must not be stopped.
+run -loopcheck 100 Tests/spin Tests/minus_one.txt "$work/out.txt" \
+    "$work/log_spin.txt"
+check "Tests/spin -loopcheck 100 exit status" [ $? -eq 1 ]
+check "Tests/spin -loopcheck 100 log" \
+  cmp -s <(grep '^LOOP:' "$work/log_spin.txt") \
+         <(grep '^LOOP:' Tests/spin_log.txt)
+for options in "-engine threaded" "-fuse no" "-log async"; do
+  run $options -loopcheck 100 Tests/spin Tests/minus_one.txt \
+      "$work/out.txt" "$work/log.txt"
+  check "Tests/spin $options -loopcheck 100 exit status" [ $? -eq 1 ]
+  check "Tests/spin $options -loopcheck 100 log" \
+    same_log "$work/log.txt" "$work/log_spin.txt"
+done
+for options in "" "-engine threaded" "-engine jit" "-fuse no" \
+               "-hottrace no" "-prefix 0"; do
+  run -log summary $options -loopcheck 100 Tests/spin Tests/minus_one.txt \
+      "$work/out.txt" "$work/log.txt"
+  check "Tests/spin -log summary $options -loopcheck 100 exit status" \
+    [ $? -eq 1 ]
+  check "Tests/spin -log summary $options -loopcheck 100 log" \
+    same_log "$work/log.txt" Tests/spin_log.txt
+done
+run -log summary Tests/spin Tests/seven.txt "$work/out.txt" "$work/log.txt"
+check "Tests/spin on 7 exit status" [ $? -eq 0 ]
+
+# Tests/loadspin loops before it reads or writes anything, so the loop is
+# run into as it is loaded, and must be found and logged in the run after
+# the same instructions as with no prefix and with the full log.
+for options in "" "-prefix 0" "-prefix 1000" "-hottrace no"; do
+  run -log summary $options Tests/loadspin Tests/empty.txt "$work/out.txt" \
+      "$work/log.txt"
+  check "Tests/loadspin -log summary $options exit status" [ $? -eq 1 ]
+  check "Tests/loadspin -log summary $options log" \
+    same_log "$work/log.txt" Tests/loadspin_log.txt
+done
+run Tests/loadspin Tests/empty.txt "$work/out.txt" "$work/log.txt"
+check "Tests/loadspin log" \
+  cmp -s <(grep '^LOOP:' "$work/log.txt") \
+         <(grep '^LOOP:' Tests/loadspin_log.txt)
+
+# Tests/twoback counts in memory round a loop with two branches back, and
+# is stopped when the count comes round; a hot trace of the loop must be
+# stopped at the same branch as the plain interpreter.
+for every in 3 16; do
+  run -log summary -loopcheck $every -hottrace no Tests/twoback \
+      Tests/empty.txt "$work/out_plain.txt" "$work/log_plain.txt"
+  for options in "" "-engine threaded"; do
+    run -log summary -loopcheck $every $options Tests/twoback \
+        Tests/empty.txt "$work/out.txt" "$work/log.txt"
+    check "Tests/twoback -loopcheck $every $options exit status" [ $? -eq 1 ]
+    check "Tests/twoback -loopcheck $every $options output" \
+      cmp -s "$work/out.txt" "$work/out_plain.txt"
+    check "Tests/twoback -loopcheck $every $options log" \
+      same_log "$work/log.txt" "$work/log_plain.txt"
+  done
+done
+run -log summary -loopcheck 0 Tests/countdown Tests/minus_one.txt \
+    "$work/out.txt" "$work/log.txt"
+run -log summary -loopcheck 1 Tests/countdown Tests/minus_one.txt \
+    "$work/out_checked.txt" "$work/log_checked.txt"
+check "Tests/countdown on -1 -loopcheck 1 exit status" [ $? -eq 0 ]
+check "Tests/countdown on -1 -loopcheck 1 output" \
+  cmp -s "$work/out_checked.txt" "$work/out.txt"
+check "Tests/countdown on -1 -loopcheck 1 summary" \
+  cmp -s <(grep '^SUMMARY:' "$work/log_checked.txt") \
+         <(grep '^SUMMARY:' "$work/log.txt")
+
+# Batches whose jobs take turns of a few instructions on one thread, so
+# that a job stops partway through a loop, and even a fused pair or a hot
+# trace, at the end of each turn; one job runs out of data, and another,
+# Tests/spin on -1, is stopped in its loop.  The log must be that of
+# the batch run one job after another.
+for options in "-slice 1" "-slice 3" "-slice 1000"; do
+  rm -f "$work"/out_*.txt
+  run -log summary $options -batch "$work/manifest.txt" "$work/log.txt"
+  check_batch_outputs $? -log summary $options -batch
+  check "-log summary $options -batch log" \
+    cmp -s "$work/log.txt" "$work/batch_log.txt"
+done
+cp "$work/manifest.txt" "$work/manifest_spin.txt"
+echo "Tests/spin Tests/minus_one.txt $work/out_spin.txt" \
+  >> "$work/manifest_spin.txt"
+echo "Tests/spin Tests/seven.txt $work/out_spin.txt" \
+  >> "$work/manifest_spin.txt"
+run -log summary -batch "$work/manifest_spin.txt" "$work/batch_spin_log.txt"
+check "-log summary -batch with a loop stops it" \
+  grep -q '^LOOP:' "$work/batch_spin_log.txt"
+for options in "-slice 1" "-slice 7"; do
+  run -log summary $options -batch "$work/manifest_spin.txt" "$work/log.txt"
+  check "-log summary $options -batch with a loop exit status" [ $? -eq 1 ]
+  check "-log summary $options -batch with a loop log" \
+    cmp -s "$work/log.txt" "$work/batch_spin_log.txt"
+done
+rm -f "$work"/out_*.txt
+run -slice 3 -batch "$work/manifest.txt" "$work/log.txt"
+check_batch_outputs $? -slice 3 -batch
+check "-slice 3 -batch log" \
+  same_log "$work/log.txt" "$work/batch_golden_log.txt"
+
+# Streams of the batch, which must log as the batch does; a stream
+# sent a line that is not a value must stop with an error while the
+# others finish, and one fed through named pipes must write through them
+# what it writes to files.
+for options in "" "-slice 3"; do
+  rm -f "$work"/out_*.txt
+  run -log summary $options -stream "$work/manifest.txt" "$work/log.txt"
+  check_batch_outputs $? -log summary $options -stream
+  check "-log summary ${options:+$options }-stream log" \
+    cmp -s "$work/log.txt" "$work/batch_log.txt"
+done
+rm -f "$work"/out_*.txt
+cp "$work/manifest.txt" "$work/manifest_bad.txt"
+echo "Tests/countdown Tests/bad_value.txt $work/out_bad.txt" \
+  >> "$work/manifest_bad.txt"
+run -log summary -stream "$work/manifest_bad.txt" "$work/log.txt"
+check_batch_outputs $? -log summary -stream with a bad value
+check "-log summary -stream with a bad value log" \
+  cmp -s <(grep -v '^MAIN:' "$work/log.txt" | head -n -2) \
+         <(grep -v '^MAIN:' "$work/batch_log.txt")
+check "-log summary -stream with a bad value stops it" \
+  cmp -s <(grep -v '^MAIN:' "$work/log.txt" | tail -n 2) \
+         Tests/bad_value_log.txt
+# More streams than there may be descriptors open at once, which are
+# run in waves and must log as the batch does.
+for i in $(seq 600); do
+  echo "Tests/countdown Tests/countdown_3.txt $work/out_many_$i.txt"
+done > "$work/manifest_many.txt"
+run -log summary -batch "$work/manifest_many.txt" "$work/batch_many_log.txt"
+(ulimit -n 256; run -log summary -stream "$work/manifest_many.txt" \
+                    "$work/log.txt")
+check "-log summary -stream of 600 jobs exit status" [ $? -eq 0 ]
+check "-log summary -stream of 600 jobs log" \
+  cmp -s "$work/log.txt" "$work/batch_many_log.txt"
+check "-log summary -stream of 600 jobs last output" \
+  cmp -s "$work/out_many_600.txt" Tests/countdown_3_output.txt
+run -engine jit -stream "$work/manifest.txt" "$work/log.txt"
+check "-engine jit -stream is refused" [ $? -eq 1 ]
+mkfifo "$work/in_pipe" "$work/out_pipe"
+echo "Tests/countdown $work/in_pipe $work/out_pipe" > "$work/manifest_pipe.txt"
+cat "$work/out_pipe" > "$work/out.txt" &
+reader=$!
+(sleep 1; cat Tests/countdown_100.txt) > "$work/in_pipe" &
+run -log summary -stream "$work/manifest_pipe.txt" "$work/log.txt"
+check "-stream through pipes exit status" [ $? -eq 0 ]
+wait $reader
+check "-stream through pipes output" \
+  cmp -s "$work/out.txt" Tests/countdown_100_output.txt
+check "-stream through pipes summary" \
+  [ "$(grep '^SUMMARY:' "$work/log.txt")" = "${summaries[2]}" ]
+
+# One core of a multiprocessor must run each job as the plain machine
+# does.  On two cores, Tests/handoff has core 0 read a value and write
+# it, and core 1 wait in a loop until core 0 stores it, and then write
+# one less; taking turns, the run must be the golden one, and each way
+# the cores are run, the output must be.  With no data, core 0 runs out
+# of it and core 1 is left waiting for ever, and so must be stopped, as
+# must Tests/spin on -1 on the one core.  On two cores the sample
+# program has both cores go round a loop that writes for ever, and both
+# must be stopped.
+for options in "-cores 1" "-cores 1 -coresched free"; do
+  for n in "${!names[@]}"; do
+    rm -f "$work/out.txt" "$work/log.txt"
+    run -log summary $options "${programs[n]}" "${datas[n]}" \
+        "$work/out.txt" "$work/log.txt"
+    check "${names[n]} $options output" cmp -s "$work/out.txt" "${outputs[n]}"
+    check "${names[n]} $options summary" \
+      [ "$(sed -n 's/^SUMMARY: core 0, /SUMMARY: /p' "$work/log.txt")" \
+        = "${summaries[n]}" ]
+  done
+done
+run -log summary -cores 2 Tests/handoff Tests/seven.txt "$work/out.txt" \
+    "$work/log.txt"
+check "Tests/handoff -cores 2 output" \
+  cmp -s "$work/out.txt" Tests/handoff_output.txt
+check "Tests/handoff -cores 2 log" \
+  same_log "$work/log.txt" Tests/handoff_log.txt
+for job in "2 Tests/handoff Tests/empty.txt" \
+           "1 Tests/spin Tests/minus_one.txt"; do
+  read -r cores program data <<< "$job"
+  timeout 60 ./Aprog -log summary -cores "$cores" "$program" "$data" \
+    "$work/out.txt" "$work/log.txt" > /dev/null
+  check "$program on $data -cores $cores exit status" [ $? -eq 1 ]
+  check "$program on $data -cores $cores stops the last core" \
+    grep -q "^SUMMARY: core $((cores - 1)), .*stopped in an infinite loop" \
+      "$work/log.txt"
+done
+timeout 60 ./Aprog -log summary -cores 2 adotout4 zzin.txt "$work/out.txt" \
+  "$work/log.txt" > /dev/null
+check "adotout4 on zzin.txt -cores 2 exit status" [ $? -eq 1 ]
+check "adotout4 on zzin.txt -cores 2 log" \
+  same_log "$work/log.txt" Tests/sample_cores_2_log.txt
+for options in "" "-log full" "-log diff" "-log summary -snapevery 2" \
+               "-log summary -engine jit" "-log summary -fuse no" \
+               "-log summary -hottrace no" "-log summary -prefix 3" \
+               "-log summary -threads 2"; do
+  run $options -cores 1 Tests/countdown Tests/countdown_3.txt \
+      "$work/out.txt" "$work/log.txt"
+  check "-cores ${options:-with no -log} is refused" [ $? -eq 1 ]
+done
+run -log none -cores 1 Tests/countdown Tests/countdown_3.txt "$work/out.txt" \
+    "$work/log.txt"
+check "-cores -log none log" no_lines '^SUMMARY:' "$work/log.txt"
+for options in "-cores 2 -slice 3" "-cores 2 -coresched free" \
+               "-cores 2 -coresched free -slice 50"; do
+  rm -f "$work/out.txt"
+  run -log summary $options Tests/handoff Tests/seven.txt "$work/out.txt" \
+      "$work/log.txt"
+  check "Tests/handoff $options output" \
+    cmp -s "$work/out.txt" Tests/handoff_output.txt
+done
+
+# The library, which must run each job as 'Aprog' does, and say how a
+# run ended: finished, out of its budget just before the last 'STP' or
+# partway through a loop or a store into code, out of data, or stopped
+# in an infinite loop, whichever comes first.
+for n in "${!names[@]}"; do
+  rm -f "$work/out.txt" "$work/log.txt"
+  ./Tests/librun "${programs[n]}.txt" "${datas[n]}" "$work/out.txt" \
+    "$work/log.txt" > "$work/result.txt"
+  check "${names[n]} libpullet16 exit status" [ $? -eq 0 ]
+  check "${names[n]} libpullet16 output" \
+    cmp -s "$work/out.txt" "${outputs[n]}"
+  check "${names[n]} libpullet16 summary" \
+    [ "$(grep '^SUMMARY:' "$work/log.txt")" = "${summaries[n]}" ]
+done
+{
+  for budget in 23 22 10; do
+    ./Tests/librun -budget $budget Tests/countdown.txt Tests/countdown_3.txt \
+      "$work/out_$budget.txt" "$work/log.txt"
+  done
+  ./Tests/librun Tests/countdown.txt Tests/empty.txt "$work/out.txt" \
+    "$work/log.txt"
+  ./Tests/librun Tests/spin.txt Tests/minus_one.txt "$work/out.txt" \
+    "$work/log_spin.txt"
+  ./Tests/librun -budget 20 Tests/spin.txt Tests/minus_one.txt \
+    "$work/out.txt" "$work/log.txt"
+  ./Tests/librun -budget 20 Tests/selfmod.txt Tests/countdown_3.txt \
+    "$work/out.txt" "$work/log.txt"
+} > "$work/results.txt"
+check "libpullet16 results" cmp -s "$work/results.txt" Tests/librun_results.txt
+check "libpullet16 out of budget output" \
+  cmp -s "$work/out_10.txt" <(head -n 1 Tests/countdown_3_output.txt)
+run -log summary Tests/spin Tests/minus_one.txt "$work/out.txt" \
+    "$work/log.txt"
+check "libpullet16 loop log" same_log "$work/log_spin.txt" "$work/log.txt"
+
+# The daemon, on two workers and on the 'jit' engine, which must run each
+# job as 'Aprog' does, twice so that the second runs on a machine kept
+# idle, end runs as the library does, refuse a 'RUN' of too many values,
+# and stop when told to even with an idle connection open.  On the 'jit'
+# engine, Tests/spin in its loop must still be stopped; with loop checks
+# off the 'jit' engine really runs, so only jobs that finish are sent.
+# Options the daemon would ignore must be refused.
+seq 65537 | sed 's/.*/+0001/' > "$work/too_many.txt"
+for options in "-threads 2" "-engine jit" "-engine jit -loopcheck 0"; do
+  rm -f "$work/socket"
+  ./Aprog -log summary $options -daemon "$work/socket" "$work/log.txt" \
+    > /dev/null &
+  daemon=$!
+  for again in "" " again"; do
+    for n in "${!names[@]}"; do
+      rm -f "$work/out.txt"
+      ./Tests/daemonrun -stay "$work/socket" "${programs[n]}.txt" \
+        "${datas[n]}" "$work/out.txt" > "$work/result.txt"
+      check "${names[n]} -daemon $options answers$again" [ $? -eq 0 ]
+      check "${names[n]} -daemon $options output$again" \
+        cmp -s "$work/out.txt" "${outputs[n]}"
+      check "${names[n]} -daemon $options result$again" \
+        [ "$(cat "$work/result.txt")" \
+          = "$(finished_result "${summaries[n]}")" ]
+    done
+  done
+  if [ "$options" != "-engine jit -loopcheck 0" ]; then
+    {
+      for budget in 23 22 10; do
+        ./Tests/daemonrun -stay -budget $budget "$work/socket" \
+          Tests/countdown.txt Tests/countdown_3.txt "$work/out_$budget.txt"
+      done
+      ./Tests/daemonrun -stay "$work/socket" Tests/countdown.txt \
+        Tests/empty.txt "$work/out.txt"
+      ./Tests/daemonrun -stay "$work/socket" Tests/spin.txt \
+        Tests/minus_one.txt "$work/out.txt"
+      ./Tests/daemonrun -stay -budget 20 "$work/socket" Tests/spin.txt \
+        Tests/minus_one.txt "$work/out.txt"
+      ./Tests/daemonrun -stay -budget 20 "$work/socket" Tests/selfmod.txt \
+        Tests/countdown_3.txt "$work/out.txt"
+    } > "$work/results.txt"
+    check "-daemon $options results" \
+      cmp -s "$work/results.txt" Tests/librun_results.txt
+    check "-daemon $options out of budget output" \
+      cmp -s "$work/out_10.txt" <(head -n 1 Tests/countdown_3_output.txt)
+    ./Tests/daemonrun -stay "$work/socket" Tests/countdown.txt \
+      "$work/too_many.txt" "$work/out.txt" > "$work/result.txt"
+    check "-daemon $options refuses too many values" \
+      grep -q "^daemonrun: no output, 'ERROR bad request" "$work/result.txt"
+  fi
+  ./Tests/daemonrun "$work/socket" Tests/countdown.txt Tests/seven.txt \
+    "$work/out.txt" > "$work/result.txt"
+  answered=$?
+  [ $answered -eq 0 ] || kill $daemon
+  wait $daemon
+  stopped=$?
+  check "-daemon $options answers before it stops" [ $answered -eq 0 ]
+  check "-daemon $options stops" [ $stopped -eq 0 ]
+done
+check "-daemon on one worker log" \
+  grep -q "^DAEMON: listening on '.*' with 1 worker$" "$work/log.txt"
+for options in "" "-log full" "-log none" "-log summary -snapevery 2" \
+               "-log summary -fuse no" "-log summary -hottrace no" \
+               "-log summary -prefix 3"; do
+  rm -f "$work/socket"
+  run $options -daemon "$work/socket" "$work/log.txt"
+  check "-daemon ${options:-with no -log} is refused" [ $? -eq 1 ]
+done
+
+# Each program as C++, compiled and run on its own.
+for n in "${!names[@]}"; do
+  rm -f "$work/out.txt" "$work/program"
+  run -log none -emitcpp "$work/program.cc" "${programs[n]}" "${datas[n]}" \
+      "$work/out_aprog.txt" "$work/log.txt"
+  ${CXX:-g++} -O1 -std=c++11 -o "$work/program" "$work/program.cc" \
+    && "$work/program" "${datas[n]}" "$work/out.txt" > /dev/null
+  check "${names[n]} -emitcpp output" cmp -s "$work/out.txt" "${outputs[n]}"
+done
+
+echo "$failures failed"
+exit $failures
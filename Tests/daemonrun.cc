@@ -0,0 +1,170 @@
+/****************************************************************
+ * Test client for 'Aprog -daemon': send an 'a.out' file to the
+ * daemon on a socket, run it on a data file, with a budget of
+ * 'count' instructions if '-budget' is given, write the output
+ * lines to a file and the 'RESULT' line to 'cout', and then tell
+ * the daemon to stop, unless '-stay' is given.  Another connection
+ * is kept open the whole time and sends nothing, so that a daemon
+ * that waits on it would never answer.
+ *
+ * Usage: daemonrun [-budget count] [-stay] socketfilename
+ *                  adotoutfilename datafilename outfilename
+ *
+ * The exit status is 0 if every answer came, and 1 otherwise.
+**/
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::string;
+
+/****************************************************************
+ * Connect to the daemon on 'socket_filename', trying for a few
+ * seconds while it starts.
+ *
+ * Returns:
+ *   the descriptor, or -1 if it cannot be reached
+**/
+static int Connect(const string& socket_filename) {
+  struct sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_filename.c_str(),
+               sizeof(address.sun_path) - 1);
+  for (int tries = 0; tries < 100; ++tries) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0
+        && connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                   sizeof(address)) == 0) {
+      struct timeval timeout = { 10, 0 };
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      return fd;
+    }
+    if (fd >= 0) close(fd);
+    usleep(50000);
+  }
+  return -1;
+}
+
+/****************************************************************
+ * Read one line from 'fd' into 'line', without its end of line.
+ *
+ * Returns:
+ *   false if the connection closed or nothing came in time
+**/
+static bool ReadLine(int fd, string& line) {
+  line.clear();
+  char c = 0;
+  while (read(fd, &c, 1) == 1) {
+    if (c == '\n') return true;
+    line += c;
+  }
+  return false;
+}
+
+/****************************************************************
+ * Send all of 'text' on 'fd'.
+**/
+static void Send(int fd, const string& text) {
+  size_t written = 0;
+  while (written < text.size()) {
+    ssize_t count = write(fd, text.data() + written, text.size() - written);
+    if (count <= 0) return;
+    written += count;
+  }
+}
+
+/****************************************************************
+ * The lines of the file 'filename' that are not blank, with a
+ * count of them.
+**/
+static string ReadLines(const string& filename, int& count) {
+  ifstream in_stream(filename.c_str());
+  string lines = "";
+  string line = "";
+  count = 0;
+  while (in_stream >> line) {
+    lines += line + "\n";
+    ++count;
+  }
+  return lines;
+}
+
+int main(int argc, char* argv[]) {
+  string budget = "";
+  bool is_staying = false;
+  while (argc > 1 && argv[1][0] == '-') {
+    if (string(argv[1]) == "-budget" && argc > 2) {
+      budget = " " + string(argv[2]);
+      argv += 2;
+      argc -= 2;
+    } else if (string(argv[1]) == "-stay") {
+      is_staying = true;
+      ++argv;
+      --argc;
+    } else {
+      break;
+    }
+  }
+  if (argc != 5) {
+    cout << "usage: " << argv[0] << " [-budget count] [-stay] "
+         << "socketfilename adotoutfilename datafilename outfilename"
+         << endl;
+    return 1;
+  }
+  // A daemon that refuses a request closes the connection without
+  // reading the rest of it, and what it said is still to be read.
+  std::signal(SIGPIPE, SIG_IGN);
+  int idle_fd = Connect(argv[1]);
+  int fd = Connect(argv[1]);
+  if (idle_fd < 0 || fd < 0) {
+    cout << "daemonrun: cannot connect to '" << argv[1] << "'" << endl;
+    return 1;
+  }
+
+  int word_count = 0;
+  string words = ReadLines(argv[2], word_count);
+  int value_count = 0;
+  string values = ReadLines(argv[3], value_count);
+
+  string line = "";
+  Send(fd, "PROGRAM " + std::to_string(word_count) + "\n" + words);
+  if (!ReadLine(fd, line) || line.compare(0, 8, "PROGRAM ") != 0) {
+    cout << "daemonrun: no program key, '" << line << "'" << endl;
+    return 1;
+  }
+  string key = line.substr(8);
+
+  Send(fd, "RUN " + key + " " + std::to_string(value_count) + budget + "\n"
+           + values);
+  if (!ReadLine(fd, line) || line.compare(0, 7, "OUTPUT ") != 0) {
+    cout << "daemonrun: no output, '" << line << "'" << endl;
+    return 1;
+  }
+  ofstream out_stream(argv[4]);
+  for (int count = std::stoi(line.substr(7)); count > 0; --count) {
+    if (!ReadLine(fd, line)) return 1;
+    out_stream << line << "\n";
+  }
+  if (!ReadLine(fd, line)) return 1;
+  cout << line << endl;
+
+  if (!is_staying) {
+    Send(fd, "STOP\n");
+    if (!ReadLine(fd, line) || line != "STOPPING") return 1;
+  }
+  close(fd);
+  close(idle_fd);
+  return 0;
+}
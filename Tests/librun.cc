@@ -0,0 +1,81 @@
+/****************************************************************
+ * Test driver for 'libpullet16': run an 'a.out' file on a data
+ * file with a 'Pullet16Machine', as 'Aprog' would, with no more
+ * than 'count' instructions if '-budget' is given, write the
+ * output and the log of the run to the files named, and write how
+ * it ended to 'cout' as the daemon's 'RESULT' line does.
+ *
+ * Usage: librun [-budget count] adotoutfilename datafilename
+ *               outfilename logfilename
+ *
+ * The exit status is 0 if the run finished, and 1 otherwise.
+**/
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pullet16machine.h"
+
+using std::cout;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::string;
+using std::vector;
+
+int main(int argc, char* argv[]) {
+  int64_t budget = INT64_MAX;
+  if (argc == 7 && string(argv[1]) == "-budget") {
+    budget = std::atoll(argv[2]);
+    argv += 2;
+    argc -= 2;
+  }
+  if (argc != 5) {
+    cout << "usage: " << argv[0] << " [-budget count] adotoutfilename "
+         << "datafilename outfilename logfilename" << endl;
+    return 1;
+  }
+
+  // The words of the program are the lines of sixteen bits, and the
+  // values are the lines of a sign and four hex digits.
+  vector<uint16_t> words;
+  ifstream adotout_stream(argv[1]);
+  string line = "";
+  while (adotout_stream >> line) {
+    words.push_back(static_cast<uint16_t>(std::stoi(line, nullptr, 2)));
+  }
+  vector<int> input;
+  ifstream data_stream(argv[2]);
+  while (data_stream >> line) {
+    int value = std::stoi(line.substr(1), nullptr, 16);
+    input.push_back((line[0] == '-') ? -value : value);
+  }
+
+  Pullet16Machine machine;
+  if (!machine.Load(words.empty() ? nullptr : &words[0], words.size())) {
+    cout << "librun: the program is too big" << endl;
+    return 1;
+  }
+  string output = "";
+  Pullet16Machine::RunResult result;
+  machine.SetBudget(budget);
+  machine.Run(input.empty() ? nullptr : &input[0], input.size(), output,
+              result);
+
+  ofstream out_stream(argv[3]);
+  out_stream << output;
+  ofstream log_stream(argv[4]);
+  log_stream << result.log;
+
+  static const char* const kStatusNames[] = {
+    "finished", "outofdata", "outofbudget", "error", "badinput"
+  };
+  cout << "RESULT " << kStatusNames[result.status] << " "
+       << result.executed_count << " " << result.pc << " " << result.accum
+       << endl;
+  return (result.status == kMachineFinished) ? 0 : 1;
+}
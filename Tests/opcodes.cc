@@ -0,0 +1,71 @@
+/****************************************************************
+ * Test driver for the ISA tables in 'DABnamespace': disassemble
+ * every 16-bit word, assemble the text back into a word from
+ * 'kOpcodeTable' alone, and check that the word decodes to the
+ * same instruction and disassembles to the same text.
+ *
+ * Usage: opcodes
+ *
+ * The exit status is 0 if every word goes round, and 1 otherwise.
+**/
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "dabnamespace.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/****************************************************************
+ * Assemble the 'text' that 'Disassemble' wrote for a word, or
+ * give -1 if its mnemonic is not in the table.  An 'EEE' word
+ * that does nothing comes back as the one with low bits zero.
+**/
+static int Assemble(const string& text) {
+  for (int opcode = 0; opcode < DABnamespace::kOpcodeCount; ++opcode) {
+    const DABnamespace::OpcodeInfo& info = DABnamespace::kOpcodeTable[opcode];
+    if (text.compare(0, 3, info.mnemonic) != 0) continue;
+    int word = info.mnemonic_bits << 13;
+    if (info.operand_kind == DABnamespace::kAddressOperand) {
+      word |= (text[4] == '*') ? 0x1000 : 0;
+      word |= std::stoi(text.substr(5));
+    } else if (info.function_bits >= 0) {
+      word |= info.function_bits;
+    }
+    return word;
+  }
+  return -1;
+}
+
+int main() {
+  int failures = 0;
+  for (int word = 0; word < 0x10000; ++word) {
+    DABnamespace::Opcode opcode = DABnamespace::OpcodeOfWord(word);
+    string text = DABnamespace::Disassemble(word);
+    int again = Assemble(text);
+    bool is_same = again >= 0
+                   && DABnamespace::OpcodeOfWord(again) == opcode
+                   && DABnamespace::Disassemble(again) == text;
+    // Only an instruction with a target has an operand to decode.
+    if (is_same && DABnamespace::kOpcodeTable[opcode].operand_kind
+                     == DABnamespace::kAddressOperand) {
+      DABnamespace::DecodedInstruction inst =
+        DABnamespace::DecodeWord(word, 4095);
+      DABnamespace::DecodedInstruction inst_again =
+        DABnamespace::DecodeWord(again, 4095);
+      is_same = inst.indirect == inst_again.indirect
+                && inst.operand == inst_again.operand;
+    }
+    if (!is_same) {
+      if (failures < 10) {
+        cout << "opcodes: word " << word << " is '" << text
+             << "', which assembles to " << again << endl;
+      }
+      ++failures;
+    }
+  }
+  return (failures == 0) ? 0 : 1;
+}
@@ -6,9 +6,9 @@
 static const char kTag[] = "UTILS: ";
 static const char WHITESPACE[] = " \n\t\r";
 
-std::ofstream Utils::log_stream;
-std::ostringstream Utils::oss;
-std::stringstream Utils::ss;
+thread_local std::ofstream Utils::log_stream;
+thread_local std::ostringstream Utils::oss;
+thread_local std::stringstream Utils::ss;
 
 /****************************************************************
  * Constructor.
@@ -181,6 +181,43 @@ void Utils::LogFileOpen(std::string filename) {
   std::cout << kTag << "open succeeded for '" << filename << "'" << std::endl;
 }
 
+/****************************************************************
+ * Send this thread's 'log_stream' to 'buffer' instead of to its
+ * file, or back to its file if 'buffer' is null.
+ *
+ * Parameters:
+ *   buffer - where the log is to go, or null
+ * Return: none
+**/
+void Utils::LogToBuffer(std::streambuf* buffer) {
+  std::ostream& stream = log_stream;
+  stream.rdbuf((buffer == nullptr) ? log_stream.rdbuf() : buffer);
+}
+
+/****************************************************************
+ * Send this thread's 'log_stream' to 'buffer' until the guard is
+ * destroyed, keeping where it went before, which may itself be a
+ * buffer.
+ *
+ * Parameters:
+ *   buffer - where the log is to go
+**/
+LogToBufferGuard::LogToBufferGuard(std::streambuf* buffer) {
+  std::ostream& stream = Utils::log_stream;
+  stream.flush();
+  previous_ = stream.rdbuf();
+  Utils::LogToBuffer(buffer);
+}
+
+/****************************************************************
+ * Send this thread's 'log_stream' back to where it went before
+ * the guard was made.
+**/
+LogToBufferGuard::~LogToBufferGuard() {
+  Utils::log_stream.flush();
+  Utils::LogToBuffer(previous_);
+}
+
 /****************************************************************
  * These are the overloaded formatting functions that all return
  * a 'string' value after having formatted the first argument.
@@ -612,7 +649,7 @@ LONG Utils::StringToLONG(std::string input) {
  * Returns: the 'string' version of the timing log
 **/
 std::string Utils::TimeCall(const std::string time_string) {
-  static double time_new = 0.0;
+  static thread_local double time_new = 0.0;
   return Utils::TimeCall(time_string, time_new);
 }
 
@@ -627,13 +664,14 @@ std::string Utils::TimeCall(const std::string timestring,
                             double& timeNew) {
   char s[160];
   std::string return_value;
-  static bool firsttime = true;
-  static double usercurrent = 0.0, userone = 0.0, usertwo = 0.0;
-  static double systemcurrent = 0.0, systemone = 0.0, systemtwo = 0.0;
-  static double cpupctone, cpupcttwo;
-  static double TIMEsystemtotal, TIMEusertotal;
-  static struct rusage rusage;
-  static time_t TIMEtcurrent, TIMEtone, TIMEttotal = 0.0, TIMEttwo;
+  static thread_local bool firsttime = true;
+  static thread_local double usercurrent = 0.0, userone = 0.0, usertwo = 0.0;
+  static thread_local double systemcurrent = 0.0, systemone = 0.0,
+                             systemtwo = 0.0;
+  static thread_local double cpupctone, cpupcttwo;
+  static thread_local double TIMEsystemtotal, TIMEusertotal;
+  static thread_local struct rusage rusage;
+  static thread_local time_t TIMEtcurrent, TIMEtone, TIMEttotal = 0.0, TIMEttwo;
 
   if (firsttime) {
     firsttime = false;
@@ -715,7 +753,7 @@ std::string Utils::TimeCall(const std::string timestring,
  * Returns: none
 **/
 void Utils::ToLower(std::string& to, const std::string from) {
-  static char c[1024];
+  static thread_local char c[1024];
 
   snprintf(c, 1024, "%s", from.c_str());
   for (UINT i = 0; i < from.length(); ++i) {
@@ -34,15 +34,17 @@ typedef int64_t LONG;
 class Utils {
  public:
 /****************************************************************
- * Input, output, and log streams.
+ * Input, output, and log streams.  Each thread has its own, so
+ * that threads can run interpreters side by side; the log file
+ * opened with 'LogFileOpen' is the one of the thread that opened it.
 **/
 //  static ifstream inStream; //deprecated
 //  static ofstream outStream; //deprecated
-  static std::ofstream log_stream;
+  static thread_local std::ofstream log_stream;
 
 //  static stringstream utilsss(stringstream::in | stringstream::out);
-  static std::stringstream ss;
-  static std::ostringstream oss;
+  static thread_local std::stringstream ss;
+  static thread_local std::ostringstream oss;
 
 /****************************************************************
  * Constructors and destructors for the class. 
@@ -68,6 +70,7 @@ class Utils {
   static void InFileOpen(const std::string filename);
 //  static void OutFileOpen(const string fileName);
   static void LogFileOpen(const std::string filename);
+  static void LogToBuffer(std::streambuf* buffer);
 
 /****************************************************************
  * all sorts of formatting functions
@@ -120,4 +123,21 @@ class Utils {
  private:
 };
 
+/****************************************************************
+ * Sends this thread's 'Utils::log_stream' to a buffer with
+ * 'Utils::LogToBuffer' for as long as it lives, and then back to
+ * wherever it went before, even if an exception is thrown.
+**/
+class LogToBufferGuard {
+ public:
+  explicit LogToBufferGuard(std::streambuf* buffer);
+  virtual ~LogToBufferGuard();
+
+ private:
+  std::streambuf* previous_;
+
+  LogToBufferGuard(const LogToBufferGuard&) = delete;
+  LogToBufferGuard& operator=(const LogToBufferGuard&) = delete;
+};
+
 #endif /*UTILS_H_*/
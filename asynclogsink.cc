@@ -0,0 +1,295 @@
+#include "asynclogsink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'AsyncLogSink' for writing the trace on a thread of its own.
+ *
+ * The interpreter hands over each line of the trace as a fixed-size
+ * 'TraceRecord' through a single-producer single-consumer ring, which takes
+ * no locks: 'Put' only ever writes 'head_' and the writer thread only ever
+ * writes 'tail_'.  The writer thread turns the records back into the text
+ * of the trace, into a buffer that it writes to the log a megabyte at a
+ * time.
+ *
+ * To print the machine the writer keeps its own copy of memory, which the
+ * interpreter keeps up to date with a 'kStoreRecord' for every store, and
+ * it keeps the 'MEM' lines of the dump formatted, so printing the machine
+ * is mostly copying.
+ *
+ * The formatting functions are also what the interpreter uses when it
+ * writes the trace itself, so the two always write the same text.  They
+ * format with 'snprintf' rather than 'Utils::Format', which shares one
+ * stream between all its callers.
+ *
+ * Nothing else may write to the log while the writer thread is running,
+ * except after a 'Drain', which returns once everything handed over so far
+ * has been written.
+**/
+
+namespace {
+const char kStars[] =
+  "********* ********* ********* ********* "
+  "********* ********* ********* ********* ";
+
+// The text before the flag and target of each instruction that has them,
+// made from 'kOpcodeTable' as the trace has always had it: the branches
+// have no 'EXECUTE:' tag, and they and 'AND' pad the mnemonic with one
+// space rather than eight.
+const string* MakeOperandPrefixes() {
+  static string prefixes[DABnamespace::kOpcodeCount];
+  for (int opcode = 0; opcode < DABnamespace::kOpcodeCount; ++opcode) {
+    const DABnamespace::OpcodeInfo& info = DABnamespace::kOpcodeTable[opcode];
+    if (info.operand_kind != DABnamespace::kAddressOperand) continue;
+    bool is_branch = opcode == DABnamespace::kBAN
+                     || opcode == DABnamespace::kBR;
+    prefixes[opcode] = is_branch ? "" : "EXECUTE:    ";
+    prefixes[opcode] += "OPCODE ADDR TARGET ";
+    prefixes[opcode] += info.mnemonic;
+    prefixes[opcode] += (is_branch || opcode == DABnamespace::kAND)
+                          ? " " : "        ";
+  }
+  return prefixes;
+}
+
+const string* const kOperandPrefixes = MakeOperandPrefixes();
+}  // namespace
+
+const char AsyncLogSink::kMachineTrailer[] =
+  "\n"
+  "********* ********* ********* ********* "
+  "********* ********* ********* ********* ";
+
+/***************************************************************************
+ * Constructor
+**/
+AsyncLogSink::AsyncLogSink()
+    : log_stream_(nullptr), head_(0), tail_(0), cached_tail_(0),
+      flushes_done_(0), flushes_asked_(0), memory_size_(0) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+AsyncLogSink::~AsyncLogSink() {
+  Stop();
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'AppendLine'.
+ * Append the text of a record that is not the machine to 'out'.
+ *
+ * Parameters:
+ *   record - the record
+ *   memory - memory as it was when the record was made
+ *   out - the string to append to
+**/
+void AsyncLogSink::AppendLine(const TraceRecord& record,
+                              const uint16_t* memory, string& out) {
+  switch (record.kind) {
+    case kOperandRecord: {
+      char operand[32];
+      uint16_t word = memory[record.address];
+      snprintf(operand, sizeof(operand), "%d ", (word >> 12) & 0x1);
+      out += kOperandPrefixes[record.flag];
+      out += operand;
+      out += DABnamespace::DecToBitString(word & 0xFFF, 12);
+      out += '\n';
+      break;
+    }
+    case kNotNegativeRecord:
+      out += "the accumulator was not negative.\n";
+      break;
+    case kReadRecord:
+      out += "OPCODE ";
+      out += DABnamespace::MnemonicOf(DABnamespace::kRD);
+      out += record.flag ? " \ntrue\n" : " \nfalse\n";
+      break;
+    case kStopRecord:
+      out += "OPCODE ";
+      out += DABnamespace::MnemonicOf(DABnamespace::kSTP);
+      out += " \n";
+      break;
+    case kWriteRecord:
+      out += "EXECUTE:    OPCODE             ";
+      out += DABnamespace::MnemonicOf(DABnamespace::kWRT);
+      out += '\n';
+      break;
+    default:
+      break;
+  }
+}
+
+/***************************************************************************
+ * Function 'AppendMachineHeader'.
+ * Append the part of the printed machine that comes before the memory.
+**/
+void AsyncLogSink::AppendMachineHeader(int pc, int accum, string& out) {
+  char line[64];
+  out += '\n';
+  out += kStars;
+  out += "\nMACHINE IS NOW\n";
+  snprintf(line, sizeof(line), "PC    %8d\n", pc);
+  out += line;
+  snprintf(line, sizeof(line), "ACCUM %8d ",
+           DABnamespace::TwosComplement(accum));
+  out += line;
+  out += DABnamespace::DecToBitString(accum, 16);
+  out += "\n\n";
+}
+
+/***************************************************************************
+ * Function 'AppendMemoryLine'.
+ * Append the 'MEM' line of the printed machine that starts at 'first'.
+**/
+void AsyncLogSink::AppendMemoryLine(int first, const uint16_t* memory,
+                                    int memory_size, string& out) {
+  char line[32];
+  snprintf(line, sizeof(line), "MEM %4d-%4d", first, first + 3);
+  out += line;
+  for (int sub = first; sub < first + 4 && sub < memory_size; ++sub) {
+    out += ' ';
+    out += DABnamespace::DecToBitString(memory[sub], 16);
+  }
+  out += '\n';
+}
+
+/***************************************************************************
+ * Function 'Drain'.
+ * Wait until everything handed over so far is written to the log.
+**/
+void AsyncLogSink::Drain() {
+  if (!writer_.joinable()) return;
+  ++flushes_asked_;
+  TraceRecord record = { kFlushRecord, 0, 0, 0 };
+  Put(record);
+  while (flushes_done_.load(std::memory_order_acquire) < flushes_asked_) {
+    std::this_thread::yield();
+  }
+}
+
+/***************************************************************************
+ * Function 'Load'.
+ * Take a new copy of memory, when the writer thread is not running or
+ * everything has been drained.
+**/
+void AsyncLogSink::Load(const uint16_t* memory, int memory_size) {
+  memory_size_ = memory_size;
+  std::copy(memory, memory + DABnamespace::kMaxMemory, memory_);
+  memory_lines_.assign((memory_size + 3) / 4, "");
+  for (size_t line = 0; line < memory_lines_.size(); ++line) {
+    AppendMemoryLine(4 * line, memory_, memory_size_, memory_lines_[line]);
+  }
+}
+
+/***************************************************************************
+ * Function 'Start'.
+ * Start the writer thread, with a copy of memory as it is now.
+ *
+ * Parameters:
+ *   log_stream - where to write
+ *   memory - the whole of memory, 'kMaxMemory' words
+ *   memory_size - how much of it is the program, to be printed
+**/
+void AsyncLogSink::Start(std::ostream& log_stream, const uint16_t* memory,
+                         int memory_size) {
+  Stop();
+  log_stream_ = &log_stream;
+  ring_.assign(kRingSize, TraceRecord());
+  head_.store(0);
+  tail_.store(0);
+  cached_tail_ = 0;
+  flushes_done_.store(0);
+  flushes_asked_ = 0;
+  Load(memory, memory_size);
+  writer_ = std::thread(&AsyncLogSink::Write, this);
+}
+
+/***************************************************************************
+ * Function 'Stop'.
+ * Write everything that is left and stop the writer thread.
+**/
+void AsyncLogSink::Stop() {
+  if (!writer_.joinable()) return;
+  TraceRecord record = { kEndRecord, 0, 0, 0 };
+  Put(record);
+  writer_.join();
+  log_stream_->flush();
+}
+
+/***************************************************************************
+ * Function 'Write'.
+ * The writer thread.  It waits, yielding and then sleeping a little, for
+ * records to turn up, and formats them all before it lets 'Put' reuse
+ * their slots.
+**/
+void AsyncLogSink::Write() {
+  string buffer;
+  buffer.reserve(2 * kWriteSize);
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  int idle = 0;
+  for (;;) {
+    size_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) {
+      if (++idle < 1000) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+      continue;
+    }
+    idle = 0;
+
+    for (; tail != head; ++tail) {
+      const TraceRecord& record = ring_[tail & (ring_.size() - 1)];
+      switch (record.kind) {
+        case kMachineRecord:
+          AppendMachineHeader(record.address, record.value, buffer);
+          for (size_t line = 0; line < memory_lines_.size(); ++line) {
+            buffer += memory_lines_[line];
+          }
+          buffer += kMachineTrailer;
+          buffer += '\n';
+          break;
+        case kStoreRecord:
+          memory_[record.address] = static_cast<uint16_t>(record.value);
+          if (record.address < memory_size_) {
+            int line = record.address / 4;
+            memory_lines_[line].clear();
+            AppendMemoryLine(4 * line, memory_, memory_size_,
+                             memory_lines_[line]);
+          }
+          break;
+        case kFlushRecord:
+          log_stream_->write(buffer.data(), buffer.size());
+          buffer.clear();
+          flushes_done_.fetch_add(1, std::memory_order_release);
+          break;
+        case kEndRecord:
+          log_stream_->write(buffer.data(), buffer.size());
+          tail_.store(tail + 1, std::memory_order_release);
+          return;
+        default:
+          AppendLine(record, memory_, buffer);
+          break;
+      }
+    }
+    tail_.store(tail, std::memory_order_release);
+
+    if (buffer.size() >= kWriteSize) {
+      log_stream_->write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
+}
@@ -0,0 +1,107 @@
+/****************************************************************
+ * Header file for the 'AsyncLogSink' class that formats and writes
+ * the interpreter's trace on a thread of its own.
+**/
+
+#ifndef ASYNCLOGSINK_H
+#define ASYNCLOGSINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cin;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "dabnamespace.h"
+
+/****************************************************************
+ * One line, or one change, of the trace, as the interpreter hands
+ * it over.  What 'flag', 'address', and 'value' hold depends on
+ * the 'kind':
+ *
+ *   kMachineRecord - 'address' the PC and 'value' the accumulator
+ *   kOperandRecord - 'flag' the opcode and 'address' the PC, whose
+ *                    word gives the flag and target that are shown
+ *   kReadRecord - 'flag' whether there was data left to read
+ *   kStoreRecord - 'address' the word written and 'value' its value
+ *
+ * The other kinds are lines without any data, or are for the sink
+ * itself.
+**/
+struct TraceRecord {
+  uint8_t kind;
+  uint8_t flag;
+  uint16_t address;
+  int32_t value;
+};
+
+enum TraceRecordKind {
+  kMachineRecord, kOperandRecord, kNotNegativeRecord, kReadRecord,
+  kStopRecord, kWriteRecord, kStoreRecord, kFlushRecord, kEndRecord
+};
+
+class AsyncLogSink {
+ public:
+  AsyncLogSink();
+  virtual ~AsyncLogSink();
+
+  static void AppendLine(const TraceRecord& record, const uint16_t* memory,
+                         string& out);
+  static void AppendMachineHeader(int pc, int accum, string& out);
+  static void AppendMemoryLine(int first, const uint16_t* memory,
+                               int memory_size, string& out);
+  static const char kMachineTrailer[];
+
+  void Drain();
+  void Load(const uint16_t* memory, int memory_size);
+  void Start(std::ostream& log_stream, const uint16_t* memory,
+             int memory_size);
+  void Stop();
+
+  /****************************************************************
+   * Hand a record to the sink, waiting for room if the ring is
+   * full.  This is the only thing the interpreter does per line,
+   * so it is here to be inlined.
+  **/
+  void Put(const TraceRecord& record) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    while (head - cached_tail_ == ring_.size()) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head - cached_tail_ == ring_.size()) {
+        std::this_thread::yield();
+      }
+    }
+    ring_[head & (ring_.size() - 1)] = record;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+ private:
+  static const size_t kRingSize = 1 << 16;  // records, a power of two
+  static const size_t kWriteSize = 1 << 20;  // bytes per write
+
+  std::ostream* log_stream_;
+  std::thread writer_;
+
+  vector<TraceRecord> ring_;
+  std::atomic<size_t> head_;  // written only by 'Put'
+  std::atomic<size_t> tail_;  // written only by the writer thread
+  size_t cached_tail_;
+  std::atomic<int> flushes_done_;
+  int flushes_asked_;
+
+  int memory_size_;
+  uint16_t memory_[DABnamespace::kMaxMemory];
+  vector<string> memory_lines_;
+
+  void Write();
+};
+#endif
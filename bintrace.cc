@@ -0,0 +1,308 @@
+#include "bintrace.h"
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Classes 'BinaryTraceWriter' and 'BinaryTraceReader' for the binary trace.
+ *
+ * See 'bintrace.h' for the format.  The writer is told about each
+ * instruction before it executes, so it holds on to that record until the
+ * next instruction, or the end, tells it what the accumulator became.  It
+ * writes the file a megabyte at a time.
+**/
+
+namespace {
+const char kMagic[] = "P16T";
+const int kVersion = 1;
+const int kEndTag = 1;
+
+uint32_t ZigZag(int value) {
+  return (static_cast<uint32_t>(value) << 1)
+         ^ static_cast<uint32_t>(value >> 31);
+}
+
+int UnZigZag(uint32_t value) {
+  return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+}
+
+bool HasTarget(uint16_t word) {
+  return DABnamespace::kOpcodeTable[DABnamespace::OpcodeOfWord(word)]
+           .operand_kind == DABnamespace::kAddressOperand;
+}
+}  // namespace
+
+/***************************************************************************
+ * Constructors
+**/
+BinaryTraceWriter::BinaryTraceWriter()
+    : trace_stream_(nullptr), has_pending_(false), last_pc_(-1),
+      last_accum_(0) {
+}
+
+BinaryTraceReader::BinaryTraceReader()
+    : trace_stream_(nullptr), is_at_end_(true), status_(kTraceTruncated),
+      last_pc_(-1), last_accum_(0) {
+}
+
+/***************************************************************************
+ * Destructors
+**/
+BinaryTraceWriter::~BinaryTraceWriter() {
+}
+
+BinaryTraceReader::~BinaryTraceReader() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Accessor for 'is_at_end_', whether 'Next' has returned the last record.
+**/
+bool BinaryTraceReader::IsAtEnd() const {
+  return is_at_end_;
+}
+
+/***************************************************************************
+ * Accessor for 'status_', how the run ended, once 'IsAtEnd'.
+**/
+TraceStatus BinaryTraceReader::GetStatus() const {
+  return status_;
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Finish'.
+ * Write the last record and the end marker, and flush the trace.
+ *
+ * Parameters:
+ *   accum - the accumulator after the last instruction
+ *   status - how the run ended
+**/
+void BinaryTraceWriter::Finish(int accum, TraceStatus status) {
+  if (trace_stream_ == nullptr) return;
+  if (has_pending_) {
+    WritePending(accum);
+  }
+  PutUnsigned(kEndTag);
+  buffer_ += static_cast<char>(status);
+  trace_stream_->write(buffer_.data(), buffer_.size());
+  trace_stream_->flush();
+  buffer_.clear();
+  trace_stream_ = nullptr;
+}
+
+/***************************************************************************
+ * Function 'Instruction'.
+ * Note an instruction that is about to execute.
+ *
+ * Parameters:
+ *   pc - its address
+ *   word - the word there
+ *   accum - the accumulator before it executes
+ *   effective_address - where its target is, if it has one
+**/
+void BinaryTraceWriter::Instruction(int pc, uint16_t word, int accum,
+                                    int effective_address) {
+  if (has_pending_) {
+    WritePending(accum);
+  }
+  pending_.pc = pc;
+  pending_.word = word;
+  pending_.accum_before = accum;
+  pending_.effective_address = effective_address;
+  has_pending_ = true;
+}
+
+/***************************************************************************
+ * Functions 'Put16', 'PutSigned', and 'PutUnsigned'.
+ * Add a number to the buffer.
+**/
+void BinaryTraceWriter::Put16(int value) {
+  buffer_ += static_cast<char>(value & 0xFF);
+  buffer_ += static_cast<char>((value >> 8) & 0xFF);
+}
+
+void BinaryTraceWriter::PutSigned(int value) {
+  PutUnsigned(ZigZag(value));
+}
+
+void BinaryTraceWriter::PutUnsigned(uint32_t value) {
+  while (value >= 0x80) {
+    buffer_ += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  buffer_ += static_cast<char>(value);
+}
+
+/***************************************************************************
+ * Function 'Start'.
+ * Write the header, with the program as it is in memory now.
+ *
+ * Parameters:
+ *   trace_stream - where to write, opened in binary mode
+ *   memory - the memory image
+ *   memory_size - the number of words in the program
+**/
+void BinaryTraceWriter::Start(std::ostream& trace_stream,
+                              const uint16_t* memory, int memory_size) {
+  trace_stream_ = &trace_stream;
+  buffer_.clear();
+  buffer_.reserve(kWriteSize + 64);
+  has_pending_ = false;
+  last_pc_ = -1;
+  last_accum_ = 0;
+
+  buffer_ += kMagic;
+  buffer_ += static_cast<char>(kVersion);
+  Put16(memory_size);
+  for (int address = 0; address < memory_size; ++address) {
+    Put16(memory[address]);
+  }
+}
+
+/***************************************************************************
+ * Function 'WritePending'.
+ * Encode the instruction noted last, now that its result is known.
+**/
+void BinaryTraceWriter::WritePending(int accum_after) {
+  PutUnsigned(ZigZag(pending_.pc - (last_pc_ + 1)) << 1);
+  Put16(pending_.word);
+  PutSigned(pending_.accum_before - last_accum_);
+  PutSigned(accum_after - pending_.accum_before);
+  if (HasTarget(pending_.word)) {
+    PutSigned(pending_.effective_address - (pending_.word & 0xFFF));
+  }
+  last_pc_ = pending_.pc;
+  last_accum_ = accum_after;
+  has_pending_ = false;
+
+  if (buffer_.size() >= kWriteSize) {
+    trace_stream_->write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+/***************************************************************************
+ * Functions 'Get16', 'GetSigned', and 'GetUnsigned'.
+ * Read a number from the trace.
+**/
+int BinaryTraceReader::Get16() {
+  int low = trace_stream_->get() & 0xFF;
+  int high = trace_stream_->get() & 0xFF;
+  return low | (high << 8);
+}
+
+int BinaryTraceReader::GetSigned() {
+  return UnZigZag(GetUnsigned());
+}
+
+uint32_t BinaryTraceReader::GetUnsigned() {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int byte = trace_stream_->get();
+    if (byte == EOF) break;
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) break;
+  }
+  return value;
+}
+
+/***************************************************************************
+ * Function 'LookForEnd'.
+ * See whether the end marker, or the end of the file, comes next.
+**/
+void BinaryTraceReader::LookForEnd() {
+  int next = trace_stream_->peek();
+  if (next == kEndTag) {
+    trace_stream_->get();
+    int status = trace_stream_->get();
+    status_ = (status >= kTraceOutOfData && status <= kTraceLooping)
+                ? static_cast<TraceStatus>(status) : kTraceFinished;
+    is_at_end_ = true;
+  } else if (next == EOF || !*trace_stream_) {
+    status_ = kTraceTruncated;
+    is_at_end_ = true;
+  }
+}
+
+/***************************************************************************
+ * Function 'Next'.
+ * Read the next record.
+ *
+ * Returns:
+ *   false if there are no more
+**/
+bool BinaryTraceReader::Next(TraceEntry& entry) {
+  if (is_at_end_) return false;
+
+  int head = static_cast<int>(GetUnsigned());
+  entry.pc = last_pc_ + 1 + UnZigZag(head >> 1);
+  entry.word = static_cast<uint16_t>(Get16());
+  entry.accum_before = last_accum_ + GetSigned();
+  entry.accum_after = entry.accum_before + GetSigned();
+  entry.effective_address = -1;
+  if (HasTarget(entry.word)) {
+    entry.effective_address = (entry.word & 0xFFF) + GetSigned();
+  }
+  last_pc_ = entry.pc;
+  last_accum_ = entry.accum_after;
+
+  // A record that points outside memory can only come from a corrupt
+  // file, and is read as the end of it.
+  if (!*trace_stream_ || entry.pc < 0
+      || entry.pc >= DABnamespace::kMaxMemory
+      || entry.effective_address >= DABnamespace::kMaxMemory) {
+    status_ = kTraceTruncated;
+    is_at_end_ = true;
+    return false;
+  }
+  LookForEnd();
+  return true;
+}
+
+/***************************************************************************
+ * Function 'Start'.
+ * Read the header.
+ *
+ * Parameters:
+ *   trace_stream - the trace, opened in binary mode
+ *   program - set to the program as it was loaded
+ *
+ * Returns:
+ *   false if this is not a trace that we can read
+**/
+bool BinaryTraceReader::Start(std::istream& trace_stream,
+                              vector<uint16_t>& program) {
+  trace_stream_ = &trace_stream;
+  is_at_end_ = true;
+  status_ = kTraceTruncated;
+  last_pc_ = -1;
+  last_accum_ = 0;
+
+  char magic[4];
+  trace_stream.read(magic, sizeof(magic));
+  int version = trace_stream.get();
+  if (!trace_stream || string(magic, sizeof(magic)) != kMagic
+      || version != kVersion) {
+    return false;
+  }
+  int memory_size = Get16();
+  if (memory_size > DABnamespace::kMaxMemory) {
+    return false;
+  }
+  program.resize(memory_size);
+  for (int address = 0; address < memory_size; ++address) {
+    program[address] = static_cast<uint16_t>(Get16());
+  }
+  if (!trace_stream) {
+    return false;
+  }
+
+  is_at_end_ = false;
+  LookForEnd();
+  return true;
+}
@@ -0,0 +1,115 @@
+/****************************************************************
+ * Header file for the binary trace of a Pullet16 run, with the
+ * 'BinaryTraceWriter' that the interpreter writes it with and the
+ * 'BinaryTraceReader' that 'Tprog' reads it back with.
+ *
+ * The file is a header and then one record for every instruction
+ * that was interpreted, in order, and then an end marker.
+ *
+ * Header:
+ *   "P16T", a version byte, the size of the program as two bytes,
+ *   and then the program's words as loaded, two bytes each.  All
+ *   multibyte numbers are little endian.
+ *
+ * Record, as variable length numbers (seven bits to the byte, low
+ * bits first, the top bit set on all but the last byte), signed
+ * ones zigzag encoded:
+ *   twice the PC's distance from the previous PC plus one (so the
+ *     next word in line is 0), which is even
+ *   the raw word, as two plain bytes
+ *   the accumulator before, less the previous accumulator after
+ *   the accumulator after, less the accumulator before
+ *   for an instruction with a target, the effective address less
+ *     the address bits of the word
+ *
+ * End marker:
+ *   1, which no record starts with, and a status byte.
+**/
+
+#ifndef BINTRACE_H
+#define BINTRACE_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cin;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "dabnamespace.h"
+
+// How a traced run ended.  A reader reports a file that stops short of
+// its end marker, or has a record with an address outside memory, as
+// truncated, as a writer does a run that is given up before it ends.
+enum TraceStatus {
+  kTraceFinished = 0, kTraceOutOfData = 1, kTraceTruncated = 2,
+  kTraceLooping = 3
+};
+
+// One interpreted instruction, as read back.
+struct TraceEntry {
+  int pc;
+  uint16_t word;
+  int accum_before;
+  int accum_after;
+  int effective_address;  // -1 if the instruction has no target
+};
+
+class BinaryTraceWriter {
+ public:
+  BinaryTraceWriter();
+  virtual ~BinaryTraceWriter();
+
+  void Finish(int accum, TraceStatus status);
+  void Instruction(int pc, uint16_t word, int accum, int effective_address);
+  void Start(std::ostream& trace_stream, const uint16_t* memory,
+             int memory_size);
+
+ private:
+  static const size_t kWriteSize = 1 << 20;  // bytes per write
+
+  std::ostream* trace_stream_;
+  string buffer_;
+
+  bool has_pending_;
+  TraceEntry pending_;
+  int last_pc_;
+  int last_accum_;
+
+  void Put16(int value);
+  void PutSigned(int value);
+  void PutUnsigned(uint32_t value);
+  void WritePending(int accum_after);
+};
+
+class BinaryTraceReader {
+ public:
+  BinaryTraceReader();
+  virtual ~BinaryTraceReader();
+
+  bool IsAtEnd() const;
+  TraceStatus GetStatus() const;
+
+  bool Next(TraceEntry& entry);
+  bool Start(std::istream& trace_stream, vector<uint16_t>& program);
+
+ private:
+  std::istream* trace_stream_;
+
+  bool is_at_end_;
+  TraceStatus status_;
+  int last_pc_;
+  int last_accum_;
+
+  int Get16();
+  int GetSigned();
+  uint32_t GetUnsigned();
+  void LookForEnd();
+};
+#endif
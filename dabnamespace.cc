@@ -1,5 +1,7 @@
 #include "dabnamespace.h"
 
+#include "hex.h"
+
 /***************************************************************************
  * Code file for the 'DABnamespace' for global constants and
  * functions.
@@ -47,7 +49,8 @@ int BitStringToDec(const string thebits) {
  *
  * We only allow conversion to a string of length 12 or of length 16
  * because we only allow an address (lessequal 4096 = 2^12) or a hex
- * operand of 16 bits.
+ * operand of 16 bits.  Any other length is logged as an error and gives
+ * the empty string.
  *
  * This is basically just a wrapper for the 'bitset' function.
  *
@@ -71,7 +74,6 @@ string DecToBitString(const int value, const int how_many_bits) {
   } else {
     Utils::log_stream << "ERROR DECTOBITSTRING " << value << " "
                       << how_many_bits << endl;
-    exit(0);
   }
 
 #ifdef EBUG
@@ -81,19 +83,188 @@ string DecToBitString(const int value, const int how_many_bits) {
   return bitsetvalue;
 }
 
-/******************************************************************************
- * Function 'GetMnemonicFromBits'.
- * This function retrieves the textual mnemonic from the bitstring code.
-string GetMnemonicFromBits(string codebits) {
+/***************************************************************************
+ * Function 'DecodeWord'.
+ * This function decodes one memory word for execution at 'address'.
+ *
+ * Because the target of an instruction is taken to be location zero if it
+ * lies beyond the address of the instruction, and an instruction only ever
+ * executes with the PC at its own address, that test is made here once
+ * instead of on every execution.
+ *
+ * Parameters:
+ *   word - the 16 bit memory word
+ *   address - the address the word is stored at
+ *
+ * Returns:
+ *   the decoded instruction
+**/
+DecodedInstruction DecodeWord(const uint16_t word, const int address) {
+#ifdef EBUG
+  Utils::log_stream << "enter DecodeWord" << endl;
+#endif
+  DecodedInstruction inst;
+  int target = word & 0x0FFF;
+
+  inst.opcode = static_cast<uint8_t>(OpcodeOfWord(word));
+  inst.handler = inst.opcode;
+
+  if (target <= address) {
+    inst.indirect = (word >> 12) & 0x1;
+    inst.operand = static_cast<uint16_t>(target);
+  } else {
+    inst.indirect = 0;
+    inst.operand = 0;
+  }
+
+#ifdef EBUG
+  Utils::log_stream << "leave DecodeWord" << endl;
+#endif
+
+  return inst;
+}
+
+/***************************************************************************
+ * Function 'FuseInstructions'.
+ * This function picks the superinstruction, if any, that a run of decoded
+ * instructions starts with, preferring the longest.
+ *
+ * Only runs in which nothing can change a later member of the run before
+ * it executes are fused, so an 'STC' may only come last, as may a branch.
+ *
+ * Parameters:
+ *   run - the decoded instructions from the head of the run onwards
+ *   length - how many of them there are (at most three are looked at)
+ *
+ * Returns:
+ *   the 'Superinstruction' for the run, or the head's own opcode
+**/
+int FuseInstructions(const DecodedInstruction* run, const int length) {
+#ifdef EBUG
+  Utils::log_stream << "enter FuseInstructions" << endl;
+#endif
+  int first = run[0].opcode;
+  int second = (length > 1) ? run[1].opcode : kNOP;
+  int third = (length > 2) ? run[2].opcode : kNOP;
+
+  int handler = first;
+  if (first == kLD && second == kADD && third == kSTC) {
+    handler = kLDADDSTC;
+  } else if (first == kLD && second == kADD) {
+    handler = kLDADD;
+  } else if (first == kLD && second == kWRT) {
+    handler = kLDWRT;
+  } else if (first == kRD && second == kSTC) {
+    handler = kRDSTC;
+  } else if (first == kADD && second == kSTC) {
+    handler = kADDSTC;
+  } else if (first == kSUB && second == kBAN) {
+    handler = kSUBBAN;
+  } else if (first == kADD && second == kBAN) {
+    handler = kADDBAN;
+  }
+
+#ifdef EBUG
+  Utils::log_stream << "leave FuseInstructions" << endl;
+#endif
+  return handler;
+}
+
+/***************************************************************************
+ * Function 'Disassemble'.
+ * This function formats a memory word as an instruction: the mnemonic,
+ * then for an instruction with a target an asterisk if it is indirect and
+ * the target in decimal.
+ *
+ * Parameters:
+ *   word - the 16 bit memory word
+ *
+ * Returns:
+ *   the disassembled instruction
+**/
+string Disassemble(const uint16_t word) {
 #ifdef EBUG
-  Utils::log_stream << "enter GetMnemonicFromBits" << endl;
+  Utils::log_stream << "enter Disassemble" << endl;
 #endif
-  return code_to_mnemonic_.at(codebits);
+  const OpcodeInfo& info = kOpcodeTable[OpcodeOfWord(word)];
+  string sss = info.mnemonic;
+  if (info.operand_kind == kAddressOperand) {
+    sss += ((word >> 12) & 0x1) ? " *" : "  ";
+    sss += Utils::Format(word & 0x0FFF, 5);
+  }
+
 #ifdef EBUG
-  Utils::log_stream << "leave GetMnemonicFromBits" << endl;
+  Utils::log_stream << "leave Disassemble" << endl;
 #endif
+  return sss;
 }
+
+/***************************************************************************
+ * Function 'OutputLine'.
+ * This function formats what a 'WRT' writes for the accumulator
+ * 'accum': the value as a signed integer and then its sixteen bits.
+ *
+ * Parameters:
+ *   accum - the 16 bit accumulator
+ *
+ * Returns:
+ *   the line, without its newline
 **/
+string OutputLine(const int accum) {
+  return "WRITE OUTPUT      " + std::to_string(TwosComplement(accum)) + " "
+         + DecToBitString(accum, 16);
+}
+
+/***************************************************************************
+ * Function 'ReadValue'.
+ * This function converts a line of data, in hex, to the value an 'RD'
+ * puts in the accumulator.
+ *
+ * Parameters:
+ *   line - the line of data
+ *
+ * Returns:
+ *   the value as a signed integer
+**/
+int ReadValue(const string& line) {
+  Hex convert = Hex(line);
+  return TwosComplement(convert.GetValue());
+}
+
+/***************************************************************************
+ * Function 'ReadValues'.
+ * This function reads a whole data file as 'RD' would read it, a line
+ * at a time, for the machines that take their input all at once.
+ *
+ * Parameters:
+ *   data_scanner - the data file
+ *   values - the values, in order
+**/
+void ReadValues(Scanner& data_scanner, vector<int>& values) {
+  values.clear();
+  while (data_scanner.HasNext()) {
+    values.push_back(ReadValue(data_scanner.NextLine()));
+  }
+}
+
+/***************************************************************************
+ * Function 'Summary'.
+ * This function formats the counts of a run for its 'SUMMARY:' line,
+ * which the caller starts and ends.
+ *
+ * Parameters:
+ *   executed_count - how many instructions ran
+ *   pc - where the PC was left
+ *   accum - the 16 bit accumulator
+ *
+ * Returns:
+ *   the counts, as in 'N instructions interpreted, PC P ACC A'
+**/
+string Summary(const int64_t executed_count, const int pc, const int accum) {
+  return std::to_string(executed_count) + " instructions interpreted, PC "
+         + std::to_string(pc) + " ACC "
+         + std::to_string(TwosComplement(accum));
+}
 
 }  // namespace DABnamespace
 
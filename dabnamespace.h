@@ -9,27 +9,167 @@
 #ifndef NAMESPACE_H
 #define NAMESPACE_H
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <bitset>
 #include <map>
+#include <vector>
 
 using std::cin;
 using std::cout;
 using std::endl;
 using std::map;
 using std::string;
+using std::vector;
 
-// #include "./Utilities/scanner.h"
+#include "./Utilities/scanner.h"
 // #include "./Utilities/scanline.h"
 #include "./Utilities/utils.h"
 
 namespace DABnamespace {
 static const int kMaxMemory = 4096;
+static const int kPCForStop = 65537;  // left by 'STP', 16-bit overflow
+
+/****************************************************************
+ * Opcodes after decoding.  The first seven are the values of the
+ * three mnemonic bits; the 'EEE' group (bits 111) is split on the
+ * low three address bits into 'STP', 'RD', and 'WRT', and any other
+ * 'EEE' word does nothing when executed.
+**/
+enum Opcode {
+  kBAN = 0, kSUB = 1, kSTC = 2, kAND = 3, kADD = 4, kLD = 5, kBR = 6,
+  kSTP = 7, kRD = 8, kWRT = 9, kNOP = 10
+};
+static const int kOpcodeCount = 11;
+
+enum OperandKind { kAddressOperand, kNoOperand };
+
+/****************************************************************
+ * The Pullet16 instruction set, described once for the decoder,
+ * the disassembler, and the text of the trace.  The table
+ * is indexed by 'Opcode'; 'function_bits' is the low three bits
+ * that pick an instruction out of the 'EEE' group, or -1.
+**/
+struct OpcodeInfo {
+  Opcode opcode;
+  int mnemonic_bits;
+  int function_bits;
+  const char* mnemonic;
+  OperandKind operand_kind;
+};
+
+constexpr OpcodeInfo kOpcodeTable[kOpcodeCount] = {
+  { kBAN, 0, -1, "BAN", kAddressOperand },
+  { kSUB, 1, -1, "SUB", kAddressOperand },
+  { kSTC, 2, -1, "STC", kAddressOperand },
+  { kAND, 3, -1, "AND", kAddressOperand },
+  { kADD, 4, -1, "ADD", kAddressOperand },
+  { kLD,  5, -1, "LD ", kAddressOperand },
+  { kBR,  6, -1, "BR ", kAddressOperand },
+  { kSTP, 7,  2, "STP", kNoOperand },
+  { kRD,  7,  1, "RD ", kNoOperand },
+  { kWRT, 7,  3, "WRT", kNoOperand },
+  { kNOP, 7, -1, "EEE", kNoOperand }
+};
+
+// The 'EEE' group, indexed by the low three bits of the word.
+constexpr Opcode kEEEFunctions[8] = {
+  kNOP, kRD, kSTP, kWRT, kNOP, kNOP, kNOP, kNOP
+};
+
+/****************************************************************
+ * Compile-time lookups into the tables.
+**/
+constexpr Opcode OpcodeOfWord(const uint16_t word) {
+  return ((word >> 13) & 0x7) == 0x7
+           ? kEEEFunctions[word & 0x7]
+           : static_cast<Opcode>((word >> 13) & 0x7);
+}
+
+constexpr const char* MnemonicOf(const Opcode opcode) {
+  return kOpcodeTable[opcode].mnemonic;
+}
+
+constexpr bool OpcodeTableIsInOrder(const int sub) {
+  return sub == kOpcodeCount
+         || (kOpcodeTable[sub].opcode == sub
+             && (kOpcodeTable[sub].function_bits < 0
+                 || kEEEFunctions[kOpcodeTable[sub].function_bits] == sub)
+             && OpcodeTableIsInOrder(sub + 1));
+}
+
+static_assert(OpcodeTableIsInOrder(0),
+              "kOpcodeTable must be indexed by Opcode");
+static_assert(OpcodeOfWord(0xA00B) == kLD && OpcodeOfWord(0xE003) == kWRT,
+              "OpcodeOfWord disagrees with the encoding");
+
+/****************************************************************
+ * Superinstructions, which execute a run of two or three adjacent
+ * instructions with one dispatch.  They continue the numbering of
+ * 'Opcode' so that both index the same handler tables.
+**/
+enum Superinstruction {
+  kRDSTC = kOpcodeCount,  // RD  STC
+  kLDADDSTC,              // LD  ADD STC
+  kLDADD,                 // LD  ADD
+  kADDSTC,                // ADD STC
+  kSUBBAN,                // SUB BAN
+  kADDBAN,                // ADD BAN
+  kLDWRT                  // LD  WRT
+};
+static const int kHandlerCount = kLDWRT + 1;
+
+// How many adjacent words a handler executes.
+constexpr int HandlerLength(const int handler) {
+  return handler < kOpcodeCount ? 1 : (handler == kLDADDSTC ? 3 : 2);
+}
+
+/****************************************************************
+ * The hash of 'word' at 'address', for the hash of memory that the
+ * loop checks use, which is the sum of these for every word and so
+ * can be kept up to date one store at a time.  This is the
+ * 'splitmix64' finalizer.
+**/
+inline uint64_t HashWord(const int address, const uint16_t word) {
+  uint64_t hash = (static_cast<uint64_t>(address) << 16) | word;
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+  return hash ^ (hash >> 31);
+}
+
+/****************************************************************
+ * The 16-bit 'word' as the signed value it holds, as 'ADD' adds it
+ * and 'WRT' writes it.
+**/
+constexpr int TwosComplement(const int word) {
+  return (word > 32768) ? word - 65536 : word;
+}
+
+/****************************************************************
+ * One memory word decoded for execution.  The 'operand' is the
+ * twelve bit target with the Pullet16 rule that a target beyond
+ * the instruction's own address means location zero already
+ * applied, so 'indirect' is only set when the lookup must be made.
+ * The 'handler' is the 'opcode' itself, or a 'Superinstruction'
+ * if this word starts a run that has been fused.
+**/
+struct DecodedInstruction {
+  uint8_t opcode;
+  uint8_t handler;
+  uint8_t indirect;
+  uint16_t operand;
+};
 
 int BitStringToDec(const string thebits);
 string DecToBitString(const int value, const int how_many_bits);
-string GetMnemonicFromBits(string codebits);
+DecodedInstruction DecodeWord(const uint16_t word, const int address);
+int FuseInstructions(const DecodedInstruction* run, const int length);
+string Disassemble(const uint16_t word);
+string OutputLine(const int accum);
+int ReadValue(const string& line);
+void ReadValues(Scanner& data_scanner, vector<int>& values);
+string Summary(const int64_t executed_count, const int pc, const int accum);
 }
 
 #endif
@@ -0,0 +1,621 @@
+#include "daemon.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include "resultcache.h"
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'Daemon' for running jobs sent over a Unix domain socket.
+ *
+ * A client connects to the socket and sends requests, each a line and
+ * perhaps lines after it, and the daemon answers each in turn, until the
+ * client closes the connection.  A request is one of
+ *
+ *   PROGRAM count    and then the count words of a program, a line each,
+ *                    as in an 'a.out' file; the answer is 'PROGRAM key',
+ *                    the hash of the program by 'ResultCache::ImageKey'
+ *   RUN key count [budget]
+ *                    and then the count values for its 'RD's, a line
+ *                    each, as in a data file; the program 'key' is run on
+ *                    them, with no more than 'budget' instructions if it
+ *                    is given, and the answer is 'OUTPUT lines', the lines
+ *                    of output as 'Aprog' writes them, and then 'RESULT
+ *                    status instructions pc accumulator', where the status
+ *                    is 'finished', 'outofdata', 'outofbudget', 'error',
+ *                    or 'badinput'
+ *   STOP             the answer is 'STOPPING', and the daemon takes no
+ *                    more connections and ends once the ones it has close
+ *
+ * A request the daemon cannot make sense of, or a 'RUN' of a program it
+ * does not have, is answered with 'ERROR' and why; after a bad request
+ * the connection is closed, since the lines after it cannot be trusted.
+ * A 'PROGRAM' of more words than memory holds, or a 'RUN' of more than
+ * 'kMaxValues' values, is a bad request, so that the lines kept for a
+ * request that has not all come are bounded.
+ * A client that sends a program once can run it by its key from then on,
+ * on any connection, until the daemon has more than 'kMaxPrograms' and
+ * forgets them all, as 'ProgramCache' does; then 'RUN' says so, and the
+ * program is sent again.
+ *
+ * The thread that calls 'Run' does all the reading and writing, sleeping
+ * in 'poll' on the socket and every connection as 'EventLoop' does, so a
+ * client that sends nothing holds back no one.  It answers a 'PROGRAM'
+ * itself, and hands each 'RUN' whose values have all come to one of the
+ * worker threads as a 'Job'; nothing more is read from that client until
+ * the answer is back, so each client's requests are answered in turn.
+ * A job runs in a 'Pullet16Machine' that is already loaded with its
+ * program if one is idle, which is then kept for the next job of that
+ * program, up to one for each worker, so after the first few jobs of a
+ * program nothing is read, decoded, or allocated to run it.  Each run is
+ * logged, with its summary line, as it finishes.  The machines use the
+ * 'jit' engine, if it is chosen, only when loop checks are off (see
+ * 'Interpreter::SetEngine'), so that a 'RUN' with no budget of a
+ * program in an infinite loop still ends and frees its worker.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+Daemon::Daemon()
+    : engine_(kSwitchEngine), loop_check_(-1), max_idle_(1),
+      listen_fd_(-1), is_stopping_(false), log_stream_(nullptr),
+      next_connection_(0), is_finished_(false) {
+  wake_fds_[0] = -1;
+  wake_fds_[1] = -1;
+}
+
+/***************************************************************************
+ * Destructor
+**/
+Daemon::~Daemon() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Mutator for the engine of the machines.
+**/
+void Daemon::SetEngine(Engine engine) {
+  engine_ = engine;
+}
+
+/***************************************************************************
+ * Mutator for how many branches back there are between the looks for an
+ * infinite loop, where zero is never.
+**/
+void Daemon::SetLoopCheck(int64_t every) {
+  loop_check_ = every;
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Accept'.
+ * Take every connection waiting on the socket.
+**/
+void Daemon::Accept() {
+  while (true) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Connection& connection = connections_[next_connection_++];
+    connection.fd = fd;
+    connection.is_input_closed = false;
+    connection.is_running = false;
+    connection.is_closing = false;
+  }
+}
+
+/***************************************************************************
+ * Function 'Answer'.
+ * Answer the requests of the connection numbered 'id' whose lines have
+ * all come, in turn, until one is handed to a worker.
+**/
+void Daemon::Answer(int id, Connection& connection) {
+  while (!connection.is_running && !connection.is_closing
+         && !connection.lines.empty()) {
+    string request = connection.lines.front();
+    if (request.compare(0, 8, "PROGRAM ") == 0) {
+      if (!DoProgram(connection, request)) break;
+    } else if (request.compare(0, 4, "RUN ") == 0) {
+      if (!DoRun(id, connection, request)) break;
+    } else if (request == "STOP") {
+      connection.lines.pop_front();
+      Write(connection, "STOPPING\n");
+      Stop();
+    } else {
+      connection.lines.pop_front();
+      Write(connection, "ERROR bad request '" + request + "'\n");
+      connection.is_closing = true;
+    }
+  }
+}
+
+/***************************************************************************
+ * Function 'DoProgram'.
+ * Take the program of the 'PROGRAM' 'request' and keep it.
+ *
+ * Returns:
+ *   false if its words have not all come yet, leaving the request
+**/
+bool Daemon::DoProgram(Connection& connection, const string& request) {
+  std::istringstream fields(request);
+  string name = "";
+  long long count = -1;
+  string extra = "";
+  fields >> name >> count;
+  if (fields.fail() || (fields >> extra)
+      || count < 0 || count > DABnamespace::kMaxMemory) {
+    connection.lines.pop_front();
+    Write(connection, "ERROR bad request '" + request + "'\n");
+    connection.is_closing = true;
+    return true;
+  }
+  if (static_cast<long long>(connection.lines.size()) <= count) return false;
+  connection.lines.pop_front();
+
+  vector<uint16_t>* image = new vector<uint16_t>();
+  std::shared_ptr<const vector<uint16_t> > read_image(image);
+  while (static_cast<long long>(image->size()) < count) {
+    string line = connection.lines.front();
+    connection.lines.pop_front();
+    if (line.size() != 16
+        || line.find_first_not_of("01") != string::npos) {
+      Write(connection, "ERROR bad word '" + line + "'\n");
+      connection.is_closing = true;
+      return true;
+    }
+    image->push_back(static_cast<uint16_t>(std::stoi(line, nullptr, 2)));
+  }
+
+  string key = ResultCache::ImageKey(*image);
+  {
+    std::lock_guard<std::mutex> guard(programs_lock_);
+    if (programs_.find(key) == programs_.end()) {
+      if (programs_.size() >= kMaxPrograms) {
+        programs_.clear();
+      }
+      programs_[key].image = read_image;
+    }
+  }
+  Log("DAEMON: program " + key + ", " + std::to_string(count) + " words\n");
+  Write(connection, "PROGRAM " + key + "\n");
+  return true;
+}
+
+/***************************************************************************
+ * Function 'DoRun'.
+ * Take the input of the 'RUN' 'request' from the connection numbered
+ * 'id', and hand the run to a worker.
+ *
+ * Returns:
+ *   false if its values have not all come yet, leaving the request
+**/
+bool Daemon::DoRun(int id, Connection& connection, const string& request) {
+  std::istringstream fields(request);
+  string name = "";
+  string key = "";
+  long long count = -1;
+  long long budget = INT64_MAX;
+  string extra = "";
+  fields >> name >> key >> count;
+  if (!fields.fail() && !(fields >> budget)) {
+    fields.clear();
+    budget = INT64_MAX;
+  }
+  if (fields.fail() || (fields >> extra) || count < 0 || count > kMaxValues
+      || budget < 0) {
+    connection.lines.pop_front();
+    Write(connection, "ERROR bad request '" + request + "'\n");
+    connection.is_closing = true;
+    return true;
+  }
+  if (static_cast<long long>(connection.lines.size()) <= count) return false;
+  connection.lines.pop_front();
+
+  // The values are all taken whatever else is wrong, so the next request
+  // is where the client thinks it is.
+  Job job;
+  job.connection = id;
+  job.key = key;
+  job.count = count;
+  job.budget = budget;
+  job.is_valid = true;
+  for (long long sub = 0; sub < count; ++sub) {
+    string line = connection.lines.front();
+    connection.lines.pop_front();
+    if (line.size() != 5 || (line[0] != '+' && line[0] != '-')
+        || line.find_first_not_of("0123456789ABCDEF", 1) != string::npos) {
+      job.is_valid = false;
+      continue;
+    }
+    int value = std::stoi(line.substr(1), nullptr, 16);
+    job.input.push_back((line[0] == '-') ? -value : value);
+  }
+
+  connection.is_running = true;
+  std::lock_guard<std::mutex> guard(jobs_lock_);
+  jobs_.push_back(std::move(job));
+  job_ready_.notify_one();
+  return true;
+}
+
+/***************************************************************************
+ * Function 'GetMachine'.
+ * Take an idle machine loaded with the program 'key', or load a new one.
+ *
+ * Returns:
+ *   the machine, or null if there is no such program
+**/
+std::unique_ptr<Pullet16Machine> Daemon::GetMachine(const string& key) {
+  std::shared_ptr<const vector<uint16_t> > image;
+  {
+    std::lock_guard<std::mutex> guard(programs_lock_);
+    std::map<string, Program>::iterator program = programs_.find(key);
+    if (program == programs_.end()) {
+      return std::unique_ptr<Pullet16Machine>();
+    }
+    if (!program->second.idle.empty()) {
+      std::unique_ptr<Pullet16Machine> machine =
+        std::move(program->second.idle.back());
+      program->second.idle.pop_back();
+      return machine;
+    }
+    image = program->second.image;
+  }
+
+  // Loaded with the lock let go, as 'ProgramCache' reads.
+  std::unique_ptr<Pullet16Machine> machine(new Pullet16Machine());
+  machine->SetEngine(engine_);
+  if (loop_check_ >= 0) {
+    machine->SetLoopCheck(loop_check_);
+  }
+  machine->Load(image->empty() ? nullptr : &(*image)[0], image->size());
+  return machine;
+}
+
+/***************************************************************************
+ * Function 'Log'.
+ * Write 'text' to the log, whole, whichever thread it is from.
+**/
+void Daemon::Log(const string& text) {
+  std::lock_guard<std::mutex> guard(log_lock_);
+  *log_stream_ << text;
+  log_stream_->flush();
+}
+
+/***************************************************************************
+ * Function 'PutMachine'.
+ * Give back 'machine', loaded with the program 'key', to be idle until
+ * another job of the program, unless there are enough idle already or
+ * the program has been forgotten.
+**/
+void Daemon::PutMachine(const string& key,
+                        std::unique_ptr<Pullet16Machine> machine) {
+  std::lock_guard<std::mutex> guard(programs_lock_);
+  std::map<string, Program>::iterator program = programs_.find(key);
+  if (program != programs_.end() && program->second.idle.size() < max_idle_) {
+    program->second.idle.push_back(std::move(machine));
+  }
+}
+
+/***************************************************************************
+ * Function 'ReadInput'.
+ * Read what there is from 'connection' and keep its whole lines, without
+ * their ends of line and blanks; blank lines are skipped.  The input is
+ * closed when the client closes it or sends a line too long to be a
+ * request.
+**/
+void Daemon::ReadInput(Connection& connection) {
+  char buffer[kReadSize];
+  ssize_t count = read(connection.fd, buffer, sizeof(buffer));
+  if (count < 0 && (errno == EAGAIN || errno == EINTR)) return;
+  if (count <= 0) {
+    connection.is_input_closed = true;
+    return;
+  }
+
+  connection.part_line.append(buffer, count);
+  size_t start = 0;
+  size_t end = connection.part_line.find('\n');
+  while (end != string::npos) {
+    string line = Utils::TrimBlanks(connection.part_line.substr(start,
+                                                               end - start));
+    if (!line.empty()) {
+      connection.lines.push_back(line);
+    }
+    start = end + 1;
+    end = connection.part_line.find('\n', start);
+  }
+  connection.part_line.erase(0, start);
+  if (connection.part_line.size() > kMaxLineLength) {
+    connection.is_input_closed = true;
+  }
+}
+
+/***************************************************************************
+ * Function 'Run'.
+ * Take connections on the socket 'socket_filename', running their jobs
+ * with 'worker_count' threads, until a client sends 'STOP' and the rest
+ * have closed.  The log is the log of the calling thread.
+ *
+ * Returns:
+ *   false if the socket could not be made
+**/
+bool Daemon::Run(string socket_filename, int worker_count) {
+  signal(SIGPIPE, SIG_IGN);  // a client that has gone is seen by 'write'
+  log_stream_ = &Utils::log_stream;
+  max_idle_ = worker_count;
+
+  struct sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_filename.size() >= sizeof(address.sun_path)) {
+    Log("DAEMON: socket name too long '" + socket_filename + "'\n");
+    return false;
+  }
+  std::strcpy(address.sun_path, socket_filename.c_str());
+  unlink(socket_filename.c_str());  // left by a daemon that did not stop
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0
+      || bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) != 0
+      || listen(listen_fd_, SOMAXCONN) != 0
+      || pipe(wake_fds_) != 0) {
+    std::perror(socket_filename.c_str());
+    return false;
+  }
+  fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+  fcntl(wake_fds_[0], F_SETFL, fcntl(wake_fds_[0], F_GETFL) | O_NONBLOCK);
+  fcntl(wake_fds_[1], F_SETFL, fcntl(wake_fds_[1], F_GETFL) | O_NONBLOCK);
+  Log("DAEMON: listening on '" + socket_filename + "' with "
+      + std::to_string(worker_count)
+      + ((worker_count == 1) ? " worker\n" : " workers\n"));
+
+  vector<std::thread> workers;
+  for (int worker = 0; worker < worker_count; ++worker) {
+    workers.push_back(std::thread(&Daemon::Work, this));
+  }
+
+  // Each wait is for the connection of the same number in 'ids', or for
+  // the pipe or the socket.
+  static const int kWakeId = -1;
+  static const int kListenId = -2;
+  vector<struct pollfd> waits;
+  vector<int> ids;
+  while (!is_stopping_ || !connections_.empty()) {
+    waits.clear();
+    ids.clear();
+    struct pollfd wait;
+    wait.revents = 0;
+    wait.fd = wake_fds_[0];
+    wait.events = POLLIN;
+    waits.push_back(wait);
+    ids.push_back(kWakeId);
+    if (!is_stopping_) {
+      wait.fd = listen_fd_;
+      waits.push_back(wait);
+      ids.push_back(kListenId);
+    }
+    for (std::map<int, Connection>::const_iterator connection =
+           connections_.begin();
+         connection != connections_.end(); ++connection) {
+      wait.fd = connection->second.fd;
+      wait.events = 0;
+      if (!connection->second.is_running && !connection->second.is_closing
+          && !connection->second.is_input_closed) {
+        wait.events |= POLLIN;
+      }
+      if (!connection->second.output.empty()) {
+        wait.events |= POLLOUT;
+      }
+      if (wait.events == 0) continue;
+      waits.push_back(wait);
+      ids.push_back(connection->first);
+    }
+
+    if (poll(&waits[0], waits.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      std::perror("poll");
+      exit(1);
+    }
+    for (size_t sub = 0; sub < waits.size(); ++sub) {
+      if (waits[sub].revents == 0) continue;
+      if (ids[sub] == kWakeId) {
+        TakeDone();
+      } else if (ids[sub] == kListenId) {
+        if (!is_stopping_) Accept();
+      } else {
+        Connection& connection = connections_[ids[sub]];
+        if (waits[sub].events & POLLIN) {
+          ReadInput(connection);
+          Answer(ids[sub], connection);
+        }
+        WriteOutput(connection);
+      }
+    }
+
+    // A connection is closed once nothing more can come of it.
+    std::map<int, Connection>::iterator connection = connections_.begin();
+    while (connection != connections_.end()) {
+      if (!connection->second.is_running
+          && (connection->second.is_closing
+              || connection->second.is_input_closed)
+          && connection->second.output.empty()) {
+        close(connection->second.fd);
+        connection = connections_.erase(connection);
+      } else {
+        ++connection;
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(jobs_lock_);
+    is_finished_ = true;
+    job_ready_.notify_all();
+  }
+  for (int worker = 0; worker < worker_count; ++worker) {
+    workers[worker].join();
+  }
+  close(wake_fds_[0]);
+  close(wake_fds_[1]);
+  unlink(socket_filename.c_str());
+  Log("DAEMON: stopped\n");
+  return true;
+}
+
+/***************************************************************************
+ * Function 'RunJob'.
+ * Run the program of 'job' on its input, for a worker, and make the
+ * answer: the output and how the run ended.
+**/
+void Daemon::RunJob(Job& job) {
+  std::unique_ptr<Pullet16Machine> machine = GetMachine(job.key);
+  if (!machine) {
+    job.answer = "ERROR no program " + job.key + "\n";
+    return;
+  }
+
+  string output = "";
+  Pullet16Machine::RunResult result;
+  result.status = kMachineBadInput;
+  result.executed_count = 0;
+  result.pc = 0;
+  result.accum = 0;
+  if (job.is_valid) {
+    machine->SetBudget(job.budget);
+    machine->Run(job.input.empty() ? nullptr : &job.input[0],
+                 job.input.size(), output, result);
+  }
+  PutMachine(job.key, std::move(machine));
+
+  static const char* const kStatusNames[] = {
+    "finished", "outofdata", "outofbudget", "error", "badinput"
+  };
+  int64_t line_count = std::count(output.begin(), output.end(), '\n');
+  std::ostringstream answer;
+  answer << "OUTPUT " << line_count << "\n" << output
+         << "RESULT " << kStatusNames[result.status] << " "
+         << result.executed_count << " " << result.pc << " "
+         << result.accum << "\n";
+  job.answer = answer.str();
+  Log("DAEMON: run " + job.key + ", " + std::to_string(job.count)
+      + " values\n" + result.log);
+}
+
+/***************************************************************************
+ * Function 'Stop'.
+ * Take no more connections, and end when the ones there are have closed.
+**/
+void Daemon::Stop() {
+  if (is_stopping_) return;
+  is_stopping_ = true;
+  close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+/***************************************************************************
+ * Function 'TakeDone'.
+ * Send the answers of the jobs the workers have done, and go on with the
+ * requests their clients sent after them.
+**/
+void Daemon::TakeDone() {
+  char buffer[kReadSize];
+  while (read(wake_fds_[0], buffer, sizeof(buffer)) > 0) {
+  }
+
+  std::deque<Job> done;
+  {
+    std::lock_guard<std::mutex> guard(jobs_lock_);
+    done.swap(done_);
+  }
+  for (size_t sub = 0; sub < done.size(); ++sub) {
+    Connection& connection = connections_[done[sub].connection];
+    connection.is_running = false;
+    Write(connection, done[sub].answer);
+    Answer(done[sub].connection, connection);
+    WriteOutput(connection);
+  }
+}
+
+/***************************************************************************
+ * Function 'Work'.
+ * Run the jobs handed over, one at a time, for a worker thread, and wake
+ * the thread that called 'Run' as each is done.
+**/
+void Daemon::Work() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> guard(jobs_lock_);
+      while (jobs_.empty() && !is_finished_) {
+        job_ready_.wait(guard);
+      }
+      if (jobs_.empty()) return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    RunJob(job);
+    {
+      std::lock_guard<std::mutex> guard(jobs_lock_);
+      done_.push_back(std::move(job));
+    }
+    // A full pipe will wake it anyway.
+    char byte = 0;
+    ssize_t count = write(wake_fds_[1], &byte, 1);
+    static_cast<void>(count);
+  }
+}
+
+/***************************************************************************
+ * Function 'Write'.
+ * Add 'text' to what is to be sent to the client of 'connection'.
+**/
+void Daemon::Write(Connection& connection, const string& text) {
+  connection.output += text;
+}
+
+/***************************************************************************
+ * Function 'WriteOutput'.
+ * Send as much of the output of 'connection' as its socket will take
+ * now.  Output to a client that has gone is dropped, and the connection
+ * is closed.
+**/
+void Daemon::WriteOutput(Connection& connection) {
+  size_t written = 0;
+  while (written < connection.output.size()) {
+    ssize_t count = write(connection.fd, connection.output.data() + written,
+                          connection.output.size() - written);
+    if (count > 0) {
+      written += count;
+    } else if (count < 0 && errno == EAGAIN) {
+      break;
+    } else if (count < 0 && errno != EINTR) {
+      written = connection.output.size();
+      connection.is_closing = true;
+    }
+  }
+  connection.output.erase(0, written);
+}
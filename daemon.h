@@ -0,0 +1,120 @@
+/****************************************************************
+ * Header file for the 'Daemon' that runs jobs sent to it over a
+ * Unix domain socket, keeping the programs it has been sent, and
+ * machines loaded with them, from one job to the next.
+**/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "pullet16machine.h"
+
+class Daemon {
+ public:
+  Daemon();
+  virtual ~Daemon();
+
+  void SetEngine(Engine engine);
+  void SetLoopCheck(int64_t every);
+
+  bool Run(string socket_filename, int worker_count);
+
+ private:
+  static const size_t kMaxPrograms = 256;
+  static const size_t kMaxLineLength = 256;
+  static const int64_t kMaxValues = 65536;  // sent with a 'RUN'
+  static const int kReadSize = 4096;
+
+  /****************************************************************
+   * A program that has been sent, and the machines loaded with it
+   * that are not running a job just now.
+  **/
+  struct Program {
+    std::shared_ptr<const vector<uint16_t> > image;
+    vector<std::unique_ptr<Pullet16Machine> > idle;
+  };
+
+  /****************************************************************
+   * A client: the part line it has sent, the whole lines that no
+   * request has taken yet, and the answers not yet sent to it.
+   * While one of its 'RUN's is with a worker, nothing more is read
+   * from it, so that its requests are answered in turn.
+  **/
+  struct Connection {
+    int fd;
+    string part_line;
+    std::deque<string> lines;
+    string output;
+    bool is_input_closed;
+    bool is_running;
+    bool is_closing;  // once its output has been sent
+  };
+
+  /****************************************************************
+   * A 'RUN' for a worker, from the connection numbered 'connection',
+   * and the answer the worker makes of it.
+  **/
+  struct Job {
+    int connection;
+    string key;
+    int64_t count;  // of values sent
+    int64_t budget;
+    vector<int> input;
+    bool is_valid;
+    string answer;
+  };
+
+  Engine engine_;
+  int64_t loop_check_;
+  size_t max_idle_;  // machines kept for each program
+  int listen_fd_;
+  int wake_fds_[2];  // a pipe, written when a job is done
+  bool is_stopping_;
+  std::ostream* log_stream_;  // the log of the thread that called 'Run'
+
+  // Only for the thread that called 'Run', by number.
+  std::map<int, Connection> connections_;
+  int next_connection_;
+
+  std::mutex programs_lock_;
+  std::map<string, Program> programs_;
+
+  std::mutex log_lock_;
+
+  std::mutex jobs_lock_;
+  std::condition_variable job_ready_;
+  std::deque<Job> jobs_;
+  std::deque<Job> done_;
+  bool is_finished_;  // the workers are to end
+
+  void Accept();
+  void Answer(int id, Connection& connection);
+  bool DoProgram(Connection& connection, const string& request);
+  bool DoRun(int id, Connection& connection, const string& request);
+  std::unique_ptr<Pullet16Machine> GetMachine(const string& key);
+  void Log(const string& text);
+  void PutMachine(const string& key, std::unique_ptr<Pullet16Machine> machine);
+  void ReadInput(Connection& connection);
+  void RunJob(Job& job);
+  void Stop();
+  void TakeDone();
+  void Work();
+  void Write(Connection& connection, const string& text);
+  void WriteOutput(Connection& connection);
+};
+#endif
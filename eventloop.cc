@@ -0,0 +1,359 @@
+#include "eventloop.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'EventLoop' for running streaming machines from descriptors.
+ *
+ * Each machine is an interpreter set to streaming, so that 'Interpret'
+ * returns when an 'RD' has no line to read and after every 'WRT', with
+ * the machine left to go on from there at the next call; it is a
+ * coroutine that suspends on its input and output, without a thread or a
+ * stack of its own.
+ *
+ * The machines that can run are in a 'RoundRobin', and each of them runs
+ * a slice in turn.  One that suspends on an 'RD' waits until its input
+ * descriptor has more lines, and one that suspends on a 'WRT' waits until
+ * its output has all been sent, so a slow reader holds back only its own
+ * machine.  When none can run, the loop sleeps in 'poll' on the
+ * descriptors of all the ones waiting; otherwise it only looks at them
+ * between rounds.
+ *
+ * Input is read only for a machine that is waiting for it, a block at a
+ * time, and fed to it a line at a time, blank lines skipped as in a data
+ * file.  A machine that waits for input after its input has closed has
+ * run out of data, and is abandoned; one that is sent a line that is not
+ * a value is stopped with an error, before the line reaches it, and the
+ * others run on.  Output that cannot be sent because
+ * the reader has gone is dropped.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+template <class Trace>
+EventLoop<Trace>::EventLoop()
+    : live_count_(0) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+template <class Trace>
+EventLoop<Trace>::~EventLoop() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Mutator for how many instructions a machine runs in its turn.
+**/
+template <class Trace>
+void EventLoop<Trace>::SetSlice(int64_t slice) {
+  scheduler_.SetSlice(slice);
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Add'.
+ * Add a machine, 'interpreter', which must be loaded and set to stream,
+ * reading from 'in_fd' and writing to 'out_fd', which may be the same, and
+ * logging to 'log_buffer' (null for the log itself).  The loop closes
+ * the descriptors when the machine is done.
+ *
+ * Returns:
+ *   the number of the machine, which is where 'Run' puts its status
+**/
+template <class Trace>
+int EventLoop<Trace>::Add(Interpreter<Trace>* interpreter, int in_fd,
+                          int out_fd, std::streambuf* log_buffer) {
+  fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+  fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) | O_NONBLOCK);
+
+  Stream stream;
+  stream.interpreter = interpreter;
+  stream.in_fd = in_fd;
+  stream.out_fd = out_fd;
+  stream.log_buffer = log_buffer;
+  stream.written = 0;
+  stream.is_input_closed = false;
+  stream.is_waiting_for_input = false;
+  stream.is_ending = false;
+  stream.is_done = false;
+  stream.status = kRunOutOfBudget;
+  streams_.push_back(stream);
+  ++live_count_;
+
+  int id = static_cast<int>(streams_.size()) - 1;
+  Ready(id);
+  return id;
+}
+
+/***************************************************************************
+ * Function 'Close'.
+ * Close the descriptors of the machine 'id', which is done.
+**/
+template <class Trace>
+void EventLoop<Trace>::Close(int id) {
+  Stream& stream = streams_[id];
+  close(stream.in_fd);
+  if (stream.out_fd != stream.in_fd) {
+    close(stream.out_fd);
+  }
+  stream.is_done = true;
+  --live_count_;
+}
+
+/***************************************************************************
+ * Function 'End'.
+ * End the run of the machine 'id' with 'status', abandoning it if it
+ * did not finish, and close it once its output has been sent.
+**/
+template <class Trace>
+void EventLoop<Trace>::End(int id, RunStatus status) {
+  Stream& stream = streams_[id];
+  stream.status = status;
+  stream.is_ending = true;
+  stream.is_waiting_for_input = false;
+  if (status != kRunFinished && status != kRunError) {
+    std::unique_ptr<LogToBufferGuard> to_log_buffer;
+    if (stream.log_buffer != nullptr) {
+      to_log_buffer.reset(new LogToBufferGuard(stream.log_buffer));
+    }
+    stream.interpreter->AbandonRun();
+  }
+  if (WriteOutput(id)) {
+    Close(id);
+  }
+}
+
+/***************************************************************************
+ * Function 'ReadInput'.
+ * Read what there is on the input of the machine 'id', which is waiting
+ * for it, and feed it the whole lines.  It runs again if it got any, and
+ * is ended if there will never be any.  A line that is not a value, a
+ * sign and four hex digits, ends it with an error instead.
+**/
+template <class Trace>
+void EventLoop<Trace>::ReadInput(int id) {
+  Stream& stream = streams_[id];
+  char buffer[kReadSize];
+  ssize_t count = read(stream.in_fd, buffer, sizeof(buffer));
+  if (count < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+  bool is_fed = false;
+  if (count > 0) {
+    stream.part_line.append(buffer, count);
+  } else {
+    stream.is_input_closed = true;
+    stream.part_line += '\n';  // the last line need not end
+  }
+  size_t start = 0;
+  size_t end = stream.part_line.find('\n');
+  while (end != string::npos) {
+    string line = Utils::TrimBlanks(stream.part_line.substr(start,
+                                                           end - start));
+    if (!line.empty()
+        && (line.size() != 5 || (line[0] != '+' && line[0] != '-')
+            || line.find_first_not_of("0123456789ABCDEF", 1)
+               != string::npos)) {
+      Reject(id, line);
+      return;
+    }
+    if (!line.empty()) {
+      stream.interpreter->Feed(line);
+      is_fed = true;
+    }
+    start = end + 1;
+    end = stream.part_line.find('\n', start);
+  }
+  stream.part_line.erase(0, start);
+
+  if (is_fed) {
+    stream.is_waiting_for_input = false;
+    Ready(id);
+  } else if (stream.is_input_closed) {
+    End(id, kRunWaitingForInput);
+  }
+}
+
+/***************************************************************************
+ * Function 'Ready'.
+ * Put the machine 'id' in the scheduler to run.
+**/
+template <class Trace>
+void EventLoop<Trace>::Ready(int id) {
+  typename RoundRobin<Trace>::Machine machine;
+  machine.interpreter = streams_[id].interpreter;
+  machine.data_scanner = &no_data_scanner_;
+  machine.out_stream = &no_out_stream_;
+  machine.log_buffer = streams_[id].log_buffer;
+  machine.id = id;
+  machine.status = kRunOutOfBudget;
+  scheduler_.Add(machine);
+}
+
+/***************************************************************************
+ * Function 'Reject'.
+ * End the run of the machine 'id' with an error for the bad input 'line',
+ * which is logged; none of the machine's input is fed to it after that.
+**/
+template <class Trace>
+void EventLoop<Trace>::Reject(int id, const string& line) {
+  Stream& stream = streams_[id];
+  {
+    std::unique_ptr<LogToBufferGuard> to_log_buffer;
+    if (stream.log_buffer != nullptr) {
+      to_log_buffer.reset(new LogToBufferGuard(stream.log_buffer));
+    }
+    Utils::log_stream << "STREAM: bad input '" << line << "', stopped"
+                      << endl;
+    stream.interpreter->AbandonRun(kRunError);
+  }
+  stream.part_line.clear();
+  End(id, kRunError);
+}
+
+/***************************************************************************
+ * Function 'Run'.
+ * Run all the machines until every one is done, and put how each ended
+ * in 'statuses', by its number.
+**/
+template <class Trace>
+void EventLoop<Trace>::Run(vector<RunStatus>& statuses) {
+  signal(SIGPIPE, SIG_IGN);  // a reader that has gone is seen by 'write'
+
+  vector<struct pollfd> waits;
+  vector<int> ids;
+  while (live_count_ > 0) {
+    typename RoundRobin<Trace>::Machine stopped;
+    for (int turns = scheduler_.Size(); turns > 0; --turns) {
+      if (scheduler_.RunSlice(stopped)) {
+        Stopped(stopped.id, stopped.status);
+      }
+    }
+
+    waits.clear();
+    ids.clear();
+    for (size_t id = 0; id < streams_.size(); ++id) {
+      const Stream& stream = streams_[id];
+      struct pollfd wait;
+      wait.revents = 0;
+      if (stream.is_done) {
+        continue;
+      } else if (stream.is_waiting_for_input) {
+        wait.fd = stream.in_fd;
+        wait.events = POLLIN;
+      } else if (stream.written < stream.output.size()) {
+        wait.fd = stream.out_fd;
+        wait.events = POLLOUT;
+      } else {
+        continue;
+      }
+      waits.push_back(wait);
+      ids.push_back(static_cast<int>(id));
+    }
+    if (waits.empty()) continue;
+
+    int timeout = scheduler_.IsEmpty() ? -1 : 0;
+    if (poll(&waits[0], waits.size(), timeout) < 0) {
+      if (errno == EINTR) continue;
+      std::perror("poll");
+      exit(1);
+    }
+    for (size_t sub = 0; sub < waits.size(); ++sub) {
+      if (waits[sub].revents == 0) continue;
+      int id = ids[sub];
+      if (waits[sub].events == POLLIN) {
+        ReadInput(id);
+      } else if (WriteOutput(id)) {
+        if (streams_[id].is_ending) {
+          Close(id);
+        } else {
+          Ready(id);
+        }
+      }
+    }
+  }
+
+  statuses.resize(streams_.size());
+  for (size_t id = 0; id < streams_.size(); ++id) {
+    statuses[id] = streams_[id].status;
+  }
+}
+
+/***************************************************************************
+ * Function 'Stopped'.
+ * Deal with the machine 'id', which the scheduler handed back with
+ * 'status': send its output, wait for its input, or end it.
+**/
+template <class Trace>
+void EventLoop<Trace>::Stopped(int id, RunStatus status) {
+  Stream& stream = streams_[id];
+  // A run can finish with output, if its last word is a 'WRT'.
+  stream.interpreter->TakeOutput(stream.output);
+  stream.written = 0;
+  if (status == kRunHasOutput) {
+    if (WriteOutput(id)) {
+      Ready(id);
+    }
+  } else if (status == kRunWaitingForInput) {
+    if (stream.is_input_closed) {
+      End(id, status);
+    } else {
+      stream.is_waiting_for_input = true;
+    }
+  } else {
+    End(id, status);
+  }
+}
+
+/***************************************************************************
+ * Function 'WriteOutput'.
+ * Send as much of the output of the machine 'id' as its descriptor will
+ * take now.
+ *
+ * Returns:
+ *   true if it has all been sent, or dropped because it cannot be
+**/
+template <class Trace>
+bool EventLoop<Trace>::WriteOutput(int id) {
+  Stream& stream = streams_[id];
+  while (stream.written < stream.output.size()) {
+    ssize_t count = write(stream.out_fd, stream.output.data() + stream.written,
+                          stream.output.size() - stream.written);
+    if (count > 0) {
+      stream.written += count;
+    } else if (count < 0 && errno == EAGAIN) {
+      return false;
+    } else if (count < 0 && errno != EINTR) {
+      break;
+    }
+  }
+  stream.output.clear();
+  stream.written = 0;
+  return true;
+}
+
+// The trace policies that 'main' can choose from.
+template class EventLoop<FullTrace>;
+template class EventLoop<AsyncFullTrace>;
+template class EventLoop<SummaryTrace>;
+template class EventLoop<NoTrace>;
+template class EventLoop<BinaryTrace>;
+template class EventLoop<DiffTrace>;
+template class EventLoop<SampledTrace>;
@@ -0,0 +1,74 @@
+/****************************************************************
+ * Header file for the 'EventLoop' that runs streaming machines on
+ * one thread, each fed from a file descriptor and writing to
+ * another, such as the ends of pipes or sockets.
+**/
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#include "./Utilities/scanner.h"
+#include "./Utilities/utils.h"
+
+#include "pullet16interpreter.h"
+#include "scheduler.h"
+
+template <class Trace>
+class EventLoop {
+ public:
+  EventLoop();
+  virtual ~EventLoop();
+
+  void SetSlice(int64_t slice);
+
+  int Add(Interpreter<Trace>* interpreter, int in_fd, int out_fd,
+          std::streambuf* log_buffer);
+  void Run(vector<RunStatus>& statuses);
+
+ private:
+  static const int kReadSize = 4096;
+
+  /****************************************************************
+   * One machine and its descriptors: the part line of input not
+   * yet fed to it, and the output it wrote not yet sent, from
+   * 'written' on.  A machine is in the scheduler, or waiting for
+   * input, or waiting for its output to be sent, or done.
+  **/
+  struct Stream {
+    Interpreter<Trace>* interpreter;
+    int in_fd;
+    int out_fd;
+    std::streambuf* log_buffer;
+    string part_line;
+    string output;
+    size_t written;
+    bool is_input_closed;
+    bool is_waiting_for_input;
+    bool is_ending;
+    bool is_done;
+    RunStatus status;
+  };
+
+  RoundRobin<Trace> scheduler_;
+  Scanner no_data_scanner_;  // the files a streaming machine does not use
+  ofstream no_out_stream_;
+  vector<Stream> streams_;
+  int live_count_;
+
+  void Close(int id);
+  void End(int id, RunStatus status);
+  void Ready(int id);
+  void ReadInput(int id);
+  void Reject(int id, const string& line);
+  void Stopped(int id, RunStatus status);
+  bool WriteOutput(int id);
+};
+#endif
@@ -0,0 +1,457 @@
+#include "inputsweep.h"
+
+#include <algorithm>
+#include <cstring>
+
+// The 'LaneVector' helpers are only called from this file, so it does not
+// matter that returning a 'LaneVector' without AVX is not the AVX ABI.
+// They, and the other helpers of a step, are defined 'inline', since with
+// '-fPIC' a function that could be interposed is never inlined, and a
+// call for each operation of a step costs more than the step itself.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'InputSweep' for running one program over many sets of input.
+ *
+ * Up to 'kLanes' machines, each with its own memory, accumulator, PC, and
+ * input, are held as structure of arrays: 'memory_[address]' is that word
+ * of every machine side by side, and so on.  While they are at the same
+ * PC with the same instruction there, one step runs the instruction for
+ * all of them at once as operations on 'LaneVector's, which the compiler
+ * turns into SSE or AVX2 instructions as the target allows.  Only 'RD',
+ * 'WRT', and targets reached indirectly are done a lane at a time.
+ *
+ * When a 'BAN' sends the machines different ways, the group goes on at
+ * the lowest PC of any of them, with the others masked off until it gets
+ * to theirs, which is where the usual loops join up again.  A machine
+ * that has been masked off for 'kMaxWaitSteps' steps in a row, or whose
+ * word at the PC is not the same as the others' after an 'STC', is run
+ * to the end on its own by 'RunAlone'.
+ *
+ * Each machine runs exactly as 'Interpreter' would run it, but a machine
+ * that reads past the end of its input only stops, with 'is_out_of_data'
+ * set, rather than ending the process.  A machine in an infinite loop is
+ * stopped by the same check as 'Interpreter::CheckLoop' makes, with
+ * 'is_looping' set.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+InputSweep::InputSweep()
+    : memory_size_(0), lane_count_(0), loop_check_every_(kDefaultLoopCheck),
+      inputs_(nullptr), out_streams_(nullptr) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+InputSweep::~InputSweep() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Mutator for how many branches back each machine takes between looks
+ * for an infinite loop, where zero is never.
+**/
+void InputSweep::SetLoopCheck(int64_t every) {
+  loop_check_every_ = every;
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'CheckLoop'.
+ * What 'Interpreter::CheckLoop' does, for the machine in 'lane' after it
+ * has branched back: stop it if it is just as it was at an earlier look,
+ * since with no 'RD' since then it can only do the same again forever.
+ * The run stops after the branch, as 'Interpreter' does.
+**/
+void InputSweep::CheckLoop(int lane) {
+  if (--loop_countdown_[lane] > 0) return;
+  loop_countdown_[lane] = loop_check_every_;
+
+  ++loop_length_[lane];
+  if (pc_[lane] == saved_pc_[lane] && accum_[lane] == saved_accum_[lane]
+      && memory_hash_[lane] == saved_hash_[lane]) {
+    int address = 0;
+    while (address < DABnamespace::kMaxMemory
+           && memory_[address][lane] == saved_memory_[lane][address]) {
+      ++address;
+    }
+    if (address == DABnamespace::kMaxMemory) {
+      is_looping_[lane] = true;
+      return;
+    }
+  }
+  if (loop_length_[lane] == loop_power_[lane]) {
+    saved_pc_[lane] = pc_[lane];
+    saved_accum_[lane] = accum_[lane];
+    saved_hash_[lane] = memory_hash_[lane];
+    saved_memory_[lane].resize(DABnamespace::kMaxMemory);
+    for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+      saved_memory_[lane][address] =
+          static_cast<uint16_t>(memory_[address][lane]);
+    }
+    loop_power_[lane] *= 2;
+    loop_length_[lane] = 0;
+  }
+}
+
+/***************************************************************************
+ * Function 'DecodeAt'.
+ * The decoded form of 'word', which is at 'address'.  Each address keeps
+ * the last word decoded there, which is nearly always the one asked for.
+**/
+inline const DecodedInstruction& InputSweep::DecodeAt(int address,
+                                                     uint16_t word) {
+  if (decoded_word_[address] != word) {
+    decoded_word_[address] = word;
+    decoded_[address] = DABnamespace::DecodeWord(word, address);
+  }
+  return decoded_[address];
+}
+
+/***************************************************************************
+ * Functions 'Load' and 'Store'.
+ * Move the values of all the lanes between an array and a 'LaneVector'.
+ * The array need not be aligned as a 'LaneVector' is.
+**/
+inline InputSweep::LaneVector InputSweep::Load(const int32_t* values) {
+  LaneVector vector;
+  memcpy(&vector, values, sizeof(vector));
+  return vector;
+}
+
+inline void InputSweep::Store(const LaneVector& vector, int32_t* values) {
+  memcpy(values, &vector, sizeof(vector));
+}
+
+/***************************************************************************
+ * Function 'Read'.
+ * Do the 'RD' for one lane, which stops that machine if its input is
+ * used up.
+**/
+void InputSweep::Read(int lane) {
+  const vector<int>& input = (*inputs_)[lane];
+  if (next_input_[lane] < input.size()) {
+    accum_[lane] = input[next_input_[lane]++];
+    ResetLoopCheck(lane);
+  } else {
+    is_live_[lane] = false;
+    is_out_of_data_[lane] = true;
+  }
+}
+
+/***************************************************************************
+ * Function 'ResetLoopCheck'.
+ * Start 'CheckLoop' over for one lane, after an 'RD'.
+**/
+void InputSweep::ResetLoopCheck(int lane) {
+  loop_countdown_[lane] = loop_check_every_;
+  loop_power_[lane] = 1;
+  loop_length_[lane] = 0;
+  saved_pc_[lane] = -1;
+}
+
+/***************************************************************************
+ * Function 'Run'.
+ * Run 'image' once for each of the 'inputs', writing what each writes to
+ * the stream of the same number.
+ *
+ * Parameters:
+ *   image - the program, as from 'Interpreter::ReadImage'
+ *   inputs - for each machine, the values it reads, at most 'kLanes'
+ *   out_streams - for each machine, where it writes
+ *   results - set to how each machine's run ended
+**/
+void InputSweep::Run(const vector<uint16_t>& image,
+                     const vector<vector<int> >& inputs,
+                     const vector<std::ostream*>& out_streams,
+                     vector<LaneResult>& results) {
+  memory_size_ = static_cast<int>(image.size());
+  lane_count_ = std::min(static_cast<int>(inputs.size()), kLanes);
+  inputs_ = &inputs;
+  out_streams_ = &out_streams;
+
+  uint64_t memory_hash = 0;
+  for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+    int32_t word = (address < memory_size_) ? image[address] : 0;
+    std::fill(memory_[address], memory_[address] + kLanes, word);
+    memory_hash += HashWord(address, static_cast<uint16_t>(word));
+  }
+  for (int address = 0; address < memory_size_; ++address) {
+    decoded_word_[address] = image[address];
+    decoded_[address] = DABnamespace::DecodeWord(image[address], address);
+  }
+  for (int lane = 0; lane < kLanes; ++lane) {
+    accum_[lane] = 0;
+    pc_[lane] = 0;
+    executed_count_[lane] = 0;
+    waited_steps_[lane] = 0;
+    is_live_[lane] = lane < lane_count_ && memory_size_ > 0;
+    is_out_of_data_[lane] = false;
+    next_input_[lane] = 0;
+    memory_hash_[lane] = memory_hash;
+    is_looping_[lane] = false;
+    ResetLoopCheck(lane);
+  }
+
+  for (;;) {
+    int pc = DABnamespace::kPCForStop;
+    for (int lane = 0; lane < kLanes; ++lane) {
+      if (is_live_[lane] && pc_[lane] < pc) pc = pc_[lane];
+    }
+    if (pc == DABnamespace::kPCForStop) break;
+
+    int32_t active[kLanes];
+    int first = -1;
+    for (int lane = 0; lane < kLanes; ++lane) {
+      active[lane] = (is_live_[lane] && pc_[lane] == pc) ? -1 : 0;
+      if (active[lane] && first < 0) first = lane;
+    }
+    uint16_t word = static_cast<uint16_t>(memory_[pc][first]);
+    for (int lane = first + 1; lane < kLanes; ++lane) {
+      if (active[lane] && memory_[pc][lane] != word) {
+        active[lane] = 0;
+        RunAlone(lane);
+      }
+    }
+
+    StepTogether(DecodeAt(pc, word), Load(active));
+
+    for (int lane = 0; lane < kLanes; ++lane) {
+      if (active[lane]) {
+        waited_steps_[lane] = 0;
+      } else if (is_live_[lane] && ++waited_steps_[lane] > kMaxWaitSteps) {
+        RunAlone(lane);
+      }
+    }
+  }
+
+  results.resize(lane_count_);
+  for (int lane = 0; lane < lane_count_; ++lane) {
+    results[lane].executed_count = executed_count_[lane];
+    results[lane].pc = pc_[lane];
+    results[lane].accum = accum_[lane];
+    results[lane].is_out_of_data = is_out_of_data_[lane];
+    results[lane].is_looping = is_looping_[lane];
+  }
+}
+
+/***************************************************************************
+ * Function 'RunAlone'.
+ * Run one machine to the end by itself.
+**/
+void InputSweep::RunAlone(int lane) {
+  while (is_live_[lane]) {
+    int pc = pc_[lane];
+    StepAlone(lane, DecodeAt(pc, static_cast<uint16_t>(memory_[pc][lane])));
+  }
+  waited_steps_[lane] = 0;
+}
+
+/***************************************************************************
+ * Function 'Select'.
+ * Each lane of 'yes' where 'mask' is all ones and of 'no' where it is 0.
+**/
+inline InputSweep::LaneVector InputSweep::Select(const LaneVector& mask,
+                                                 const LaneVector& yes,
+                                                 const LaneVector& no) {
+  return (yes & mask) | (no & ~mask);
+}
+
+/***************************************************************************
+ * Function 'StepAlone'.
+ * Execute one instruction for one machine, as 'Interpreter' does.
+**/
+void InputSweep::StepAlone(int lane, const DecodedInstruction& inst) {
+  int location = inst.operand;
+  if (inst.indirect) {
+    location = memory_[location][lane] & 0xFFF;
+  }
+  int32_t value = memory_[location][lane];
+  int32_t& accum = accum_[lane];
+  switch (inst.opcode) {
+    case DABnamespace::kBAN:
+      if (accum < 0) {
+        bool is_back = location < pc_[lane];
+        pc_[lane] = location;
+        if (is_back && loop_check_every_ > 0) {
+          CheckLoop(lane);
+        }
+      }
+      break;
+    case DABnamespace::kSUB:
+      accum -= value & 0xFFF;
+      break;
+    case DABnamespace::kSTC:
+      StoreWord(lane, location, accum & 0xFFFF);
+      accum = 0;
+      break;
+    case DABnamespace::kAND:
+      accum &= value;
+      break;
+    case DABnamespace::kADD:
+      accum = DABnamespace::TwosComplement(accum)
+              + DABnamespace::TwosComplement(value);
+      break;
+    case DABnamespace::kLD:
+      accum = value & 0xFFF;
+      break;
+    case DABnamespace::kBR: {
+      bool is_back = location < pc_[lane];
+      pc_[lane] = location;
+      if (is_back && loop_check_every_ > 0) {
+        CheckLoop(lane);
+      }
+      break;
+    }
+    case DABnamespace::kSTP:
+      pc_[lane] = DABnamespace::kPCForStop;
+      break;
+    case DABnamespace::kRD:
+      Read(lane);
+      break;
+    case DABnamespace::kWRT:
+      Write(lane);
+      break;
+    default:
+      break;
+  }
+
+  // Stopped at the 'RD', which is not counted, as 'Interpreter' does.
+  if (is_out_of_data_[lane]) return;
+  ++executed_count_[lane];
+  if (is_live_[lane]
+      && (++pc_[lane] >= memory_size_ || is_looping_[lane])) {
+    is_live_[lane] = false;
+  }
+}
+
+/***************************************************************************
+ * Function 'StepTogether'.
+ * Execute one instruction for every machine in 'active', all at the same
+ * PC with the same word there.
+**/
+void InputSweep::StepTogether(const DecodedInstruction& inst,
+                              const LaneVector& active) {
+  if (inst.opcode == DABnamespace::kRD || inst.opcode == DABnamespace::kWRT) {
+    for (int lane = 0; lane < kLanes; ++lane) {
+      if (!active[lane]) continue;
+      if (inst.opcode == DABnamespace::kRD) {
+        Read(lane);
+      } else {
+        Write(lane);
+      }
+    }
+  } else if (inst.opcode <= DABnamespace::kSTP) {
+    // Where the target is, and what is there, for each lane.
+    LaneVector location = LaneVector() + inst.operand;
+    LaneVector value = Load(memory_[inst.operand]);
+    if (inst.indirect) {
+      location = value & 0xFFF;
+      for (int lane = 0; lane < kLanes; ++lane) {
+        value[lane] = memory_[location[lane]][lane];
+      }
+    }
+
+    LaneVector accum = Load(accum_);
+    LaneVector pc = Load(pc_);
+    switch (inst.opcode) {
+      case DABnamespace::kBAN:
+        pc = Select(active & (accum < 0), location, pc);
+        break;
+      case DABnamespace::kSUB:
+        accum = Select(active, accum - (value & 0xFFF), accum);
+        break;
+      case DABnamespace::kSTC:
+        if (inst.indirect || loop_check_every_ > 0) {
+          for (int lane = 0; lane < kLanes; ++lane) {
+            if (active[lane]) {
+              StoreWord(lane, location[lane], accum[lane] & 0xFFFF);
+            }
+          }
+        } else {
+          Store(Select(active, accum & 0xFFFF, value),
+                memory_[inst.operand]);
+        }
+        accum = Select(active, LaneVector(), accum);
+        break;
+      case DABnamespace::kAND:
+        accum = Select(active, accum & value, accum);
+        break;
+      case DABnamespace::kADD:
+        accum = Select(active, TwosComplement(accum) + TwosComplement(value),
+                       accum);
+        break;
+      case DABnamespace::kLD:
+        accum = Select(active, value & 0xFFF, accum);
+        break;
+      case DABnamespace::kBR:
+        pc = Select(active, location, pc);
+        break;
+      case DABnamespace::kSTP:
+        pc = Select(active, LaneVector() + DABnamespace::kPCForStop, pc);
+        break;
+      default:
+        break;
+    }
+    LaneVector is_back = active & (pc < Load(pc_));
+    Store(accum, accum_);
+    Store(pc, pc_);
+    if (loop_check_every_ > 0 && (inst.opcode == DABnamespace::kBAN
+                                  || inst.opcode == DABnamespace::kBR)) {
+      for (int lane = 0; lane < kLanes; ++lane) {
+        if (is_back[lane]) CheckLoop(lane);
+      }
+    }
+  }
+
+  for (int lane = 0; lane < kLanes; ++lane) {
+    if (!active[lane] || is_out_of_data_[lane]) continue;
+    ++executed_count_[lane];
+    if (is_live_[lane]
+        && (++pc_[lane] >= memory_size_ || is_looping_[lane])) {
+      is_live_[lane] = false;
+    }
+  }
+}
+
+/***************************************************************************
+ * Function 'StoreWord'.
+ * Store 'word' at 'location' for one lane, keeping the hash of its memory
+ * that 'CheckLoop' uses up to date.
+**/
+inline void InputSweep::StoreWord(int lane, int location, int32_t word) {
+  if (loop_check_every_ > 0) {
+    memory_hash_[lane] +=
+        HashWord(location, static_cast<uint16_t>(word))
+        - HashWord(location, static_cast<uint16_t>(memory_[location][lane]));
+  }
+  memory_[location][lane] = word;
+}
+
+/***************************************************************************
+ * Function 'TwosComplement'.
+ * What 'Interpreter::TwosComplementInteger' does, for every lane.
+**/
+inline InputSweep::LaneVector InputSweep::TwosComplement(
+    const LaneVector& values) {
+  return values - ((values > 32768) & 65536);
+}
+
+/***************************************************************************
+ * Function 'Write'.
+ * Do the 'WRT' for one lane.
+**/
+void InputSweep::Write(int lane) {
+  int accum = accum_[lane];
+  *(*out_streams_)[lane] << DABnamespace::OutputLine(accum) << '\n';
+}
@@ -0,0 +1,107 @@
+/****************************************************************
+ * Header file for the 'InputSweep' class that runs one Pullet16
+ * program against several sets of input at once, in lockstep.
+**/
+
+#ifndef INPUTSWEEP_H
+#define INPUTSWEEP_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cin;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+#include "./Utilities/scanner.h"
+#include "./Utilities/utils.h"
+
+#include "dabnamespace.h"
+
+using DABnamespace::DecodedInstruction;
+using DABnamespace::HashWord;
+
+class InputSweep {
+ public:
+  static const int kLanes = 8;  // machines run together
+
+  /****************************************************************
+   * How one machine's run ended.
+  **/
+  struct LaneResult {
+    int64_t executed_count;
+    int pc;
+    int accum;
+    bool is_out_of_data;
+    bool is_looping;  // stopped in an infinite loop
+  };
+
+  InputSweep();
+  virtual ~InputSweep();
+
+  void SetLoopCheck(int64_t every);
+
+  void Run(const vector<uint16_t>& image, const vector<vector<int> >& inputs,
+           const vector<std::ostream*>& out_streams,
+           vector<LaneResult>& results);
+
+ private:
+  static const int kMaxWaitSteps = 256;  // masked, before running alone
+  static const int64_t kDefaultLoopCheck = 16;  // branches back per check
+
+  // One value for each lane, for the compiler to keep in vector
+  // registers and operate on all at once.
+  typedef int32_t LaneVector __attribute__((vector_size(4 * kLanes)));
+
+  int memory_size_;
+  int lane_count_;
+  int32_t memory_[DABnamespace::kMaxMemory][kLanes];
+  int32_t accum_[kLanes];
+  int32_t pc_[kLanes];
+  int64_t executed_count_[kLanes];
+  int waited_steps_[kLanes];
+  bool is_live_[kLanes];
+  bool is_out_of_data_[kLanes];
+  size_t next_input_[kLanes];
+
+  // For 'CheckLoop', what 'Interpreter' keeps for its one machine, for
+  // each lane.  The saved memory of a lane is only made at its first save.
+  int64_t loop_check_every_;
+  int64_t loop_countdown_[kLanes];
+  int64_t loop_power_[kLanes];
+  int64_t loop_length_[kLanes];
+  uint64_t memory_hash_[kLanes];
+  uint64_t saved_hash_[kLanes];
+  int32_t saved_pc_[kLanes];
+  int32_t saved_accum_[kLanes];
+  vector<uint16_t> saved_memory_[kLanes];
+  bool is_looping_[kLanes];
+
+  uint16_t decoded_word_[DABnamespace::kMaxMemory];
+  DecodedInstruction decoded_[DABnamespace::kMaxMemory];
+
+  const vector<vector<int> >* inputs_;
+  const vector<std::ostream*>* out_streams_;
+
+  void CheckLoop(int lane);
+  const DecodedInstruction& DecodeAt(int address, uint16_t word);
+  void Read(int lane);
+  void ResetLoopCheck(int lane);
+  void RunAlone(int lane);
+  void StepAlone(int lane, const DecodedInstruction& inst);
+  void StepTogether(const DecodedInstruction& inst,
+                    const LaneVector& active);
+  void StoreWord(int lane, int location, int32_t word);
+  void Write(int lane);
+
+  static LaneVector Load(const int32_t* values);
+  static void Store(const LaneVector& vector, int32_t* values);
+  static LaneVector Select(const LaneVector& mask, const LaneVector& yes,
+                           const LaneVector& no);
+  static LaneVector TwosComplement(const LaneVector& values);
+};
+#endif
@@ -0,0 +1,491 @@
+#include "jitcompiler.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_IS_AVAILABLE 1
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'JitCompiler' for translating a Pullet16 program to x86-64 code.
+ *
+ * 'Compile' translates every word of the loaded program, in address order,
+ * into a short run of native code, so that falling through from one word to
+ * the next needs no jump at all.  While the compiled code runs
+ *   rbx holds the 'JitContext',
+ *   r12 holds the base of the guest memory (two bytes per word),
+ *   r13d holds the accumulator,
+ *   r14 holds the table of native entry points, for indirect branches, and
+ *   r15 holds the count of instructions executed.
+ * These are all callee-saved, so 'RD' and 'WRT' can call out to ordinary
+ * C++ functions through the context.  Each word's code starts by counting
+ * itself, so a word that is patched out, below, is not counted, and the
+ * interpreter counts it when it runs it.
+ *
+ * Each word's code follows the interpreter exactly, including the rule
+ * that a branch to 'target' carries on at 'target' + 1 and the two's
+ * complement conversions in 'ADD'.  Leaving the program, by 'STP' or by
+ * running off the end of it, jumps to a common exit that writes the PC
+ * and the accumulator back to the context and returns.
+ *
+ * Self-modifying code is handled by the 'STC' that does it: if it writes
+ * a word of the program with something other than what was compiled, the
+ * first bytes of that word's native code are overwritten with an exit at
+ * that address, so that if the word is ever executed the caller will
+ * interpret it instead.  Every word's code is therefore made at least
+ * 'kMinEntrySize' bytes long.  'Unpatch' puts back what the patches
+ * overwrote, so that the code can run again from the compiled image.
+ *
+ * On anything other than x86-64 Linux 'Compile' simply returns false.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+JitCompiler::JitCompiler()
+    : memory_size_(0), memory_(nullptr),
+      native_(nullptr), native_size_(0), exit_offset_(0) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+JitCompiler::~JitCompiler() {
+  Release();
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Function 'IsAvailable'.
+ * Is there a code generator for the machine we are running on?
+**/
+bool JitCompiler::IsAvailable() {
+#ifdef JIT_IS_AVAILABLE
+  return true;
+#else
+  return false;
+#endif
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'CodeWrite'.
+ * Called from compiled code after an 'STC' to a word of the program.
+**/
+void JitCompiler::CodeWrite(JitContext* context, int address) {
+  static_cast<JitCompiler*>(context->compiler)->Invalidate(address);
+}
+
+/***************************************************************************
+ * Function 'Compile'.
+ * Translate the program in 'memory' into native code.
+ *
+ * Parameters:
+ *   memory - the guest memory image
+ *   memory_size - the number of words in the program
+ *
+ * Returns:
+ *   true if there is now native code that 'Run' can execute
+**/
+bool JitCompiler::Compile(const uint16_t* memory, int memory_size) {
+#ifdef EBUG
+  Utils::log_stream << "enter Compile" << endl;
+#endif
+#ifdef JIT_IS_AVAILABLE
+  Release();
+  memory_size_ = memory_size;
+  compiled_image_.assign(memory, memory + memory_size);
+  is_patched_.assign(memory_size, false);
+  unpatched_.assign(static_cast<size_t>(memory_size) * kMinEntrySize, 0);
+  entry_offsets_.assign(memory_size, 0);
+  fixups_.clear();
+  code_.clear();
+
+  // Prologue: save the registers we use, load them from the context, and
+  // jump to the entry point for the starting PC.
+  Emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+  Emit({0x48, 0x89, 0xFB});  // mov rbx, rdi
+  Emit({0x4C, 0x8B, 0x63, offsetof(JitContext, memory)});   // mov r12
+  Emit({0x44, 0x8B, 0x6B, offsetof(JitContext, accum)});    // mov r13d
+  Emit({0x4C, 0x8B, 0x73, offsetof(JitContext, entries)});  // mov r14
+  Emit({0x4C, 0x8B, 0x7B, offsetof(JitContext, executed_count)});  // r15
+  Emit({0x48, 0x63, 0x43, offsetof(JitContext, pc)});       // movsxd rax
+  Emit({0x41, 0xFF, 0x24, 0xC6});  // jmp [r14 + rax*8]
+
+  // The common exit, with the PC to leave at in eax.
+  exit_offset_ = code_.size();
+  Emit({0x89, 0x43, offsetof(JitContext, pc)});
+  Emit({0x44, 0x89, 0x6B, offsetof(JitContext, accum)});
+  Emit({0x4C, 0x89, 0x7B, offsetof(JitContext, executed_count)});
+  Emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+
+  for (int address = 0; address < memory_size_; ++address) {
+    entry_offsets_[address] = code_.size();
+    EmitInstruction(memory[address], address);
+    while (code_.size() - entry_offsets_[address] < kMinEntrySize) {
+      Emit({0x0F, 0x1F, 0x44, 0x00, 0x00});  // five byte nop
+    }
+  }
+  EmitExitTo(memory_size_);
+
+  for (size_t sub = 0; sub < fixups_.size(); ++sub) {
+    size_t offset = fixups_[sub].first;
+    Patch32(offset, static_cast<int>(entry_offsets_[fixups_[sub].second])
+                    - static_cast<int>(offset + 4));
+  }
+
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  native_size_ = (code_.size() + page_size - 1) / page_size * page_size;
+  void* pages = mmap(nullptr, native_size_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pages == MAP_FAILED) {
+    native_size_ = 0;
+    return false;
+  }
+  native_ = static_cast<uint8_t*>(pages);
+  memcpy(native_, code_.data(), code_.size());
+  if (mprotect(native_, native_size_, PROT_READ | PROT_EXEC) != 0) {
+    Release();
+    return false;
+  }
+
+  entries_.assign(memory_size_, nullptr);
+  for (int address = 0; address < memory_size_; ++address) {
+    entries_[address] = native_ + entry_offsets_[address];
+  }
+  code_.clear();
+
+#ifdef EBUG
+  Utils::log_stream << "leave Compile" << endl;
+#endif
+  return true;
+#else
+  return false;
+#endif
+}
+
+/***************************************************************************
+ * Function 'Emit'.
+ * Append machine code bytes.
+**/
+void JitCompiler::Emit(std::initializer_list<int> bytes) {
+  for (int byte : bytes) {
+    code_.push_back(static_cast<uint8_t>(byte));
+  }
+}
+
+/***************************************************************************
+ * Function 'Emit32'.
+ * Append a little-endian 32 bit immediate or displacement.
+**/
+void JitCompiler::Emit32(int value) {
+  uint32_t bits = static_cast<uint32_t>(value);
+  Emit({static_cast<int>(bits & 0xFF), static_cast<int>((bits >> 8) & 0xFF),
+        static_cast<int>((bits >> 16) & 0xFF),
+        static_cast<int>((bits >> 24) & 0xFF)});
+}
+
+/***************************************************************************
+ * Function 'EmitBranch'.
+ * Jump to the word after the branch target, as 'BR' and a taken 'BAN' do.
+**/
+void JitCompiler::EmitBranch(const DecodedInstruction& inst) {
+  if (!inst.indirect) {
+    EmitJumpTo(inst.operand + 1);
+    return;
+  }
+  EmitLocationToEax(inst);
+  Emit({0xFF, 0xC0});                         // inc eax
+  Emit({0x3D});                               // cmp eax, memory_size_
+  Emit32(memory_size_);
+  Emit({0x0F, 0x83});                         // jae exit
+  Emit32(static_cast<int>(exit_offset_) - static_cast<int>(code_.size() + 4));
+  Emit({0x41, 0xFF, 0x24, 0xC6});             // jmp [r14 + rax*8]
+}
+
+/***************************************************************************
+ * Function 'EmitCall'.
+ * Call the function pointer at 'function_offset' in the context, with the
+ * context as its first argument.
+**/
+void JitCompiler::EmitCall(int function_offset) {
+  Emit({0x48, 0x89, 0xDF});                   // mov rdi, rbx
+  Emit({0xFF, 0x53, function_offset});        // call [rbx + offset]
+}
+
+/***************************************************************************
+ * Function 'EmitExitTo'.
+ * Leave the compiled code with the given PC.
+**/
+void JitCompiler::EmitExitTo(int pc) {
+  Emit({0xB8});                               // mov eax, pc
+  Emit32(pc);
+  Emit({0xE9});                               // jmp exit
+  Emit32(static_cast<int>(exit_offset_) - static_cast<int>(code_.size() + 4));
+}
+
+/***************************************************************************
+ * Function 'EmitInstruction'.
+ * Translate the word at 'address'.
+**/
+void JitCompiler::EmitInstruction(uint16_t word, int address) {
+  DecodedInstruction inst = DABnamespace::DecodeWord(word, address);
+  size_t skip = 0;
+
+  Emit({0x49, 0xFF, 0xC7});                              // inc r15
+
+  switch (inst.opcode) {
+    case DABnamespace::kADD:
+      // The accumulator and the word as two's complement, then add.
+      Emit({0x41, 0x8D, 0x85, 0x00, 0x00, 0xFF, 0xFF});  // lea eax,[r13-65536]
+      Emit({0x41, 0x81, 0xFD, 0x00, 0x80, 0x00, 0x00});  // cmp r13d, 32768
+      Emit({0x44, 0x0F, 0x4F, 0xE8});                    // cmovg r13d, eax
+      EmitLoadEcx(inst);
+      Emit({0x8D, 0x91, 0x00, 0x00, 0xFF, 0xFF});        // lea edx,[rcx-65536]
+      Emit({0x81, 0xF9, 0x00, 0x80, 0x00, 0x00});        // cmp ecx, 32768
+      Emit({0x0F, 0x4F, 0xCA});                          // cmovg ecx, edx
+      Emit({0x41, 0x01, 0xCD});                          // add r13d, ecx
+      break;
+    case DABnamespace::kAND:
+      EmitLoadEcx(inst);
+      Emit({0x41, 0x21, 0xCD});                          // and r13d, ecx
+      break;
+    case DABnamespace::kSUB:
+      EmitLoadEcx(inst);
+      Emit({0x81, 0xE1, 0xFF, 0x0F, 0x00, 0x00});        // and ecx, 0xFFF
+      Emit({0x41, 0x29, 0xCD});                          // sub r13d, ecx
+      break;
+    case DABnamespace::kLD:
+      EmitLoadEcx(inst);
+      Emit({0x41, 0x89, 0xCD});                          // mov r13d, ecx
+      Emit({0x41, 0x81, 0xE5, 0xFF, 0x0F, 0x00, 0x00});  // and r13d, 0xFFF
+      break;
+    case DABnamespace::kSTC:
+      if (!inst.indirect) {
+        Emit({0x66, 0x45, 0x89, 0xAC, 0x24});            // mov [r12+d], r13w
+        Emit32(inst.operand * 2);
+        Emit({0x45, 0x31, 0xED});                        // xor r13d, r13d
+        if (inst.operand < memory_size_) {
+          Emit({0xBE});                                  // mov esi, operand
+          Emit32(inst.operand);
+          EmitCall(offsetof(JitContext, code_write));
+        }
+      } else {
+        EmitLocationToEax(inst);
+        Emit({0x66, 0x45, 0x89, 0x2C, 0x44});            // mov [r12+rax*2]
+        Emit({0x45, 0x31, 0xED});                        // xor r13d, r13d
+        Emit({0x3D});                                    // cmp eax, size
+        Emit32(memory_size_);
+        Emit({0x73, 0x00});                              // jae over the call
+        skip = code_.size();
+        Emit({0x89, 0xC6});                              // mov esi, eax
+        EmitCall(offsetof(JitContext, code_write));
+        code_[skip - 1] = static_cast<uint8_t>(code_.size() - skip);
+      }
+      break;
+    case DABnamespace::kBAN:
+      Emit({0x45, 0x85, 0xED});                          // test r13d, r13d
+      Emit({0x79, 0x00});                                // jns over the branch
+      skip = code_.size();
+      EmitBranch(inst);
+      code_[skip - 1] = static_cast<uint8_t>(code_.size() - skip);
+      break;
+    case DABnamespace::kBR:
+      EmitBranch(inst);
+      break;
+    case DABnamespace::kSTP:
+      Emit({0x8B, 0x43, offsetof(JitContext, stop_pc)});  // mov eax, stop_pc
+      Emit({0xE9});                                       // jmp exit
+      Emit32(static_cast<int>(exit_offset_)
+             - static_cast<int>(code_.size() + 4));
+      break;
+    case DABnamespace::kRD:
+      Emit({0x44, 0x89, 0x6B, offsetof(JitContext, accum)});
+      Emit({0x4C, 0x89, 0x7B, offsetof(JitContext, executed_count)});
+      EmitCall(offsetof(JitContext, read));
+      Emit({0x44, 0x8B, 0x6B, offsetof(JitContext, accum)});
+      Emit({0x4C, 0x8B, 0x7B, offsetof(JitContext, executed_count)});
+      Emit({0x85, 0xC0});                                 // test eax, eax
+      Emit({0x74, 0x0A});                                 // jz over the exit
+      EmitExitTo(address);
+      break;
+    case DABnamespace::kWRT:
+      Emit({0x44, 0x89, 0x6B, offsetof(JitContext, accum)});
+      EmitCall(offsetof(JitContext, write));
+      break;
+    default:  // an 'EEE' word with no defined function
+      break;
+  }
+}
+
+/***************************************************************************
+ * Function 'EmitJumpTo'.
+ * Carry on at 'pc', leaving the compiled code if that is past the program.
+**/
+void JitCompiler::EmitJumpTo(int pc) {
+  if (pc >= memory_size_) {
+    EmitExitTo(pc);
+    return;
+  }
+  Emit({0xE9});
+  fixups_.push_back(std::make_pair(code_.size(), pc));
+  Emit32(0);
+}
+
+/***************************************************************************
+ * Function 'EmitLocationToEax'.
+ * Put the target location of the instruction in eax.
+**/
+void JitCompiler::EmitLocationToEax(const DecodedInstruction& inst) {
+  if (inst.indirect) {
+    Emit({0x41, 0x0F, 0xB7, 0x84, 0x24});    // movzx eax, word [r12 + d]
+    Emit32(inst.operand * 2);
+    Emit({0x25, 0xFF, 0x0F, 0x00, 0x00});    // and eax, 0xFFF
+  } else {
+    Emit({0xB8});                            // mov eax, operand
+    Emit32(inst.operand);
+  }
+}
+
+/***************************************************************************
+ * Function 'EmitLoadEcx'.
+ * Load the word at the instruction's target location into ecx.
+**/
+void JitCompiler::EmitLoadEcx(const DecodedInstruction& inst) {
+  if (inst.indirect) {
+    EmitLocationToEax(inst);
+    Emit({0x41, 0x0F, 0xB7, 0x0C, 0x44});    // movzx ecx, word [r12 + rax*2]
+  } else {
+    Emit({0x41, 0x0F, 0xB7, 0x8C, 0x24});    // movzx ecx, word [r12 + d]
+    Emit32(inst.operand * 2);
+  }
+}
+
+/***************************************************************************
+ * Function 'Invalidate'.
+ * The word at 'address' has just been stored into.  If it now differs from
+ * what was compiled there, replace the start of its code with an exit.
+**/
+void JitCompiler::Invalidate(int address) {
+#ifdef JIT_IS_AVAILABLE
+  if (address >= memory_size_ || is_patched_[address]) return;
+  if (memory_[address] == compiled_image_[address]) return;
+
+  // mov eax, address; jmp exit
+  uint8_t patch[kMinEntrySize];
+  int32_t exit_distance = static_cast<int32_t>(exit_offset_)
+                          - static_cast<int32_t>(entry_offsets_[address]
+                                                 + kMinEntrySize);
+  int32_t pc = address;
+  patch[0] = 0xB8;
+  memcpy(&patch[1], &pc, 4);
+  patch[5] = 0xE9;
+  memcpy(&patch[6], &exit_distance, 4);
+
+  // We are called from the compiled code, but from outside these pages,
+  // and nothing in them runs until we return.
+  mprotect(native_, native_size_, PROT_READ | PROT_WRITE);
+  memcpy(&unpatched_[static_cast<size_t>(address) * kMinEntrySize],
+         entries_[address], kMinEntrySize);
+  memcpy(entries_[address], patch, kMinEntrySize);
+  mprotect(native_, native_size_, PROT_READ | PROT_EXEC);
+  is_patched_[address] = true;
+#endif
+}
+
+/***************************************************************************
+ * Function 'IsCompiledFrom'.
+ * Is there code compiled from exactly the words in 'memory'?
+**/
+bool JitCompiler::IsCompiledFrom(const uint16_t* memory,
+                                 int memory_size) const {
+  if (native_ == nullptr || memory_size != memory_size_) return false;
+  return std::equal(compiled_image_.begin(), compiled_image_.end(), memory);
+}
+
+/***************************************************************************
+ * Function 'Patch32'.
+ * Overwrite a 32 bit value already emitted.
+**/
+void JitCompiler::Patch32(size_t offset, int value) {
+  uint32_t bits = static_cast<uint32_t>(value);
+  for (int sub = 0; sub < 4; ++sub) {
+    code_[offset + sub] = static_cast<uint8_t>((bits >> (8 * sub)) & 0xFF);
+  }
+}
+
+/***************************************************************************
+ * Function 'Release'.
+ * Give back the native code pages.
+**/
+void JitCompiler::Release() {
+#ifdef JIT_IS_AVAILABLE
+  if (native_ != nullptr) {
+    munmap(native_, native_size_);
+  }
+#endif
+  native_ = nullptr;
+  native_size_ = 0;
+  entries_.clear();
+}
+
+/***************************************************************************
+ * Function 'Run'.
+ * Execute the compiled code from 'context->pc' until it leaves, which sets
+ * 'context->pc' and 'context->accum'.
+**/
+void JitCompiler::Run(JitContext* context) {
+#ifdef EBUG
+  Utils::log_stream << "enter Run" << endl;
+#endif
+  if (native_ == nullptr) return;
+  if (context->pc < 0 || context->pc >= memory_size_) return;
+
+  context->entries = entries_.data();
+  context->compiler = this;
+  context->code_write = &JitCompiler::CodeWrite;
+  memory_ = context->memory;
+
+  void (*entry)(JitContext*) = reinterpret_cast<void (*)(JitContext*)>(
+                                 native_);
+  entry(context);
+#ifdef EBUG
+  Utils::log_stream << "leave Run" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'Unpatch'.
+ * Put back the code of every word that 'Invalidate' patched out, for a run
+ * with memory once more as it was compiled.
+**/
+void JitCompiler::Unpatch() {
+#ifdef JIT_IS_AVAILABLE
+  if (native_ == nullptr) return;
+  bool is_writable = false;
+  for (int address = 0; address < memory_size_; ++address) {
+    if (!is_patched_[address]) continue;
+    if (!is_writable) {
+      mprotect(native_, native_size_, PROT_READ | PROT_WRITE);
+      is_writable = true;
+    }
+    memcpy(entries_[address],
+           &unpatched_[static_cast<size_t>(address) * kMinEntrySize],
+           kMinEntrySize);
+    is_patched_[address] = false;
+  }
+  if (is_writable) {
+    mprotect(native_, native_size_, PROT_READ | PROT_EXEC);
+  }
+#endif
+}
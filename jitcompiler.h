@@ -0,0 +1,103 @@
+/****************************************************************
+ * Header file for the 'JitCompiler' class that translates a
+ * Pullet16 memory image into native x86-64 code.
+**/
+
+#ifndef JITCOMPILER_H
+#define JITCOMPILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::cin;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "dabnamespace.h"
+
+using DABnamespace::DecodedInstruction;
+
+/****************************************************************
+ * The state shared between compiled code and its caller.  The
+ * compiled code keeps the accumulator in a register and only
+ * writes it back here around a call out and when it returns,
+ * with 'pc' set to where the interpreter should carry on, which
+ * is 'stop_pc' after an 'STP'.  It does the same with
+ * 'executed_count', to which it adds one for every word it runs.
+ *
+ * 'read' and 'write' carry out 'RD' and 'WRT'; 'read' returns
+ * nonzero if execution must stop at the 'RD'.  'owner', 'input',
+ * and 'output' are for their use.
+**/
+struct JitContext {
+  uint16_t* memory;
+  uint8_t* const* entries;
+  int accum;
+  int pc;
+  int stop_pc;
+  int (*read)(JitContext* context);
+  void (*write)(JitContext* context);
+  void (*code_write)(JitContext* context, int address);
+  void* compiler;
+  void* owner;
+  void* input;
+  void* output;
+  int64_t executed_count;
+};
+
+class JitCompiler {
+ public:
+  JitCompiler();
+  virtual ~JitCompiler();
+
+  static bool IsAvailable();
+
+  bool Compile(const uint16_t* memory, int memory_size);
+  bool IsCompiledFrom(const uint16_t* memory, int memory_size) const;
+  void Run(JitContext* context);
+  void Unpatch();
+
+ private:
+  static const int kMinEntrySize = 10;  // room for an exit patch
+
+  int memory_size_;
+  uint16_t* memory_;
+
+  uint8_t* native_;
+  size_t native_size_;
+
+  size_t exit_offset_;
+
+  vector<uint8_t> code_;
+  vector<size_t> entry_offsets_;
+  vector<uint8_t*> entries_;
+  vector<uint16_t> compiled_image_;
+  vector<bool> is_patched_;
+  vector<uint8_t> unpatched_;  // what each patch overwrote
+  vector<std::pair<size_t, int> > fixups_;
+
+  static void CodeWrite(JitContext* context, int address);
+
+  void Emit(std::initializer_list<int> bytes);
+  void Emit32(int value);
+  void EmitBranch(const DecodedInstruction& inst);
+  void EmitCall(int function_offset);
+  void EmitExitTo(int pc);
+  void EmitInstruction(uint16_t word, int address);
+  void EmitJumpTo(int pc);
+  void EmitLocationToEax(const DecodedInstruction& inst);
+  void EmitLoadEcx(const DecodedInstruction& inst);
+  void Invalidate(int address);
+  void Patch32(size_t offset, int value);
+  void Release();
+};
+#endif
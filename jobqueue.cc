@@ -0,0 +1,103 @@
+#include "jobqueue.h"
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'JobQueue' for running the jobs of a batch on several threads.
+ *
+ * Jobs are numbered in the order of the manifest and dealt out to the
+ * workers in turn, so that at any time the jobs being run are close to
+ * the front of the manifest.  A worker takes its own jobs from the front
+ * of its deque; one that has run out steals from the back of the others,
+ * which is the work that would otherwise be done last.  Nothing is added
+ * once the queue is started, so a worker that finds every deque empty is
+ * done.
+ *
+ * Each finished job leaves its log with the queue, and 'WaitFor' gives
+ * the logs back in order, so they can be written as they come in while
+ * later jobs are still running.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+JobQueue::JobQueue() {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+JobQueue::~JobQueue() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Finish'.
+ * Take the log of a finished job, for 'WaitFor'.
+**/
+void JobQueue::Finish(int job, string& log) {
+  std::lock_guard<std::mutex> guard(results_lock_);
+  logs_[job].swap(log);
+  is_finished_[job] = true;
+  result_ready_.notify_all();
+}
+
+/***************************************************************************
+ * Function 'Next'.
+ * Take the next job for 'worker', its own or one stolen from another.
+ *
+ * Returns:
+ *   false if there are no jobs left anywhere
+**/
+bool JobQueue::Next(int worker, int& job) {
+  int worker_count = static_cast<int>(workers_.size());
+  for (int sub = 0; sub < worker_count; ++sub) {
+    WorkerJobs& victim = *workers_[(worker + sub) % worker_count];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.jobs.empty()) continue;
+    if (sub == 0) {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+    } else {
+      job = victim.jobs.back();
+      victim.jobs.pop_back();
+    }
+    return true;
+  }
+  return false;
+}
+
+/***************************************************************************
+ * Function 'Start'.
+ * Deal out jobs 0 through 'job_count' - 1 to 'worker_count' workers.
+**/
+void JobQueue::Start(int job_count, int worker_count) {
+  workers_.clear();
+  for (int worker = 0; worker < worker_count; ++worker) {
+    workers_.push_back(std::unique_ptr<WorkerJobs>(new WorkerJobs()));
+  }
+  for (int job = 0; job < job_count; ++job) {
+    workers_[job % worker_count]->jobs.push_back(job);
+  }
+  is_finished_.assign(job_count, false);
+  logs_.assign(job_count, "");
+}
+
+/***************************************************************************
+ * Function 'WaitFor'.
+ * Wait until 'job' is finished and take its log.
+**/
+void JobQueue::WaitFor(int job, string& log) {
+  std::unique_lock<std::mutex> guard(results_lock_);
+  while (!is_finished_[job]) {
+    result_ready_.wait(guard);
+  }
+  log.swap(logs_[job]);
+  logs_[job].clear();
+}
@@ -0,0 +1,47 @@
+/****************************************************************
+ * Header file for the 'JobQueue' class that shares out the jobs
+ * of a batch among worker threads and hands their logs back in
+ * the order of the manifest.
+**/
+
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class JobQueue {
+ public:
+  JobQueue();
+  virtual ~JobQueue();
+
+  void Finish(int job, string& log);
+  bool Next(int worker, int& job);
+  void Start(int job_count, int worker_count);
+  void WaitFor(int job, string& log);
+
+ private:
+  /****************************************************************
+   * The jobs still to be run by one worker, from the front by the
+   * worker itself and from the back by any worker that steals.
+  **/
+  struct WorkerJobs {
+    std::mutex lock;
+    std::deque<int> jobs;
+  };
+
+  vector<std::unique_ptr<WorkerJobs> > workers_;
+
+  std::mutex results_lock_;
+  std::condition_variable result_ready_;
+  vector<bool> is_finished_;
+  vector<string> logs_;
+};
+#endif
@@ -0,0 +1,31 @@
+/****************************************************************
+ * Header file for the 'MachineSnapshot' that an 'Interpreter'
+ * saves and restores.
+ *
+ * A snapshot is a loaded machine as 'Interpret' would start it:
+ * memory, the decoded and fused instructions, and the PC and
+ * accumulator to start with, which are past the start of the
+ * program if some of it has already been run (see 'RunPrefix'),
+ * with the count of the instructions that took.  It is plain
+ * data, so it is copied with 'memcpy' and is the same whatever
+ * the trace policy of the interpreter that saved it.
+**/
+
+#ifndef MACHINESNAPSHOT_H
+#define MACHINESNAPSHOT_H
+
+#include <cstdint>
+
+#include "dabnamespace.h"
+
+using DABnamespace::DecodedInstruction;
+
+struct MachineSnapshot {
+  int memory_size;
+  int pc;
+  int accum;
+  int64_t executed_count;
+  uint16_t memory[DABnamespace::kMaxMemory];
+  DecodedInstruction decoded[DABnamespace::kMaxMemory];
+};
+#endif
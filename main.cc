@@ -22,56 +22,1081 @@
  *          extension.  This is to allow the same source code
  *          to run without modification by adding the 'BINARY'
  *          for the ifdef at compile time.
+ *
+ * Options, each an option name and a value, may come before the
+ * file names:
+ *   -engine switch|threaded|jit
+ *                             the execution engine (default switch)
+ *   -fuse yes|no              fuse superinstructions (default yes)
+ *   -hottrace yes|no          record and run traces of hot loops in the
+ *                             switch engine, with '-log' summary or none
+ *                             (default yes)
+ *   -emitcpp cppfilename      also write the program, as read, as C++
+ *                             that can be compiled to run it natively
+ *   -log full|async|diff|summary|none
+ *                             what the interpreter writes to the log:
+ *                             the machine and every instruction (the
+ *                             default, or 'async' to have another thread
+ *                             write it), every instruction with only the
+ *                             changes to the machine between keyframes,
+ *                             a summary at the end, or nothing
+ *   -bintrace tracefilename   write a binary trace of every instruction to
+ *                             tracefilename instead, which 'Tprog' turns
+ *                             back into the full log; the 'jit' engine is
+ *                             not used then, and '-log' and the snapshot
+ *                             options cannot be given
+ *   -snapevery count          instead, write the whole machine only every
+ *                             count instructions
+ *   -snapms milliseconds      and/or every so many milliseconds
+ *   -snapat pc,pc,...         and/or whenever the PC is one of these; with
+ *                             any of the three, the log has only these
+ *                             snapshots and the summary, so '-log' cannot
+ *                             be given, and the 'jit' engine is not used
+ *   -batch manifestfilename   run every job in the manifest, one after
+ *                             another, instead of the one job named by
+ *                             the file names; only the log file name is
+ *                             then given
+ *   -threads count            run the jobs of a batch on this many
+ *                             threads, or on one for each core if 0
+ *                             (default 1)
+ *   -loopcheck count          stop a run that is in an infinite loop,
+ *                             looking at every count'th branch back, or
+ *                             never if 0 (default 16); with '-sweep',
+ *                             each run is looked at by itself, with
+ *                             '-cores' the cores together, and not
+ *                             at all with '-coresched free'; the 'jit'
+ *                             engine does not look, so it is used only
+ *                             with 0, and the 'switch' engine otherwise
+ *   -prefix count             when a program is loaded, run it as far as
+ *                             its first read or write, but for no more
+ *                             than count instructions, and start every
+ *                             run of it from there; only with '-log'
+ *                             summary or none, and 0 turns it off
+ *                             (default 1000000)
+ *   -cache directory          keep the output and log of each run in
+ *                             directory, and give them back instead of
+ *                             running the same program on the same data
+ *                             again (see 'ResultCache'); only with '-log'
+ *                             summary or none
+ *   -cachemb megabytes        the most the cache may hold (default 64)
+ *   -slice count              run the jobs of a batch all at once on the
+ *                             one thread, up to 'kSliceMachines' loaded at
+ *                             a time, taking turns of count instructions
+ *                             (see 'RoundRobin'); not with '-threads' more
+ *                             than 1, '-log async', '-engine jit', whose
+ *                             code runs only to the end, '-bintrace',
+ *                             '-cache', '-emitcpp', or '-sweep'
+ *   -stream manifestfilename  run the jobs in the manifest together, as
+ *                             with '-slice', 'kStreamMachines' at a time,
+ *                             reading each data file and writing each
+ *                             output file as it goes, so they can be
+ *                             pipes (see 'EventLoop'); the same options
+ *                             cannot be used with it
+ *   -cores count              run the one job on this many cores over the
+ *                             one memory (see 'Multiprocessor'); the log
+ *                             has a summary for each core, so '-log
+ *                             summary' or none must be given, and none of
+ *                             the options for the interpreter itself, nor
+ *                             '-threads', '-batch', '-stream', '-sweep',
+ *                             '-bintrace', '-cache', or '-emitcpp'
+ *   -coresched interleave|free
+ *                             take turns on one thread, '-slice' count
+ *                             instructions each (default 1), so that the
+ *                             run is the same every time (the default), or
+ *                             run each core on a thread of its own
+ *   -sweep sweepfilename      run the one program named against every
+ *                             data file in the sweep file, several at a
+ *                             time in lockstep (see 'InputSweep'); only
+ *                             the 'a.out' and log file names are given,
+ *                             and the log has a summary for each run, so
+ *                             '-log summary' must be given, and none of
+ *                             the options for the interpreter itself
+ *   -daemon socketfilename    instead of running any job named here, run
+ *                             the jobs that clients send over the Unix
+ *                             domain socket socketfilename, on '-threads'
+ *                             workers, until one sends 'STOP' (see
+ *                             'Daemon'); only the log file name is given,
+ *                             and the log has a summary for each run, so
+ *                             '-log summary' must be given; it cannot be
+ *                             used with the snapshot options, '-fuse no',
+ *                             '-hottrace no', '-prefix', '-batch',
+ *                             '-stream', '-sweep', '-cores', '-slice',
+ *                             '-bintrace', '-cache', or '-emitcpp'
+ *
+ * A manifest has one job to a line, the 'a.out', data, and output file
+ * names, as on the command line, separated by blanks.  Blank lines and
+ * lines that start with '#' are skipped.  Each thread runs its jobs in
+ * an interpreter of its own, each program is read only once however
+ * many jobs run it, a job that runs the same program as the job
+ * before it on its thread starts from a copy of the machine as it
+ * was loaded for that one, and everything is logged to the one log file, job
+ * by job in the order of the manifest.  A job that runs out of data or
+ * is stopped in an infinite loop ends there, and the others go on, but
+ * the exit status is then 1.
+ *
+ * A sweep file is the same, but with only the data and output file
+ * names on each line.  A run that runs out of data stops there, and
+ * the others go on, but the exit status is still 1.
 **/
 
 static const char kTag[] = "MAIN: ";
+static const int kSliceMachines = 256;  // loaded at a time with '-slice'
+static const int kStreamMachines = 64;  // with '-stream', two fds each
+static const int64_t kPrefixLimit = 1000000;  // '-prefix' by default
+static const char kUsage[] =
+    "[-engine switch|threaded|jit] [-fuse yes|no] [-hottrace yes|no] "
+    "[-emitcpp cppfilename] [-log full|async|diff|summary|none] "
+    "[-bintrace tracefilename] [-snapevery count] [-snapms milliseconds] "
+    "[-snapat pc,pc,...] [-threads count] [-cache cachedirectory] "
+    "[-cachemb megabytes] [-prefix count] [-loopcheck count] "
+    "[-slice count] [-cores count] [-coresched interleave|free] "
+    "{adotoutfilename datafilename outfilename | -batch manifestfilename "
+    "| -stream manifestfilename | -sweep sweepfilename adotoutfilename "
+    "| -daemon socketfilename} "
+    "logfilename";
 
-int main(int argc, char *argv[]) {
-  string adotout_filename = "dummyadotoutfilename";
-  string data_filename = "dummydatafilename";
-  string out_filename = "dummyoutname";
-  string log_filename = "dummylogname";
+/****************************************************************
+ * The settings from the options, for whichever 'Interpreter' the
+ * '-log' option picks.
+**/
+struct Options {
+  Engine engine;
+  bool fusion;
+  bool hot_traces;
+  string cpp_filename;
+  string log;
+  string trace_filename;
+  int64_t sample_every;
+  int sample_milliseconds;
+  vector<int> snapshot_pcs;
+  string manifest_filename;
+  string stream_filename;
+  string sweep_filename;
+  string daemon_filename;
+  int threads;
+  string cache_directory;
+  int64_t cache_megabytes;
+  int64_t prefix_limit;
+  int64_t loop_check;
+  int64_t slice;
+  int cores;
+  CoreSchedule core_schedule;
+};
 
-  Scanner adotout_scanner;
-  Scanner data_scanner;
-  ofstream out_stream;
+/****************************************************************
+ * One run of a program: the 'a.out' file name, with its extension,
+ * and the data and output file names.
+**/
+struct Job {
+  string adotout_filename;
+  string data_filename;
+  string out_filename;
+};
 
-  Interpreter interpreter;
+/****************************************************************
+ * The program an interpreter ran last, and the machine as it was
+ * when loaded, for the next job that runs the same program to
+ * start from with 'RestoreSnapshot'.
+**/
+struct WarmProgram {
+  ProgramImage program;
+  std::unique_ptr<MachineSnapshot> snapshot;
+};
 
-  Utils::CheckArgs(4, argc, argv,
-                   "adotoutfilename datafilename outfilename logfilename");
+/****************************************************************
+ * Function 'AdotoutFilename'.
+ * The 'a.out' file name given, with its extension.
+**/
+static string AdotoutFilename(string name) {
 #ifdef BINARY
-  adotout_filename = static_cast<string>(argv[1]) + ".bin";
+  return name + ".bin";
 #else
-  adotout_filename = static_cast<string>(argv[1]) + ".txt";
+  return name + ".txt";
 #endif
-  data_filename = static_cast<string>(argv[2]);
-  out_filename = static_cast<string>(argv[3]);
-  log_filename = static_cast<string>(argv[4]);
+}
 
-  Utils::LogFileOpen(log_filename);
-  adotout_scanner.OpenFile(adotout_filename);
-  data_scanner.OpenFile(data_filename);
-  Utils::FileOpen(out_stream, out_filename);
+/****************************************************************
+ * Function 'ParseAddresses'.
+ * Read the comma-separated addresses of '-snapat' into 'addresses'.
+ *
+ * Returns:
+ *   false if any of them is empty, not all digits, or past memory
+**/
+static bool ParseAddresses(const string& value, vector<int>& addresses) {
+  std::istringstream fields(value + ",");
+  string field;
+  while (std::getline(fields, field, ',')) {
+    if (field.empty() || field.size() > 4
+        || field.find_first_not_of("0123456789") != string::npos
+        || std::atoi(field.c_str()) >= DABnamespace::kMaxMemory) {
+      return false;
+    }
+    addresses.push_back(std::atoi(field.c_str()));
+  }
+  return true;
+}
 
-  Utils::log_stream << kTag << "Beginning execution" << endl;
-  Utils::log_stream << kTag << "adotoutfile   '" << adotout_filename
-                            << "'" << endl;
-  Utils::log_stream << kTag << "datafile '" << data_filename << "'" << endl;
-  Utils::log_stream << kTag << "outfile  '" << out_filename << "'" << endl;
+/****************************************************************
+ * Function 'ParseOptions'.
+ * Read the leading '-name value' options into 'options' and
+ * remove them from the argument list, so that what is left is the
+ * program name followed by the file names.
+**/
+static void ParseOptions(int& argc, char *argv[], Options& options) {
+  bool is_log_given = false;
+  int argsub = 1;
+  while (argsub + 1 < argc && argv[argsub][0] == '-') {
+    string option = static_cast<string>(argv[argsub]);
+    string value = static_cast<string>(argv[argsub + 1]);
+    if (option == "-engine" && value == "switch") {
+      options.engine = kSwitchEngine;
+    } else if (option == "-engine" && value == "threaded") {
+      options.engine = kThreadedEngine;
+    } else if (option == "-engine" && value == "jit") {
+      options.engine = kJitEngine;
+    } else if (option == "-fuse" && (value == "yes" || value == "no")) {
+      options.fusion = value == "yes";
+    } else if (option == "-hottrace" && (value == "yes" || value == "no")) {
+      options.hot_traces = value == "yes";
+    } else if (option == "-emitcpp") {
+      options.cpp_filename = value;
+    } else if (option == "-bintrace") {
+      options.trace_filename = value;
+    } else if (option == "-batch") {
+      options.manifest_filename = value;
+    } else if (option == "-loopcheck"
+               && value.find_first_not_of("0123456789") == string::npos) {
+      options.loop_check = std::atoll(value.c_str());
+    } else if (option == "-prefix"
+               && value.find_first_not_of("0123456789") == string::npos) {
+      options.prefix_limit = std::atoll(value.c_str());
+    } else if (option == "-cache") {
+      options.cache_directory = value;
+    } else if (option == "-cachemb"
+               && value.find_first_not_of("0123456789") == string::npos
+               && std::atoll(value.c_str()) > 0) {
+      options.cache_megabytes = std::atoll(value.c_str());
+    } else if (option == "-slice"
+               && value.find_first_not_of("0123456789") == string::npos
+               && std::atoll(value.c_str()) > 0) {
+      options.slice = std::atoll(value.c_str());
+    } else if (option == "-cores"
+               && value.find_first_not_of("0123456789") == string::npos
+               && std::atoi(value.c_str()) > 0) {
+      options.cores = std::atoi(value.c_str());
+    } else if (option == "-coresched" && value == "interleave") {
+      options.core_schedule = kInterleavedCores;
+    } else if (option == "-coresched" && value == "free") {
+      options.core_schedule = kFreeRunningCores;
+    } else if (option == "-stream") {
+      options.stream_filename = value;
+    } else if (option == "-sweep") {
+      options.sweep_filename = value;
+    } else if (option == "-daemon") {
+      options.daemon_filename = value;
+    } else if (option == "-threads"
+               && value.find_first_not_of("0123456789") == string::npos) {
+      options.threads = std::atoi(value.c_str());
+    } else if (option == "-snapevery"
+               && value.find_first_not_of("0123456789") == string::npos
+               && std::atoll(value.c_str()) > 0) {
+      options.sample_every = std::atoll(value.c_str());
+    } else if (option == "-snapms"
+               && value.find_first_not_of("0123456789") == string::npos
+               && std::atoi(value.c_str()) > 0) {
+      options.sample_milliseconds = std::atoi(value.c_str());
+    } else if (option == "-snapat"
+               && ParseAddresses(value, options.snapshot_pcs)) {
+      // 'ParseAddresses' has added them to 'snapshot_pcs'.
+    } else if (option == "-log"
+               && (value == "full" || value == "async" || value == "diff"
+                   || value == "summary" || value == "none")) {
+      options.log = value;
+      is_log_given = true;
+    } else {
+      cout << kTag << "bad option '" << option << " " << value << "'" << endl;
+      cout << kTag << "usage: " << argv[0] << " " << kUsage << endl;
+      exit(1);
+    }
+    argsub += 2;
+  }
+
+  int removed = argsub - 1;
+  for (int sub = argsub; sub < argc; ++sub) {
+    argv[sub - removed] = argv[sub];
+  }
+  argc -= removed;
+
+  // The snapshot options and '-bintrace' each pick the trace policy
+  // themselves, whatever order the options come in.
+  bool is_sampled = options.sample_every > 0
+                    || options.sample_milliseconds > 0
+                    || !options.snapshot_pcs.empty();
+  if (!options.trace_filename.empty() && (is_log_given || is_sampled)) {
+    cout << kTag << "'-bintrace' cannot be used with '-log', '-snapevery', "
+         << "'-snapms', or '-snapat'" << endl;
+    exit(1);
+  }
+  if (is_sampled && is_log_given) {
+    cout << kTag << "'-snapevery', '-snapms', and '-snapat' cannot be used "
+         << "with '-log'" << endl;
+    exit(1);
+  }
+  if (is_sampled) {
+    options.log = "sampled";
+  }
 
-  interpreter.ReadProgram(adotout_scanner);
-  adotout_scanner.Close();
+  if (!options.manifest_filename.empty()
+      && (!options.cpp_filename.empty() || !options.trace_filename.empty())) {
+    cout << kTag << "'-batch' cannot be used with '-emitcpp' or '-bintrace'"
+         << endl;
+    exit(1);
+  }
+  if (!options.sweep_filename.empty()
+      && (options.log != "summary" || options.engine != kSwitchEngine
+          || !options.fusion || !options.hot_traces || options.threads != 1
+          || !options.manifest_filename.empty() || !options.cpp_filename.empty()
+          || !options.trace_filename.empty())) {
+    cout << kTag << "'-sweep' needs '-log summary', and cannot be used with "
+         << "'-snapevery', '-snapms', '-snapat', '-engine' other than "
+         << "switch, '-fuse no', '-hottrace no', '-threads' other than 1, "
+         << "'-batch', '-emitcpp', or '-bintrace'" << endl;
+    exit(1);
+  }
+  if (!options.cache_directory.empty()
+      && ((options.log != "summary" && options.log != "none")
+          || !options.sweep_filename.empty() || !options.cpp_filename.empty()
+          || !options.trace_filename.empty())) {
+    cout << kTag << "'-cache' needs '-log summary' or '-log none', and "
+         << "cannot be used with '-sweep', '-emitcpp', or '-bintrace'"
+         << endl;
+    exit(1);
+  }
+  if ((options.slice > 0 || !options.stream_filename.empty())
+      && (options.threads != 1 || options.log == "async"
+          || options.engine == kJitEngine
+          || !options.trace_filename.empty()
+          || !options.cache_directory.empty()
+          || !options.cpp_filename.empty()
+          || !options.sweep_filename.empty()
+          || (!options.stream_filename.empty()
+              && !options.manifest_filename.empty()))) {
+    cout << kTag << "'-slice' and '-stream' cannot be used with '-threads' "
+         << "other than 1, '-log async', '-engine jit', '-bintrace', "
+         << "'-cache', '-emitcpp', or '-sweep', nor '-stream' with '-batch'"
+         << endl;
+    exit(1);
+  }
+  if (options.cores > 0
+      && ((options.log != "summary" && options.log != "none")
+          || options.engine != kSwitchEngine || !options.fusion
+          || !options.hot_traces || options.prefix_limit != kPrefixLimit
+          || options.threads != 1 || !options.manifest_filename.empty()
+          || !options.stream_filename.empty()
+          || !options.sweep_filename.empty()
+          || !options.trace_filename.empty()
+          || !options.cache_directory.empty()
+          || !options.cpp_filename.empty())) {
+    cout << kTag << "'-cores' needs '-log summary' or '-log none', and "
+         << "cannot be used with '-snapevery', '-snapms', '-snapat', "
+         << "'-engine' other than switch, '-fuse no', '-hottrace no', "
+         << "'-prefix', '-threads' other than 1, '-batch', '-stream', "
+         << "'-sweep', '-bintrace', '-cache', or '-emitcpp'" << endl;
+    cout << kTag << "usage: " << argv[0] << " " << kUsage << endl;
+    exit(1);
+  }
+  if (!options.daemon_filename.empty()
+      && (options.log != "summary" || !options.fusion
+          || !options.hot_traces || options.prefix_limit != kPrefixLimit
+          || !options.manifest_filename.empty()
+          || !options.stream_filename.empty()
+          || !options.sweep_filename.empty() || options.cores > 0
+          || options.slice > 0 || !options.trace_filename.empty()
+          || !options.cache_directory.empty()
+          || !options.cpp_filename.empty())) {
+    cout << kTag << "'-daemon' needs '-log summary', and cannot be used "
+         << "with '-snapevery', '-snapms', '-snapat', '-fuse no', "
+         << "'-hottrace no', '-prefix', '-batch', '-stream', '-sweep', "
+         << "'-cores', '-slice', '-bintrace', '-cache', or '-emitcpp'"
+         << endl;
+    cout << kTag << "usage: " << argv[0] << " " << kUsage << endl;
+    exit(1);
+  }
+}
+
+/****************************************************************
+ * Function 'ReadManifest'.
+ * Read the jobs in the manifest 'manifest_filename' into 'jobs'.
+ * For a sweep, 'adotout_filename' is the program of every job and
+ * the lines name only the data and output files; otherwise it is
+ * empty.
+**/
+static void ReadManifest(string manifest_filename, string adotout_filename,
+                         vector<Job>& jobs) {
+  Scanner manifest_scanner;
+  manifest_scanner.OpenFile(manifest_filename);
+  int linesub = 0;
+  while (manifest_scanner.HasNext()) {
+    string line = manifest_scanner.NextLine();
+    ++linesub;
+    std::istringstream fields(line);
+    string first;
+    if (!(fields >> first) || first[0] == '#') continue;
+
+    Job job;
+    job.adotout_filename = adotout_filename;
+    job.data_filename = first;
+    if (adotout_filename.empty()) {
+      job.adotout_filename = AdotoutFilename(first);
+      fields >> job.data_filename;
+    }
+    string extra;
+    if (!(fields >> job.out_filename) || (fields >> extra)) {
+      cout << kTag << "bad job on line " << linesub << " of '"
+           << manifest_filename << "'" << endl;
+      exit(1);
+    }
+    jobs.push_back(job);
+  }
+  manifest_scanner.Close();
+}
+
+/****************************************************************
+ * Function 'SetUp'.
+ * Apply the options to an interpreter.
+**/
+template <class Trace>
+static void SetUp(const Options& options, Interpreter<Trace>& interpreter) {
+  interpreter.SetEngine(options.engine);
+  interpreter.SetFusion(options.fusion);
+  interpreter.SetHotTraces(options.hot_traces);
+  interpreter.SetLoopCheck(options.loop_check);
+  interpreter.SetSampling(options.sample_every, options.sample_milliseconds);
+  for (size_t sub = 0; sub < options.snapshot_pcs.size(); ++sub) {
+    interpreter.SetSnapshotAt(options.snapshot_pcs[sub]);
+  }
+}
+
+/****************************************************************
+ * Function 'LoadJob'.
+ * Load 'program' into 'interpreter', from the snapshot in 'warm' if
+ * it is the same program as last time, and dump it.
+**/
+template <class Trace>
+static void LoadJob(const Options& options, const Job& job,
+                    ProgramImage program, WarmProgram& warm,
+                    Interpreter<Trace>& interpreter) {
+  if (program == warm.program) {
+    interpreter.RestoreSnapshot(*warm.snapshot);
+  } else {
+    interpreter.LoadProgram(*program);
+    // The C++ is of the program as it was read, not run into.
+    if (options.cpp_filename.empty()) {
+      interpreter.RunPrefix(options.prefix_limit);
+    }
+    if (!warm.snapshot) {
+      warm.snapshot.reset(new MachineSnapshot());
+    }
+    interpreter.SaveSnapshot(*warm.snapshot);
+    warm.program = program;
+  }
 #ifdef BINARY
   interpreter.ExpandBinaryToASCII();
 #endif
-  interpreter.DumpProgram(out_stream);
-  interpreter.Interpret(data_scanner, out_stream);
+  if (!options.cpp_filename.empty()) {
+    ofstream cpp_stream;
+    Utils::FileOpen(cpp_stream, options.cpp_filename);
+    interpreter.WriteCpp(cpp_stream, job.adotout_filename);
+    Utils::FileClose(cpp_stream);
+    Utils::log_stream << kTag << "cppfile  '" << options.cpp_filename
+                      << "'" << endl;
+  }
+}
 
-  Utils::log_stream << kTag << "Ending execution" << endl;
+/****************************************************************
+ * Function 'LogJob'.
+ * Write the file names of 'job' to the log.
+**/
+static void LogJob(const Job& job) {
+  Utils::log_stream << kTag << "adotoutfile   '" << job.adotout_filename
+                            << "'" << endl;
+  Utils::log_stream << kTag << "datafile '" << job.data_filename << "'"
+                    << endl;
+  Utils::log_stream << kTag << "outfile  '" << job.out_filename << "'"
+                    << endl;
+}
+
+/****************************************************************
+ * Function 'RunSettings'.
+ * The options that the output and log of a run depend on, besides
+ * its program and data: the '-log' option, and the engine, '-prefix',
+ * and '-loopcheck', which change what the summary says.
+**/
+static string RunSettings(const Options& options) {
+  std::ostringstream settings;
+  settings << options.log << " engine " << options.engine << " prefix "
+           << options.prefix_limit << " loopcheck " << options.loop_check;
+  return settings.str();
+}
+
+/****************************************************************
+ * Function 'RunJob'.
+ * Load the program of 'job' into 'interpreter' and run it, logging
+ * to this thread's 'Utils::log_stream'.  If there is a cache of
+ * 'results', a run found there is not done again, and a run that is
+ * done, and finishes, is kept there.
+ *
+ * Returns:
+ *   false if the run did not finish, as when it ran out of data
+**/
+template <class Trace>
+static bool RunJob(const Options& options, const Job& job,
+                   ProgramCache& programs, ResultCache& results,
+                   WarmProgram& warm, Interpreter<Trace>& interpreter) {
+  LogJob(job);
+
+  ProgramImage program = programs.Get(job.adotout_filename);
+  string key = "";
+  string input = "";
+  if (results.IsOpen() && ResultCache::ReadFile(job.data_filename, input)) {
+    key = ResultCache::Key(*program, input, RunSettings(options));
+    string output = "";
+    string log = "";
+    if (results.Find(key, output, log)) {
+      ofstream out_stream;
+      Utils::FileOpen(out_stream, job.out_filename);
+      out_stream << output;
+      Utils::FileClose(out_stream);
+      Utils::log_stream << log;
+      return true;
+    }
+  }
+
+  Scanner data_scanner;
+  data_scanner.OpenFile(job.data_filename);
+  ofstream out_stream;
+  Utils::FileOpen(out_stream, job.out_filename);
+  LoadJob(options, job, program, warm, interpreter);
+
+  // The lines of the run itself go to 'run_log' as well, to be cached.
+  std::stringbuf run_log;
+  RunStatus status = kRunFinished;
+  {
+    std::unique_ptr<LogToBufferGuard> to_run_log;
+    if (!key.empty()) {
+      to_run_log.reset(new LogToBufferGuard(&run_log));
+    }
+    interpreter.DumpProgram(out_stream);
+    status = interpreter.Interpret(data_scanner, out_stream);
+    if (status == kRunWaitingForInput) {
+      interpreter.AbandonRun();  // and there will be no more
+    }
+  }
+
+  data_scanner.Close();
+  Utils::FileClose(out_stream);
+  if (!key.empty()) {
+    Utils::log_stream << run_log.str();
+    string output = "";
+    if (status == kRunFinished
+        && ResultCache::ReadFile(job.out_filename, output)) {
+      results.Store(key, output, run_log.str());
+    }
+  }
+  return status == kRunFinished;
+}
+
+/****************************************************************
+ * Function 'Work'.
+ * One worker thread of 'RunParallel', running jobs from 'queue'
+ * until there are none left.  Each job's log goes to a buffer of
+ * its own, which the queue hands back to be written in order, and
+ * whether it finished goes in 'is_finished'.
+**/
+template <class Trace>
+static void Work(const Options& options, const vector<Job>& jobs,
+                 ProgramCache& programs, ResultCache& results,
+                 JobQueue& queue, vector<char>& is_finished, int worker) {
+  std::unique_ptr<Interpreter<Trace> > interpreter(new Interpreter<Trace>());
+  SetUp(options, *interpreter);
+  WarmProgram warm;
+
+  int job = 0;
+  while (queue.Next(worker, job)) {
+    std::stringbuf log_buffer;
+    {
+      LogToBufferGuard to_log_buffer(&log_buffer);
+      is_finished[job] = RunJob(options, jobs[job], programs, results, warm,
+                                *interpreter);
+    }
+    string log = log_buffer.str();
+    queue.Finish(job, log);
+  }
+}
+
+/****************************************************************
+ * Function 'RunParallel'.
+ * Run the 'jobs' on 'threads' worker threads, and write their logs
+ * to the log in the order of the manifest as they finish.
+ *
+ * Returns:
+ *   false if any of the runs did not finish
+**/
+template <class Trace>
+static bool RunParallel(const Options& options, const vector<Job>& jobs,
+                        ResultCache& results, int threads) {
+  ProgramCache programs;
+  JobQueue queue;
+  queue.Start(static_cast<int>(jobs.size()), threads);
+
+  vector<char> is_finished(jobs.size(), true);
+  vector<std::thread> workers;
+  for (int worker = 0; worker < threads; ++worker) {
+    workers.push_back(std::thread(Work<Trace>, std::cref(options),
+                                  std::cref(jobs), std::ref(programs),
+                                  std::ref(results), std::ref(queue),
+                                  std::ref(is_finished), worker));
+  }
+  string log;
+  for (size_t job = 0; job < jobs.size(); ++job) {
+    queue.WaitFor(static_cast<int>(job), log);
+    Utils::log_stream << log;
+  }
+  for (int worker = 0; worker < threads; ++worker) {
+    workers[worker].join();
+  }
+  return std::find(is_finished.begin(), is_finished.end(), false)
+         == is_finished.end();
+}
+
+/****************************************************************
+ * One job loaded for 'RunSliced', with the files it runs with and
+ * the buffer its log goes to until it is written in order.
+**/
+template <class Trace>
+struct SlicedJob {
+  Interpreter<Trace> interpreter;
+  Scanner data_scanner;
+  ofstream out_stream;
+  std::stringbuf log_buffer;
+};
+
+/****************************************************************
+ * Function 'RunSliced'.
+ * Run the 'jobs' together on this thread with a 'RoundRobin' of up
+ * to 'kSliceMachines' interpreters, loading the next job whenever
+ * one stops, and write their logs to the log in the order of the
+ * manifest as they finish.
+ *
+ * Returns:
+ *   false if any of the runs did not finish
+**/
+template <class Trace>
+static bool RunSliced(const Options& options, const vector<Job>& jobs) {
+  int machines = std::min(kSliceMachines, static_cast<int>(jobs.size()));
+  vector<std::unique_ptr<SlicedJob<Trace> > > loaded(machines);
+  vector<int> free_machines;
+  for (int sub = machines - 1; sub >= 0; --sub) {
+    loaded[sub].reset(new SlicedJob<Trace>());
+    SetUp(options, loaded[sub]->interpreter);
+    free_machines.push_back(sub);
+  }
+
+  RoundRobin<Trace> scheduler;
+  scheduler.SetSlice(options.slice);
+  ProgramCache programs;
+  WarmProgram warm;
+  vector<int> job_on(machines, 0);
+  vector<string> logs(jobs.size());
+  vector<char> is_logged(jobs.size(), false);
+  bool is_finished = true;
+  size_t next_job = 0;
+  size_t next_log = 0;
+  while (next_log < jobs.size()) {
+    while (next_job < jobs.size() && !free_machines.empty()) {
+      int sub = free_machines.back();
+      free_machines.pop_back();
+      SlicedJob<Trace>& sliced = *loaded[sub];
+      const Job& job = jobs[next_job];
+      sliced.log_buffer.str("");
+      {
+        LogToBufferGuard to_log_buffer(&sliced.log_buffer);
+        LogJob(job);
+        sliced.data_scanner.OpenFile(job.data_filename);
+        Utils::FileOpen(sliced.out_stream, job.out_filename);
+        LoadJob(options, job, programs.Get(job.adotout_filename), warm,
+                sliced.interpreter);
+        sliced.interpreter.DumpProgram(sliced.out_stream);
+      }
+
+      typename RoundRobin<Trace>::Machine machine;
+      machine.interpreter = &sliced.interpreter;
+      machine.data_scanner = &sliced.data_scanner;
+      machine.out_stream = &sliced.out_stream;
+      machine.log_buffer = &sliced.log_buffer;
+      machine.id = sub;
+      scheduler.Add(machine);
+      job_on[sub] = static_cast<int>(next_job);
+      ++next_job;
+    }
+
+    typename RoundRobin<Trace>::Machine stopped;
+    if (!scheduler.RunSlice(stopped)) continue;
+    SlicedJob<Trace>& sliced = *loaded[stopped.id];
+    if (stopped.status == kRunWaitingForInput) {
+      LogToBufferGuard to_log_buffer(&sliced.log_buffer);
+      sliced.interpreter.AbandonRun();  // and there will be no more
+    }
+    is_finished = is_finished && stopped.status == kRunFinished;
+    sliced.data_scanner.Close();
+    Utils::FileClose(sliced.out_stream);
+    logs[job_on[stopped.id]] = sliced.log_buffer.str();
+    is_logged[job_on[stopped.id]] = true;
+    free_machines.push_back(stopped.id);
+    while (next_log < jobs.size() && is_logged[next_log]) {
+      Utils::log_stream << logs[next_log];
+      logs[next_log].clear();
+      ++next_log;
+    }
+  }
+  return is_finished;
+}
+
+/****************************************************************
+ * Function 'OpenStream'.
+ * Open 'filename' for an 'EventLoop', as input or as output, without
+ * waiting for the other end if it is a pipe.  An output pipe must
+ * already have a reader.
+**/
+static int OpenStream(string filename, bool is_output) {
+  int fd = is_output
+           ? open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK,
+                  0666)
+           : open(filename.c_str(), O_RDONLY | O_NONBLOCK);
+  if (fd < 0) {
+    std::perror(filename.c_str());
+    exit(1);
+  }
+  return fd;
+}
+
+/****************************************************************
+ * Function 'RunStreams'.
+ * Run the 'jobs' on this thread with an 'EventLoop', each in a
+ * streaming interpreter of its own, in waves of 'kStreamMachines',
+ * so that no more descriptors than that are open at once, and write
+ * the logs of each wave to the log in the order of the manifest as
+ * soon as it is done.
+ *
+ * Returns:
+ *   false if any of the runs did not finish
+**/
+template <class Trace>
+static bool RunStreams(const Options& options, const vector<Job>& jobs) {
+  int machines = std::min(kStreamMachines, static_cast<int>(jobs.size()));
+  vector<std::unique_ptr<Interpreter<Trace> > > interpreters(machines);
+  for (int sub = 0; sub < machines; ++sub) {
+    interpreters[sub].reset(new Interpreter<Trace>());
+    SetUp(options, *interpreters[sub]);
+    interpreters[sub]->SetStreaming(true);
+  }
+  vector<std::stringbuf> logs(machines);
+  ProgramCache programs;
+  WarmProgram warm;
+  ofstream no_out_stream;  // the dump writes only to the log
+
+  bool is_finished = true;
+  for (size_t first = 0; first < jobs.size(); first += machines) {
+    size_t wave = std::min(static_cast<size_t>(machines),
+                           jobs.size() - first);
+    EventLoop<Trace> loop;
+    if (options.slice > 0) {
+      loop.SetSlice(options.slice);
+    }
+    for (size_t sub = 0; sub < wave; ++sub) {
+      const Job& job = jobs[first + sub];
+      logs[sub].str("");
+      {
+        LogToBufferGuard to_log(&logs[sub]);
+        LogJob(job);
+        LoadJob(options, job, programs.Get(job.adotout_filename), warm,
+                *interpreters[sub]);
+        interpreters[sub]->DumpProgram(no_out_stream);
+      }
+      loop.Add(interpreters[sub].get(), OpenStream(job.data_filename, false),
+               OpenStream(job.out_filename, true), &logs[sub]);
+    }
+
+    vector<RunStatus> statuses;
+    loop.Run(statuses);
+    for (size_t sub = 0; sub < wave; ++sub) {
+      Utils::log_stream << logs[sub].str();
+      is_finished = is_finished && statuses[sub] == kRunFinished;
+    }
+  }
+  return is_finished;
+}
+
+/****************************************************************
+ * Function 'Run'.
+ * Run the 'jobs' in order with the trace policy 'Trace', on as
+ * many threads as the options say, or time sliced on the one, with
+ * or without streams, or else all with the one interpreter.
+ *
+ * Returns:
+ *   false if any of the runs did not finish
+**/
+template <class Trace>
+static bool Run(const Options& options, const vector<Job>& jobs) {
+  if (!options.stream_filename.empty()) {
+    return RunStreams<Trace>(options, jobs);
+  }
+  if (options.slice > 0) {
+    return RunSliced<Trace>(options, jobs);
+  }
+  int threads = options.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, static_cast<int>(jobs.size()));
+  ResultCache results;
+  if (!options.cache_directory.empty()) {
+    results.Open(options.cache_directory,
+                 options.cache_megabytes * 1024 * 1024);
+  }
+  if (threads > 1) {
+    return RunParallel<Trace>(options, jobs, results, threads);
+  }
+
+  Interpreter<Trace> interpreter;
+  SetUp(options, interpreter);
+  ofstream trace_stream;
+  if (!options.trace_filename.empty()) {
+    Utils::FileOpen(trace_stream, options.trace_filename);
+    interpreter.SetTraceStream(trace_stream);
+  }
+
+  ProgramCache programs;
+  WarmProgram warm;
+  bool is_finished = true;
+  for (size_t job = 0; job < jobs.size(); ++job) {
+    is_finished = RunJob(options, jobs[job], programs, results, warm,
+                         interpreter) && is_finished;
+  }
+  if (!options.trace_filename.empty()) {
+    Utils::FileClose(trace_stream);
+  }
+  return is_finished;
+}
 
+/****************************************************************
+ * Function 'RunSweep'.
+ * Run the program of the 'jobs', which is the same for all, on
+ * all their data files with an 'InputSweep', 'kLanes' at a time.
+ *
+ * Returns:
+ *   false if any of the runs ran out of data or was in a loop
+**/
+static bool RunSweep(const Options& options, const vector<Job>& jobs) {
+  if (jobs.empty()) return true;
+  Utils::log_stream << kTag << "adotoutfile   '" << jobs[0].adotout_filename
+                            << "'" << endl;
+  ProgramCache programs;
+  ProgramImage program = programs.Get(jobs[0].adotout_filename);
+
+  std::unique_ptr<InputSweep> sweep(new InputSweep());
+  sweep->SetLoopCheck(options.loop_check);
+  bool is_finished = true;
+  for (size_t first = 0; first < jobs.size(); first += InputSweep::kLanes) {
+    size_t count = std::min(jobs.size() - first,
+                            static_cast<size_t>(InputSweep::kLanes));
+    vector<vector<int> > inputs(count);
+    ofstream out_files[InputSweep::kLanes];
+    vector<std::ostream*> out_streams;
+    for (size_t lane = 0; lane < count; ++lane) {
+      Scanner data_scanner;
+      data_scanner.OpenFile(jobs[first + lane].data_filename);
+      DABnamespace::ReadValues(data_scanner, inputs[lane]);
+      data_scanner.Close();
+      Utils::FileOpen(out_files[lane], jobs[first + lane].out_filename);
+      out_streams.push_back(&out_files[lane]);
+    }
+
+    vector<InputSweep::LaneResult> results;
+    sweep->Run(*program, inputs, out_streams, results);
+
+    for (size_t lane = 0; lane < count; ++lane) {
+      Utils::FileClose(out_files[lane]);
+      const InputSweep::LaneResult& result = results[lane];
+      Utils::log_stream << kTag << "datafile '"
+                        << jobs[first + lane].data_filename << "'" << endl;
+      Utils::log_stream << kTag << "outfile  '"
+                        << jobs[first + lane].out_filename << "'" << endl;
+      Utils::log_stream << "SUMMARY: "
+                        << DABnamespace::Summary(result.executed_count,
+                                                 result.pc, result.accum);
+      if (result.is_out_of_data) {
+        Utils::log_stream << ", ran out of data";
+        is_finished = false;
+      }
+      if (result.is_looping) {
+        Utils::log_stream << ", stopped in an infinite loop";
+        is_finished = false;
+      }
+      Utils::log_stream << endl;
+    }
+  }
+  return is_finished;
+}
+
+/****************************************************************
+ * Function 'RunCores'.
+ * Run the program of 'job' on the cores the options say with a
+ * 'Multiprocessor', and log a summary of each core unless '-log none'
+ * is given.
+ *
+ * Returns:
+ *   false if any of the cores ran out of data or was stopped in a loop
+**/
+static bool RunCores(const Options& options, const Job& job) {
+  LogJob(job);
+  ProgramCache programs;
+  ProgramImage program = programs.Get(job.adotout_filename);
+  Scanner data_scanner;
+  data_scanner.OpenFile(job.data_filename);
+  vector<int> input;
+  DABnamespace::ReadValues(data_scanner, input);
+  data_scanner.Close();
+  ofstream out_stream;
+  Utils::FileOpen(out_stream, job.out_filename);
+
+  std::unique_ptr<Multiprocessor> cores(new Multiprocessor());
+  cores->SetLoopCheck(options.loop_check);
+  if (options.slice > 0) {
+    cores->SetQuantum(options.slice);
+  }
+  vector<Multiprocessor::CoreResult> results;
+  cores->Run(*program, options.cores, options.core_schedule, input,
+             out_stream, results);
   Utils::FileClose(out_stream);
+
+  bool is_finished = true;
+  std::ostringstream summary;
+  for (size_t core = 0; core < results.size(); ++core) {
+    const Multiprocessor::CoreResult& result = results[core];
+    summary << "SUMMARY: core " << core << ", "
+            << DABnamespace::Summary(result.executed_count, result.pc,
+                                     result.accum);
+    if (result.is_out_of_data) {
+      summary << ", ran out of data";
+      is_finished = false;
+    }
+    if (result.is_looping) {
+      summary << ", stopped in an infinite loop";
+      is_finished = false;
+    }
+    summary << endl;
+  }
+  if (options.log == "summary") {
+    Utils::log_stream << summary.str();
+  }
+  return is_finished;
+}
+
+/****************************************************************
+ * Function 'RunDaemon'.
+ * Run the jobs clients send to the socket the options name with a
+ * 'Daemon', until one of them tells it to stop.
+ *
+ * Returns:
+ *   false if the socket could not be made
+**/
+static bool RunDaemon(const Options& options) {
+  int threads = options.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::unique_ptr<Daemon> daemon(new Daemon());
+  daemon->SetEngine(options.engine);
+  daemon->SetLoopCheck(options.loop_check);
+  return daemon->Run(options.daemon_filename, threads);
+}
+
+int main(int argc, char *argv[]) {
+  string log_filename = "dummylogname";
+
+  Options options;
+  options.engine = kSwitchEngine;
+  options.fusion = true;
+  options.hot_traces = true;
+  options.log = "full";
+  options.sample_every = 0;
+  options.sample_milliseconds = 0;
+  options.threads = 1;
+  options.cache_megabytes = 64;
+  options.prefix_limit = kPrefixLimit;
+  options.loop_check = 16;
+  options.slice = 0;
+  options.cores = 0;
+  options.core_schedule = kInterleavedCores;
+
+  ParseOptions(argc, argv, options);
+  vector<Job> jobs;
+  if (!options.sweep_filename.empty()) {
+    Utils::CheckArgs(2, argc, argv, kUsage);
+    ReadManifest(options.sweep_filename,
+                 AdotoutFilename(static_cast<string>(argv[1])), jobs);
+    log_filename = static_cast<string>(argv[2]);
+  } else if (!options.stream_filename.empty()) {
+    Utils::CheckArgs(1, argc, argv, kUsage);
+    ReadManifest(options.stream_filename, "", jobs);
+    log_filename = static_cast<string>(argv[1]);
+  } else if (!options.daemon_filename.empty()) {
+    Utils::CheckArgs(1, argc, argv, kUsage);
+    log_filename = static_cast<string>(argv[1]);
+  } else if (options.manifest_filename.empty()) {
+    Utils::CheckArgs(4, argc, argv, kUsage);
+    Job job;
+    job.adotout_filename = AdotoutFilename(static_cast<string>(argv[1]));
+    job.data_filename = static_cast<string>(argv[2]);
+    job.out_filename = static_cast<string>(argv[3]);
+    jobs.push_back(job);
+    log_filename = static_cast<string>(argv[4]);
+  } else {
+    Utils::CheckArgs(1, argc, argv, kUsage);
+    ReadManifest(options.manifest_filename, "", jobs);
+    log_filename = static_cast<string>(argv[1]);
+  }
+
+  Utils::LogFileOpen(log_filename);
+  Utils::log_stream << kTag << "Beginning execution" << endl;
+
+  int status = 0;
+  if (!options.daemon_filename.empty()) {
+    status = RunDaemon(options) ? 0 : 1;
+  } else if (!options.sweep_filename.empty()) {
+    status = RunSweep(options, jobs) ? 0 : 1;
+  } else if (options.cores > 0) {
+    status = RunCores(options, jobs[0]) ? 0 : 1;
+  } else if (!options.trace_filename.empty()) {
+    status = Run<BinaryTrace>(options, jobs) ? 0 : 1;
+  } else if (options.log == "sampled") {
+    status = Run<SampledTrace>(options, jobs) ? 0 : 1;
+  } else if (options.log == "none") {
+    status = Run<NoTrace>(options, jobs) ? 0 : 1;
+  } else if (options.log == "async") {
+    status = Run<AsyncFullTrace>(options, jobs) ? 0 : 1;
+  } else if (options.log == "diff") {
+    status = Run<DiffTrace>(options, jobs) ? 0 : 1;
+  } else if (options.log == "summary") {
+    status = Run<SummaryTrace>(options, jobs) ? 0 : 1;
+  } else {
+    status = Run<FullTrace>(options, jobs) ? 0 : 1;
+  }
+
+  Utils::log_stream << kTag << "Ending execution" << endl;
+
   Utils::FileClose(Utils::log_stream);
 
-  return 0;
+  return status;
 }
@@ -8,19 +8,37 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using std::cin;
 using std::cout;
 using std::endl;
 using std::ofstream;
 using std::string;
+using std::vector;
 
 #include "./Utilities/utils.h"
 #include "./Utilities/scanner.h"
 #include "./Utilities/scanline.h"
 
+#include "daemon.h"
+#include "eventloop.h"
+#include "inputsweep.h"
+#include "jobqueue.h"
+#include "multiprocessor.h"
+#include "programcache.h"
 #include "pullet16interpreter.h"
+#include "resultcache.h"
+#include "scheduler.h"
 
 #endif  // MAIN_H
@@ -0,0 +1,398 @@
+#include "multiprocessor.h"
+
+#include <algorithm>
+#include <thread>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'Multiprocessor' for running several cores on one memory.
+ *
+ * Each core has its own PC and accumulator; memory, the input, and the
+ * output are shared.  Every core starts at PC 0 with its own number in
+ * the accumulator, which is how a program tells the cores apart; with
+ * one core a program runs as 'Interpreter' runs it.  An 'RD' takes the
+ * next value of the one input, whichever core does it, and a 'WRT' writes
+ * a whole line of the one output.
+ *
+ * Memory is words of 'std::atomic<uint16_t>', loaded with acquire and
+ * stored with release, so an 'STC' of one core is seen whole by the
+ * others, and everything a core stored before a flag word is seen by a
+ * core that sees the flag.  Each word is decoded as it is fetched, so a
+ * core can run code that another has just stored.
+ *
+ * With 'kInterleavedCores' the cores take turns on the one thread, each
+ * running 'quantum_' instructions in turn, in the order of their numbers,
+ * so a run is the same every time.  With 'kFreeRunningCores' each core
+ * runs on a host thread of its own, as fast as it can, and the order in
+ * which they see each other's stores is whatever the host gives.
+ *
+ * A core that reads past the end of the input stops, with
+ * 'is_out_of_data' set, and the others go on.  Interleaved cores are
+ * looked at for infinite loops.  While two or more are running,
+ * 'CheckRound' looks between rounds at the whole machine, every core's
+ * PC, accumulator, and whether it runs, memory, and how much of the input
+ * has been read; since the turns are always taken in the same order, if
+ * that is as it was at an earlier round the rounds go on for ever, and
+ * every core still running is stopped with 'is_looping' set.  Once only
+ * one is left, 'CheckLoop' looks at it as 'Interpreter::CheckLoop' does.
+ * Free-running cores are not looked at.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+Multiprocessor::Multiprocessor()
+    : memory_size_(0), quantum_(kDefaultQuantum), checked_core_(nullptr),
+      loop_check_every_(0), loop_countdown_(0), loop_power_(1),
+      loop_length_(0), is_hashing_(false), memory_hash_(0), saved_pc_(-1),
+      saved_accum_(0), saved_hash_(0), saved_next_input_(0), input_(nullptr),
+      next_input_(0), out_stream_(nullptr) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+Multiprocessor::~Multiprocessor() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Mutator for 'loop_check_every_', how many branches back there are to
+ * each look for an infinite loop, or 0 for never.
+**/
+void Multiprocessor::SetLoopCheck(int64_t every) {
+  loop_check_every_ = every;
+}
+
+/***************************************************************************
+ * Mutator for 'quantum_', how many instructions a core runs in its turn
+ * when they are interleaved.
+**/
+void Multiprocessor::SetQuantum(int64_t quantum) {
+  quantum_ = quantum;
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'CheckLoop'.
+ * Called after a branch back of the one core left, this stops it if it
+ * is in an infinite loop, as 'Interpreter::CheckLoop' does.
+**/
+void Multiprocessor::CheckLoop(Core& core) {
+  if (--loop_countdown_ > 0) return;
+  loop_countdown_ = loop_check_every_;
+
+  ++loop_length_;
+  if (core.pc == saved_pc_ && core.accum == saved_accum_
+      && memory_hash_ == saved_hash_ && IsSavedMemory()) {
+    core.is_live = false;
+    core.is_looping = true;
+    return;
+  }
+  if (loop_length_ == loop_power_) {
+    saved_pc_ = core.pc;
+    saved_accum_ = core.accum;
+    SaveMemory();
+    loop_power_ *= 2;
+    loop_length_ = 0;
+  }
+}
+
+/***************************************************************************
+ * Function 'CheckRound'.
+ * Called after each round of the interleaved cores while two or more are
+ * running, this stops every core still running if the whole machine is
+ * as it was after an earlier round, with the same saves at powers of two
+ * as 'CheckLoop'.
+**/
+void Multiprocessor::CheckRound(vector<Core>& cores) {
+  if (--loop_countdown_ > 0) return;
+  loop_countdown_ = loop_check_every_;
+
+  ++loop_length_;
+  size_t next_input = next_input_.load(std::memory_order_relaxed);
+  bool is_same = saved_cores_.size() == cores.size()
+                 && next_input == saved_next_input_
+                 && memory_hash_ == saved_hash_;
+  for (size_t sub = 0; is_same && sub < cores.size(); ++sub) {
+    is_same = cores[sub].pc == saved_cores_[sub].pc
+              && cores[sub].accum == saved_cores_[sub].accum
+              && cores[sub].is_live == saved_cores_[sub].is_live;
+  }
+  if (is_same && IsSavedMemory()) {
+    for (size_t sub = 0; sub < cores.size(); ++sub) {
+      if (cores[sub].is_live) {
+        cores[sub].is_live = false;
+        cores[sub].is_looping = true;
+      }
+    }
+    return;
+  }
+  if (loop_length_ == loop_power_) {
+    saved_cores_ = cores;
+    saved_next_input_ = next_input;
+    SaveMemory();
+    loop_power_ *= 2;
+    loop_length_ = 0;
+  }
+}
+
+/***************************************************************************
+ * Function 'IsSavedMemory'.
+ * Is memory word for word what 'SaveMemory' last saved?
+**/
+bool Multiprocessor::IsSavedMemory() const {
+  for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+    if (memory_[address].load(std::memory_order_relaxed)
+        != saved_memory_[address]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/***************************************************************************
+ * Function 'ResetLoopCheck'.
+ * Start 'CheckLoop' or 'CheckRound' over, after an 'RD' or when the
+ * cores left are down to one.
+**/
+void Multiprocessor::ResetLoopCheck() {
+  loop_countdown_ = loop_check_every_;
+  loop_power_ = 1;
+  loop_length_ = 0;
+  saved_pc_ = -1;
+  saved_cores_.clear();
+}
+
+/***************************************************************************
+ * Function 'Run'.
+ * Run 'image' on 'core_count' cores until all of them stop.
+ *
+ * Parameters:
+ *   image - the program, as from 'Interpreter::ReadImage'
+ *   core_count - how many cores
+ *   schedule - how the cores share the host
+ *   input - the values the 'RD's of all the cores read, in order
+ *   out_stream - where the 'WRT's of all the cores write
+ *   results - set to how each core's run ended
+**/
+void Multiprocessor::Run(const vector<uint16_t>& image, int core_count,
+                         CoreSchedule schedule, const vector<int>& input,
+                         std::ostream& out_stream,
+                         vector<CoreResult>& results) {
+  memory_size_ = static_cast<int>(image.size());
+  for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+    memory_[address].store((address < memory_size_) ? image[address] : 0,
+                           std::memory_order_relaxed);
+  }
+  input_ = &input;
+  next_input_.store(0);
+  out_stream_ = &out_stream;
+
+  vector<Core> cores(core_count);
+  for (int sub = 0; sub < core_count; ++sub) {
+    cores[sub].pc = 0;
+    cores[sub].accum = sub;
+    cores[sub].executed_count = 0;
+    cores[sub].is_live = memory_size_ > 0;
+    cores[sub].is_out_of_data = false;
+    cores[sub].is_looping = false;
+  }
+  checked_core_ = nullptr;
+  is_hashing_ = false;
+
+  if (schedule == kFreeRunningCores) {
+    vector<std::thread> threads;
+    for (int sub = 0; sub < core_count; ++sub) {
+      threads.push_back(std::thread(&Multiprocessor::RunCore, this,
+                                    &cores[sub]));
+    }
+    for (int sub = 0; sub < core_count; ++sub) {
+      threads[sub].join();
+    }
+  } else {
+    int live_count = (memory_size_ > 0) ? core_count : 0;
+    if (live_count > 1 && loop_check_every_ > 0) {
+      StartHash();
+    }
+    while (live_count > 0) {
+      live_count = 0;
+      Core* live_core = nullptr;
+      for (int sub = 0; sub < core_count; ++sub) {
+        Core& core = cores[sub];
+        for (int64_t count = 0; count < quantum_ && core.is_live; ++count) {
+          Step(core);
+        }
+        if (core.is_live) {
+          ++live_count;
+          live_core = &core;
+        }
+      }
+      if (live_count > 1 && is_hashing_) {
+        CheckRound(cores);
+      } else if (live_count == 1 && checked_core_ == nullptr
+                 && loop_check_every_ > 0) {
+        StartLoopCheck(live_core);
+      }
+    }
+  }
+
+  results.resize(core_count);
+  for (int sub = 0; sub < core_count; ++sub) {
+    results[sub].executed_count = cores[sub].executed_count;
+    results[sub].pc = cores[sub].pc;
+    results[sub].accum = cores[sub].accum;
+    results[sub].is_out_of_data = cores[sub].is_out_of_data;
+    results[sub].is_looping = cores[sub].is_looping;
+  }
+}
+
+/***************************************************************************
+ * Function 'RunCore'.
+ * Run one core to the end by itself, on a host thread of its own.  Its
+ * registers are kept in a local copy, not next to the other cores'.
+**/
+void Multiprocessor::RunCore(Core* core) {
+  Core local = *core;
+  while (local.is_live) {
+    Step(local);
+  }
+  *core = local;
+}
+
+/***************************************************************************
+ * Function 'SaveMemory'.
+ * Save memory and its hash, for 'IsSavedMemory' to compare with later.
+**/
+void Multiprocessor::SaveMemory() {
+  saved_hash_ = memory_hash_;
+  for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+    saved_memory_[address] = memory_[address].load(std::memory_order_relaxed);
+  }
+}
+
+/***************************************************************************
+ * Function 'StartHash'.
+ * Hash all of memory, and have 'Step' keep the hash up to date from here
+ * for 'CheckLoop' and 'CheckRound'.
+**/
+void Multiprocessor::StartHash() {
+  is_hashing_ = true;
+  memory_hash_ = 0;
+  for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+    memory_hash_ += DABnamespace::HashWord(
+        address, memory_[address].load(std::memory_order_relaxed));
+  }
+  saved_memory_.resize(DABnamespace::kMaxMemory);
+  ResetLoopCheck();
+}
+
+/***************************************************************************
+ * Function 'StartLoopCheck'.
+ * Have 'CheckLoop' look at 'core', the one left, from now on.
+**/
+void Multiprocessor::StartLoopCheck(Core* core) {
+  checked_core_ = core;
+  if (is_hashing_) {
+    ResetLoopCheck();
+  } else {
+    StartHash();
+  }
+}
+
+/***************************************************************************
+ * Function 'Step'.
+ * Execute one instruction for one core, as 'Interpreter' does.
+**/
+void Multiprocessor::Step(Core& core) {
+  uint16_t word = memory_[core.pc].load(std::memory_order_acquire);
+  DecodedInstruction inst = DABnamespace::DecodeWord(word, core.pc);
+  int location = inst.operand;
+  if (inst.indirect) {
+    location = memory_[location].load(std::memory_order_acquire) & 0xFFF;
+  }
+  int value = 0;
+  switch (inst.opcode) {
+    case DABnamespace::kBAN:
+      if (core.accum < 0) {
+        bool is_back = location < core.pc;
+        core.pc = location;
+        if (is_back && &core == checked_core_) {
+          CheckLoop(core);
+        }
+      }
+      break;
+    case DABnamespace::kSUB:
+      value = memory_[location].load(std::memory_order_acquire);
+      core.accum -= value & 0xFFF;
+      break;
+    case DABnamespace::kSTC:
+      if (is_hashing_) {
+        memory_hash_ +=
+            DABnamespace::HashWord(location,
+                                   static_cast<uint16_t>(core.accum))
+            - DABnamespace::HashWord(
+                location, memory_[location].load(std::memory_order_relaxed));
+      }
+      memory_[location].store(static_cast<uint16_t>(core.accum),
+                              std::memory_order_release);
+      core.accum = 0;
+      break;
+    case DABnamespace::kAND:
+      core.accum &= memory_[location].load(std::memory_order_acquire);
+      break;
+    case DABnamespace::kADD:
+      value = memory_[location].load(std::memory_order_acquire);
+      core.accum = DABnamespace::TwosComplement(core.accum)
+                   + DABnamespace::TwosComplement(value);
+      break;
+    case DABnamespace::kLD:
+      value = memory_[location].load(std::memory_order_acquire);
+      core.accum = value & 0xFFF;
+      break;
+    case DABnamespace::kBR: {
+      bool is_back = location < core.pc;
+      core.pc = location;
+      if (is_back && &core == checked_core_) {
+        CheckLoop(core);
+      }
+      break;
+    }
+    case DABnamespace::kSTP:
+      core.pc = DABnamespace::kPCForStop;
+      break;
+    case DABnamespace::kRD: {
+      size_t next = next_input_.fetch_add(1);
+      if (next >= input_->size()) {
+        // Stopped at the 'RD', which is not counted, as 'Interpreter' does.
+        core.is_live = false;
+        core.is_out_of_data = true;
+        return;
+      }
+      core.accum = (*input_)[next];
+      if (&core == checked_core_) {
+        ResetLoopCheck();
+      }
+      break;
+    }
+    case DABnamespace::kWRT: {
+      int accum = core.accum;
+      std::lock_guard<std::mutex> guard(out_lock_);
+      *out_stream_ << DABnamespace::OutputLine(accum) << '\n';
+      break;
+    }
+    default:
+      break;
+  }
+
+  ++core.executed_count;
+  if (++core.pc >= memory_size_) {
+    core.is_live = false;
+  }
+}
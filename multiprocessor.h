@@ -0,0 +1,105 @@
+/****************************************************************
+ * Header file for the 'Multiprocessor' class that runs several
+ * Pullet16 cores over the one memory.
+**/
+
+#ifndef MULTIPROCESSOR_H
+#define MULTIPROCESSOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::cin;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "dabnamespace.h"
+
+using DABnamespace::DecodedInstruction;
+
+// How 'Multiprocessor' shares the host among its cores.
+enum CoreSchedule { kInterleavedCores, kFreeRunningCores };
+
+class Multiprocessor {
+ public:
+  /****************************************************************
+   * How one core's run ended.
+  **/
+  struct CoreResult {
+    int64_t executed_count;
+    int pc;
+    int accum;
+    bool is_out_of_data;
+    bool is_looping;  // stopped in an infinite loop
+  };
+
+  Multiprocessor();
+  virtual ~Multiprocessor();
+
+  void SetLoopCheck(int64_t every);
+  void SetQuantum(int64_t quantum);
+
+  void Run(const vector<uint16_t>& image, int core_count,
+           CoreSchedule schedule, const vector<int>& input,
+           std::ostream& out_stream, vector<CoreResult>& results);
+
+ private:
+  static const int64_t kDefaultQuantum = 1;
+
+  /****************************************************************
+   * The registers of one core, and whether it is still running.
+  **/
+  struct Core {
+    int pc;
+    int accum;
+    int64_t executed_count;
+    bool is_live;
+    bool is_out_of_data;
+    bool is_looping;
+  };
+
+  int memory_size_;
+  int64_t quantum_;
+  std::atomic<uint16_t> memory_[DABnamespace::kMaxMemory];
+
+  // For 'CheckLoop', what 'Interpreter' keeps for its one machine, for
+  // the one core that is left once the others have stopped, and for
+  // 'CheckRound' the whole machine after a round of two or more.
+  Core* checked_core_;
+  int64_t loop_check_every_;
+  int64_t loop_countdown_;
+  int64_t loop_power_;
+  int64_t loop_length_;
+  bool is_hashing_;  // whether 'memory_hash_' is kept up to date
+  uint64_t memory_hash_;
+  int saved_pc_;
+  int saved_accum_;
+  uint64_t saved_hash_;
+  vector<Core> saved_cores_;
+  size_t saved_next_input_;
+  vector<uint16_t> saved_memory_;
+
+  const vector<int>* input_;
+  std::atomic<size_t> next_input_;
+  std::ostream* out_stream_;
+  std::mutex out_lock_;
+
+  void CheckLoop(Core& core);
+  void CheckRound(vector<Core>& cores);
+  bool IsSavedMemory() const;
+  void ResetLoopCheck();
+  void RunCore(Core* core);
+  void SaveMemory();
+  void StartHash();
+  void StartLoopCheck(Core* core);
+  void Step(Core& core);
+};
+#endif
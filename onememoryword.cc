@@ -12,25 +12,30 @@
  * what one is extracting from the 16 bit pattern that is a memory word,
  * and to format the bits for printing as 3 + 1 + 12 for opcode, indirect,
  * and address.
+ *
+ * The word itself is held as a 'uint16_t', so an instance is only a thin
+ * two-byte view of one entry of the interpreter's memory image.  The
+ * extraction functions are shifts and masks; strings of '0' and '1' are
+ * only built when a word is formatted for printing.
 **/
 
 /***************************************************************************
  * Constructor
 **/
-OneMemoryWord::OneMemoryWord() {
+OneMemoryWord::OneMemoryWord() : bit_pattern_(0) {
 }
 
 /***************************************************************************
  * Constructor
 **/
-OneMemoryWord::OneMemoryWord(string thestring) {
-  Initialize(thestring);
+OneMemoryWord::OneMemoryWord(uint16_t the_word) : bit_pattern_(the_word) {
 }
 
 /***************************************************************************
- * Destructor
+ * Constructor
 **/
-OneMemoryWord::~OneMemoryWord() {
+OneMemoryWord::OneMemoryWord(string thestring) : bit_pattern_(0) {
+  Initialize(thestring);
 }
 
 /***************************************************************************
@@ -38,37 +43,37 @@ OneMemoryWord::~OneMemoryWord() {
 **/
 
 /***************************************************************************
- * Accessor for the 'address_bits_'.
+ * Accessor for the 'address_bits_', the low twelve bits.
 **/
-string OneMemoryWord::GetAddressBits() const {
-  return bit_pattern_.substr(4);
+int OneMemoryWord::GetAddressBits() const {
+  return bit_pattern_ & 0x0FFF;
 }
 
 /***************************************************************************
  * Accessor for the 'bit_pattern_'.
 **/
-string OneMemoryWord::GetBitPattern() const {
+uint16_t OneMemoryWord::GetBitPattern() const {
   return bit_pattern_;
 }
 
 /***************************************************************************
- * Accessor for the 'indirect_flag_'.
+ * Accessor for the 'indirect_flag_', bit 12.
 **/
-string OneMemoryWord::GetIndirectFlag() const {
-  return bit_pattern_.substr(3, 1);
+int OneMemoryWord::GetIndirectFlag() const {
+  return (bit_pattern_ >> 12) & 0x1;
 }
 
 /***************************************************************************
- * Accessor for the 'mnemonic_bits_'.
+ * Accessor for the 'mnemonic_bits_', the high three bits.
 **/
-string OneMemoryWord::GetMnemonicBits() const {
-  return bit_pattern_.substr(0, 3);
+int OneMemoryWord::GetMnemonicBits() const {
+  return (bit_pattern_ >> 13) & 0x7;
 }
 
 /***************************************************************************
  * Mutator for the 'bit_pattern_'.
 **/
-void OneMemoryWord::SetBitPattern(string what) {
+void OneMemoryWord::SetBitPattern(uint16_t what) {
   bit_pattern_ = what;
 }
 
@@ -78,10 +83,11 @@ void OneMemoryWord::SetBitPattern(string what) {
 
 /***************************************************************************
  * Function 'Initialize'.
+ * Convert the ASCII bit string as read from the 'a.out' file.
 **/
 void OneMemoryWord::Initialize(string bit_pattern) {
-
-  bit_pattern_ = bit_pattern;
+  bit_pattern_ = static_cast<uint16_t>(
+                   DABnamespace::BitStringToDec(bit_pattern));
 }
 
 /***************************************************************************
@@ -99,9 +105,9 @@ string OneMemoryWord::ToString() const {
 #ifdef EBUG
   Utils::log_stream << "enter ToString" << endl;
 #endif
+  string bits = DABnamespace::DecToBitString(bit_pattern_, 16);
   string sss = "";
-  sss += this->GetMnemonicBits() + " " + this->GetIndirectFlag() + " " +
-         this->GetAddressBits();
+  sss += bits.substr(0, 3) + " " + bits.substr(3, 1) + " " + bits.substr(4);
 
 #ifdef EBUG
   Utils::log_stream << "leave ToString" << endl;
@@ -10,6 +10,7 @@
 #ifndef CODELINE_H
 #define CODELINE_H
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 
@@ -27,19 +28,19 @@ using std::string;
 class OneMemoryWord {
  public:
   OneMemoryWord();
-  OneMemoryWord(string thestring);
-  virtual ~OneMemoryWord();
+  explicit OneMemoryWord(uint16_t the_word);
+  explicit OneMemoryWord(string thestring);
 
-  string GetAddressBits() const;
-  string GetBitPattern() const;
-  string GetIndirectFlag() const;
-  string GetMnemonicBits() const;
+  int GetAddressBits() const;
+  uint16_t GetBitPattern() const;
+  int GetIndirectFlag() const;
+  int GetMnemonicBits() const;
 
-  void SetBitPattern(string what);
+  void SetBitPattern(uint16_t what);
   string ToString() const;
 
  private:
-  string bit_pattern_;
+  uint16_t bit_pattern_;
 
   void Initialize(string thestring);
 };
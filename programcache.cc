@@ -0,0 +1,72 @@
+#include "programcache.h"
+
+#include <cstdlib>
+
+#include "pullet16interpreter.h"
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'ProgramCache' for the programs of a batch.
+ *
+ * Programs are kept by file name as the image that 'ReadImage' reads,
+ * which is the same whatever the trace policy.  The file is read with the
+ * lock let go, so threads reading different programs do not wait for each
+ * other; two threads that both miss on the same program both read it, and
+ * the first one in is kept.
+ *
+ * Images are shared, so emptying the cache when it is full does not take
+ * one away from a job that is still loading it.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+ProgramCache::ProgramCache() {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+ProgramCache::~ProgramCache() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Get'.
+ * Return the program in 'adotout_filename', reading it if it is not
+ * already here.
+**/
+ProgramImage ProgramCache::Get(string adotout_filename) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    std::map<string, ProgramImage>::iterator program =
+      programs_.find(adotout_filename);
+    if (program != programs_.end()) {
+      return program->second;
+    }
+  }
+
+  Scanner adotout_scanner;
+  adotout_scanner.OpenFile(adotout_filename);
+  vector<uint16_t>* image = new vector<uint16_t>();
+  ProgramImage read_image(image);
+  bool is_whole = Interpreter<NoTrace>::ReadImage(adotout_scanner, *image);
+  adotout_scanner.Close();
+  if (!is_whole) {
+    exit(1);
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (programs_.size() >= kMaxPrograms) {
+    programs_.clear();
+  }
+  return programs_.insert(std::make_pair(adotout_filename, read_image))
+           .first->second;
+}
@@ -0,0 +1,35 @@
+/****************************************************************
+ * Header file for the 'ProgramCache' class that keeps the programs
+ * of a batch once they are read, for any number of jobs and
+ * threads to load.
+**/
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+typedef std::shared_ptr<const vector<uint16_t> > ProgramImage;
+
+class ProgramCache {
+ public:
+  ProgramCache();
+  virtual ~ProgramCache();
+
+  ProgramImage Get(string adotout_filename);
+
+ private:
+  static const size_t kMaxPrograms = 4096;  // kept before emptying
+
+  std::mutex lock_;
+  std::map<string, ProgramImage> programs_;
+};
+#endif
@@ -23,28 +23,384 @@
  *   for whether a target address is in fact out of bounds and also does
  *   the indirect lookup, so the code to interpret an instruction never
  *   needs to know whether the address is indirect or not.
+ *
+ *   Memory is a fixed image of 'kMaxMemory' 16 bit words held inside the
+ *   instance (8 KB), of which the first 'memory_size_' words were loaded
+ *   by 'ReadProgram'.  Words are only turned into strings of bits when the
+ *   machine is printed to the log.
+ *
+ *   'ReadProgram' also decodes every loaded word into 'decoded_', which
+ *   is only as long as the program, and 'DoSTC' re-decodes any word it
+ *   overwrites, so 'Interpret' executes from the decoded stream and never
+ *   extracts bits from a word itself.
+ *   Common runs of two or three instructions are then fused into single
+ *   superinstructions (see 'DABnamespace::FuseInstructions'); the words
+ *   after the head of a run keep their own decoding, so a branch into the
+ *   middle of a run still works.
+ *
+ *   A loaded machine can be kept with 'SaveSnapshot' and put back with
+ *   'RestoreSnapshot', which copies memory and the decoded instructions
+ *   instead of reading, decoding, and fusing the program again.
+ *
+ *   'Interpret' runs for at most a budget of instructions, and stops
+ *   early at an 'RD' with no data, leaving the PC at it; the next call
+ *   goes on from there.  A streaming machine (see 'SetStreaming') reads
+ *   the lines given it by 'Feed' instead of the data file, and stops after
+ *   each 'WRT' for its output to be taken with 'TakeOutput', so that it
+ *   can be run like a coroutine by a loop that waits on its input and
+ *   output (see 'EventLoop').  'TraceMachine', which every interpreted
+ *   instruction goes through, counts the budget down, and the engines
+ *   stop when it is used up.  Anything that has to stop the run sets it to
+ *   zero, with 'stop_status_' saying why.
+ *
+ *   Every so many branches back, 'CheckLoop' looks for the machine being
+ *   just as it was at an earlier check, which can only be an infinite
+ *   loop, and stops the run if it is.
+ *
+ *   For a trace policy that does not write every instruction, the 'switch'
+ *   loop in 'Interpret' also finds hot loops by counting the branches back
+ *   to their heads, records one trip around each, compiles it into a
+ *   straight run of plain instructions, and runs that with the accumulator
+ *   in a local and guards only where the trip can go another way (see
+ *   'RecordStep', 'CompileTrace', and 'RunTrace').  The tables for this are
+ *   only made when there is a loop to count.
 **/
 
 /***************************************************************************
  * Constructor
 **/
-Interpreter::Interpreter() {
+template <class Trace>
+Interpreter<Trace>::Interpreter()
+    : engine_(kSwitchEngine), fusion_(true), hot_traces_(true),
+      pc_(0), entry_pc_(0), accum_(0), memory_size_(0), last_store_(0),
+      executed_count_(0), entry_executed_count_(0), steps_left_(INT64_MAX),
+      stop_status_(kRunOutOfBudget), status_(kRunFinished),
+      is_running_(false), is_resuming_(false), next_keyframe_(1),
+      sample_every_(0), next_sample_(0),
+      sample_milliseconds_(0),
+      trace_stream_(nullptr), is_streaming_(false), trace_generation_(0),
+      loop_check_every_(kDefaultLoopCheck),
+      loop_countdown_(0), loop_power_(1), loop_length_(0), memory_hash_(0),
+      saved_hash_(0), saved_pc_(-1), saved_accum_(0), is_in_prefix_(false) {
+  // 'decoded_' is made as long as each program by 'LoadProgram'; memory
+  // itself must start out zero.
+  std::fill(memory_, memory_ + DABnamespace::kMaxMemory, 0);
+  if (Trace::kAsync) {
+    log_sink_.reset(new AsyncLogSink());
+  }
+  if (Trace::kBinary) {
+    trace_writer_.reset(new BinaryTraceWriter());
+  }
+  if (Trace::kDiff) {
+    is_written_.assign(DABnamespace::kMaxMemory, false);
+  }
+  DropTraces();
 }
 
 /***************************************************************************
  * Destructor
 **/
-Interpreter::~Interpreter() {
+template <class Trace>
+Interpreter<Trace>::~Interpreter() {
 }
 
 /***************************************************************************
  * Accessors and Mutators
 **/
 
+/***************************************************************************
+ * Accessor for 'accum_', as a signed value.
+**/
+template <class Trace>
+int Interpreter<Trace>::GetAccum() const {
+  return DABnamespace::TwosComplement(accum_);
+}
+
+/***************************************************************************
+ * Accessor for 'executed_count_', which only the trace policies that
+ * count instructions keep.
+**/
+template <class Trace>
+int64_t Interpreter<Trace>::GetExecutedCount() const {
+  return executed_count_;
+}
+
+/***************************************************************************
+ * Accessor for 'pc_'.
+**/
+template <class Trace>
+int Interpreter<Trace>::GetPC() const {
+  return pc_;
+}
+
+/***************************************************************************
+ * Mutator for the 'engine_' used by 'Interpret'.  The 'jit' engine cannot
+ * stop in an infinite loop, so 'Interpret' runs it only with 'SetLoopCheck(0)'.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetEngine(Engine engine) {
+  engine_ = engine;
+}
+
+/***************************************************************************
+ * Mutator for 'fusion_', whether 'ReadProgram' fuses superinstructions.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetFusion(bool fusion) {
+  fusion_ = fusion;
+}
+
+/***************************************************************************
+ * Mutator for 'hot_traces_', whether 'Interpret' records and runs traces
+ * of hot loops, for a trace policy that does not write every instruction.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetHotTraces(bool hot_traces) {
+  hot_traces_ = hot_traces;
+  if (!hot_traces_) {
+    DropTraces();
+  }
+}
+
+/***************************************************************************
+ * Mutator for 'loop_check_every_', how many branches back there are
+ * between the checks of 'CheckLoop', where zero is never.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetLoopCheck(int64_t every) {
+  loop_check_every_ = every;
+}
+
+/***************************************************************************
+ * Mutator for when a 'kSampled' trace policy writes the machine: every
+ * 'every' instructions and every 'milliseconds' ms, where zero is never.
+ * The clock is only looked at every 'kClockInterval' instructions.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetSampling(int64_t every, int milliseconds) {
+  sample_every_ = every;
+  sample_milliseconds_ = milliseconds;
+}
+
+/***************************************************************************
+ * Mutator to have a 'kSampled' trace policy write the machine whenever
+ * the PC is 'address'.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetSnapshotAt(int address) {
+  if (address >= 0 && address < DABnamespace::kMaxMemory) {
+    if (is_snapshot_pc_.empty()) {
+      is_snapshot_pc_.assign(DABnamespace::kMaxMemory, false);
+    }
+    is_snapshot_pc_[address] = true;
+  }
+}
+
+/***************************************************************************
+ * Mutator for 'is_streaming_', whether 'DoRD' and 'DoWRT' use the lines
+ * of 'Feed' and 'TakeOutput' instead of the data and output files.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetStreaming(bool is_streaming) {
+  is_streaming_ = is_streaming;
+}
+
+/***************************************************************************
+ * Mutator for 'trace_stream_', where a binary trace policy writes.
+**/
+template <class Trace>
+void Interpreter<Trace>::SetTraceStream(std::ostream& trace_stream) {
+  trace_stream_ = &trace_stream;
+}
+
 /***************************************************************************
  * General functions.
 **/
 
+/***************************************************************************
+ * Function 'AbandonRun'.
+ * End a run that 'Interpret' left out of budget or waiting for input, as
+ * it is, as when the input has run out or the run is not wanted.
+**/
+template <class Trace>
+void Interpreter<Trace>::AbandonRun() {
+  if (is_running_) {
+    EndRun(status_);
+  }
+}
+
+/***************************************************************************
+ * Function 'AbandonRun'.
+ * End a run that 'Interpret' left out of budget or waiting for input as
+ * if it had stopped with 'status', as when its input is bad.
+**/
+template <class Trace>
+void Interpreter<Trace>::AbandonRun(RunStatus status) {
+  if (is_running_) {
+    status_ = status;
+    EndRun(status_);
+  }
+}
+
+/***************************************************************************
+ * Function 'CheckLoop'.
+ * Called after a branch back, this stops the run if the machine is in an
+ * infinite loop.
+ *
+ * Between one 'RD' and the next, the machine (the PC, the accumulator, and
+ * memory) is all there is to where it goes next, so if it is ever again as
+ * it was, it goes round the same way for ever.  Brent's algorithm saves the
+ * machine after 1, 2, 4, 8, ... checks and compares every later check with
+ * it, so a loop of n checks is found within a few times n checks however
+ * late it starts, with only a logarithmic number of copies of memory.  The
+ * copies are only compared when the PC, the accumulator, and the hash of
+ * memory kept by 'DoSTC' all match.
+ *
+ * Only every 'loop_check_every_'th branch back is a check, to bound the
+ * cost; the checks are still a function of the machine, so the loop is
+ * still found, just later.
+**/
+template <class Trace>
+void Interpreter<Trace>::CheckLoop() {
+  if (--loop_countdown_ > 0) return;
+  loop_countdown_ = loop_check_every_;
+
+  ++loop_length_;
+  if (pc_ == saved_pc_ && accum_ == saved_accum_
+      && memory_hash_ == saved_hash_
+      && std::equal(memory_, memory_ + DABnamespace::kMaxMemory,
+                    saved_memory_.begin())) {
+    stop_status_ = kRunError;
+    steps_left_ = 0;
+    if (is_in_prefix_) return;
+    DrainLog();
+    Utils::log_stream << "LOOP: stopped in an infinite loop: the machine was "
+                      << "the same, PC " << pc_ + 1 << " ACC "
+                      << TwosComplementInteger(accum_) << " and all of "
+                      << "memory, " << loop_length_ * loop_check_every_
+                      << " branches back before, with no RD since" << endl;
+    return;
+  }
+  if (loop_length_ == loop_power_) {
+    saved_pc_ = pc_;
+    saved_accum_ = accum_;
+    saved_hash_ = memory_hash_;
+    saved_memory_.assign(memory_, memory_ + DABnamespace::kMaxMemory);
+    loop_power_ *= 2;
+    loop_length_ = 0;
+  }
+}
+
+/***************************************************************************
+ * Function 'CompileTrace'.
+ * Compile the trip just recorded around the loop at 'recording_head' into
+ * a trace for 'RunTrace', and have the head run it from now on.
+ *
+ * Each superinstruction is taken apart into its members, which are the
+ * words after its head, as decoded now; any store into the loop since its
+ * recording started would have dropped it.  A direct 'BR' forward always
+ * goes the same way, and an 'EEE' word with no function does nothing, so
+ * neither is in the compiled trace, but both count in its length; a direct
+ * 'BR' back is kept for 'CheckLoop'.
+**/
+template <class Trace>
+void Interpreter<Trace>::CompileTrace() {
+#ifdef EBUG
+  Utils::log_stream << "enter CompileTrace" << endl;
+#endif
+  HotTraces& hot = *hot_;
+  CompiledTrace trace;
+  trace.length = 0;
+  for (size_t sub = 0; sub < hot.recording.size(); ++sub) {
+    const TraceStep& step = hot.recording[sub];
+    int members = DABnamespace::HandlerLength(decoded_[step.address].handler);
+    for (int member = 0; member < members; ++member) {
+      TraceOp op;
+      op.inst = decoded_[step.address + member];
+      op.address = static_cast<uint16_t>(step.address + member);
+      op.next = (member + 1 < members) ? op.address + 1 : step.next;
+      op.step = static_cast<uint16_t>(++trace.length);
+      if ((op.inst.opcode == DABnamespace::kBR && !op.inst.indirect
+           && op.next > op.address)
+          || op.inst.opcode == DABnamespace::kNOP) {
+        continue;
+      }
+      trace.ops.push_back(op);
+    }
+  }
+
+  hot.trace_at[hot.recording_head] = static_cast<int16_t>(hot.traces.size());
+  hot.traces.push_back(trace);
+  hot.recording.clear();
+  hot.recording_head = kNoTrace;
+#ifdef EBUG
+  Utils::log_stream << "leave CompileTrace" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'CountLoop'.
+ * Count one more trip around the loop at 'head', after a branch back to
+ * it, and start recording it when it is hot.  The tables for hot traces
+ * are made here, for the program as it is loaded, the first time.
+**/
+template <class Trace>
+void Interpreter<Trace>::CountLoop(int head) {
+  if (!hot_) {
+    hot_.reset(new HotTraces());
+    hot_->loop_counts.assign(memory_size_, 0);
+    hot_->trace_at.assign(memory_size_, kNoTrace);
+    hot_->in_trace.assign(memory_size_, false);
+    hot_->recording_head = kNoTrace;
+  }
+  if (hot_->trace_at[head] == kNoTrace
+      && ++hot_->loop_counts[head] >= kHotLoopCount) {
+    hot_->recording_head = head;
+  }
+}
+
+/***************************************************************************
+ * Function 'CountSteps'.
+ * Take 'count' instructions, run without 'TraceMachine', from the budget,
+ * and count them as it would have.
+**/
+template <class Trace>
+void Interpreter<Trace>::CountSteps(int count) {
+  steps_left_ -= count;
+  if (Trace::kSummary || Trace::kDiff || Trace::kSampled) {
+    executed_count_ += count;
+  }
+}
+
+/***************************************************************************
+ * Function 'DecodeAt'.
+ * Decode the word at 'address' again after it has been written, and redo
+ * the fusion of any run of instructions that it may be part of.
+ *
+ * Parameter:
+ *   address - the address of the word, which must be below 'memory_size_'
+**/
+template <class Trace>
+void Interpreter<Trace>::DecodeAt(int address) {
+#ifdef EBUG
+  Utils::log_stream << "enter DecodeAt" << endl;
+#endif
+  decoded_[address] = DABnamespace::DecodeWord(memory_[address], address);
+  bool is_traced = false;
+  for (int head = std::max(0, address - 2); head <= address; ++head) {
+    FuseAt(head);
+    is_traced = is_traced || (hot_ && hot_->in_trace[head]);
+  }
+
+  // A trace holds copies of the decoded instructions it runs.
+  if (is_traced) {
+    DropTraces();
+  }
+#ifdef EBUG
+  Utils::log_stream << "leave DecodeAt" << endl;
+#endif
+}
+
 /***************************************************************************
  * Function 'DoADD'.
  * This top level function interprets the 'ADD' opcode.
@@ -55,18 +411,20 @@ Interpreter::~Interpreter() {
  * Arithmetic overflow causes the top bits to be lost but is not flagged
  *   as an error.  It's just the way hardware works.
 **/
-void Interpreter::DoADD(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoADD(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoADD" << endl;
 #endif
 
-  Utils::log_stream << "EXECUTE:    OPCODE ADDR TARGET " << "ADD        "
-                    << addr << " " << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kADD, pc_, 0);
+  }
   /* Go to needed location. Get its contents. Convert to a 32 bit
    * Two's Complement value. Add it to the existing accumulator.
   **/
-  int location = GetTargetLocation(addr, target);
-  int val = DABnamespace::BitStringToDec(memory_.at(location).GetBitPattern());
+  int location = GetTargetLocation(inst);
+  int val = memory_[location];
   int converted_value = TwosComplementInteger(val);
   accum_ = TwosComplementInteger(accum_) + converted_value;
 
@@ -82,17 +440,19 @@ void Interpreter::DoADD(string addr, string target) {
  * Load the contents from the 'target', taking indirection into account.
  * AND, storing the result in the accumulator.
 **/
-void Interpreter::DoAND(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoAND(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoAND" << endl;
 #endif
-  Utils::log_stream << "EXECUTE:    OPCODE ADDR TARGET " << "AND "
-                    << addr << " " << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kAND, pc_, 0);
+  }
   /* Get target location. Get the contents to and to the accumulator. 
    * AND the contents together with the accumulator bit by bit.
   **/
-  int location = GetTargetLocation(addr, target);
-  int add = DABnamespace::BitStringToDec(memory_.at(location).GetBitPattern());
+  int location = GetTargetLocation(inst);
+  int add = memory_[location];
   accum_ &= add;
 #ifdef EBUG
   Utils::log_stream << "leave DoAND" << endl;
@@ -106,19 +466,26 @@ void Interpreter::DoAND(string addr, string target) {
  * If the accumulator value is negative, branch to the target location.
  * Otherwise, just continue on continuing on.
 **/
-void Interpreter::DoBAN(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoBAN(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoBAN" << endl;
 #endif
-  Utils::log_stream << "OPCODE ADDR TARGET " << "BAN " << addr << " "
-                    << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kBAN, pc_, 0);
+  }
   // Ensure that the accumulator is negative to branch. Hence,
   // "Branch Accumulator Negative". If negative, branch (jump)
   // to the target location.
   if (accum_ < 0) {
-    pc_ = GetTargetLocation(addr, target);
-  } else {
-    Utils::log_stream << "the accumulator was not negative." << endl;
+    int location = GetTargetLocation(inst);
+    bool is_back = location < pc_;
+    pc_ = location;
+    if (is_back && loop_check_every_ > 0) {
+      CheckLoop();
+    }
+  } else if (Trace::kSteps) {
+    LogRecord(kNotNegativeRecord, 0, 0, 0);
   }
 #ifdef EBUG
   Utils::log_stream << "leave DoBAN" << endl;
@@ -131,14 +498,21 @@ void Interpreter::DoBAN(string addr, string target) {
  *
  * Branch unconditionally to the target location.
 **/
-void Interpreter::DoBR(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoBR(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoBR" << endl;
 #endif
-  Utils::log_stream << "OPCODE ADDR TARGET " << "BR  " << addr << " "
-                    << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kBR, pc_, 0);
+  }
   // Branch (jump in memory) to the target location.
-  pc_ = GetTargetLocation(addr, target);
+  int location = GetTargetLocation(inst);
+  bool is_back = location < pc_;
+  pc_ = location;
+  if (is_back && loop_check_every_ > 0) {
+    CheckLoop();
+  }
 #ifdef EBUG
   Utils::log_stream << "leave DoBR" << endl;
 #endif
@@ -152,16 +526,18 @@ void Interpreter::DoBR(string addr, string target) {
  * The contents are the last twelve bits. Meaning, the first four that have 
  * the opcode and addressing will be ignored.
 **/
-void Interpreter::DoLD(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoLD(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoLD" << endl;
 #endif
-  Utils::log_stream << "EXECUTE:    OPCODE ADDR TARGET " << "LD         "
-                    << addr << " " << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kLD, pc_, 0);
+  }
   // Get the target location to load. Load (make the accumulator)
   // the value found by the target location.
-  int location = GetTargetLocation(addr, target);
-  int add = DABnamespace::BitStringToDec(memory_.at(location).GetAddressBits());
+  int location = GetTargetLocation(inst);
+  int add = OneMemoryWord(memory_[location]).GetAddressBits();
   accum_ = add;
 #ifdef EBUG
   Utils::log_stream << "leave DoLD" << endl;
@@ -179,28 +555,53 @@ void Interpreter::DoLD(string addr, string target) {
  * Else:
  *   crash on read past end of file
 **/
-void Interpreter::DoRD(Scanner& data_scanner) {
+template <class Trace>
+bool Interpreter<Trace>::DoRD(Scanner& data_scanner) {
 #ifdef EBUG
   Utils::log_stream << "enter DoRD" << endl;
 #endif
-  Utils::log_stream << "OPCODE " << "RD  " << endl;
-  Utils::log_stream << std::boolalpha << data_scanner.HasNext() << endl;
+  // A streaming machine waits for its input without logging a read.
+  bool has_data = is_streaming_ ? !input_lines_.empty()
+                                : data_scanner.HasNext();
+  if (Trace::kSteps && (has_data || !is_streaming_)) {
+    LogRecord(kReadRecord, has_data, 0, 0);
+  }
   // ".empty()" returns true if there is nothing else in the vector.
   // Referenced from c++.com
 
   // Read the needed file as long for as long as there is more data to read.
   // Convert the hexadecimal data to a decimal, then make that the accumulator.
 
-  if (data_scanner.HasNext()) {
-    string line = data_scanner.NextLine();
-    Hex convert = Hex(line);
-    accum_ = TwosComplementInteger(convert.GetValue());
+  if (has_data) {
+    string line = "";
+    if (is_streaming_) {
+      line = input_lines_.front();
+      input_lines_.pop_front();
+    } else {
+      line = data_scanner.NextLine();
+    }
+    accum_ = DABnamespace::ReadValue(line);
+    ResetLoopCheck();
   } else {
-    exit(1);
+    // Stop with the PC back at the 'RD', after the '++pc_' that follows,
+    // and not counted, so that it is done again when the run goes on;
+    // it has been traced, so 'TraceMachine' only counts it then.
+    --pc_;
+    if (Trace::kSummary || Trace::kDiff || Trace::kSampled) {
+      --executed_count_;
+    }
+    is_resuming_ = true;
+    stop_status_ = kRunWaitingForInput;
+    steps_left_ = 0;
+#ifdef EBUG
+    Utils::log_stream << "leave DoRD" << endl;
+#endif
+    return false;
   }
 #ifdef EBUG
   Utils::log_stream << "leave DoRD" << endl;
 #endif
+  return true;
 }
 
 /***************************************************************************
@@ -214,18 +615,36 @@ void Interpreter::DoRD(Scanner& data_scanner) {
  * This assumes that 'GetTargetLocation' does the error checking for invalid
  * addresses.
 **/
-void Interpreter::DoSTC(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoSTC(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoSTC" << endl;
 #endif
-  Utils::log_stream << "EXECUTE:    OPCODE ADDR TARGET " << "STC        "
-                    << addr << " " << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kSTC, pc_, 0);
+  }
   // Get the target location. Make the address in memory at that location
   // the value of the accumulator. Reset the accumulator.
-  int location = GetTargetLocation(addr, target);
-  string to_store = DABnamespace::DecToBitString(accum_, 16);
-  memory_.at(location) = (to_store);
+  int location = GetTargetLocation(inst);
+  if (loop_check_every_ > 0) {
+    memory_hash_ += HashWord(location, static_cast<uint16_t>(accum_))
+                    - HashWord(location, memory_[location]);
+  }
+  memory_[location] = static_cast<uint16_t>(accum_);
   accum_ = 0;
+  if (Trace::kAsync && (Trace::kMachine || Trace::kSteps)) {
+    LogRecord(kStoreRecord, 0, location, memory_[location]);
+  }
+  if (Trace::kDiff && !is_written_[location]) {
+    is_written_[location] = true;
+    written_words_.push_back(location);
+  }
+
+  // The word may be an instruction; keep its decoded form in step.
+  last_store_ = location;
+  if (location < memory_size_) {
+    DecodeAt(location);
+  }
 
 #ifdef EBUG
   Utils::log_stream << "leave DoSTC" << endl;
@@ -240,13 +659,16 @@ void Interpreter::DoSTC(string addr, string target) {
  * the indicator to stop execution, all we need to do here is assign that
  * constant to the program counter.
 **/
-void Interpreter::DoSTP() {
+template <class Trace>
+void Interpreter<Trace>::DoSTP() {
 #ifdef EBUG
   Utils::log_stream << "enter DoSTP" << endl;
 #endif
-  Utils::log_stream << "OPCODE " << "STP " << endl;
+  if (Trace::kSteps) {
+    LogRecord(kStopRecord, 0, 0, 0);
+  }
   // Give a value to know when to stop.
-  pc_ = kPCForStop;
+  pc_ = DABnamespace::kPCForStop;
 #ifdef EBUG
   Utils::log_stream << "leave DoSTP" << endl;
 #endif
@@ -258,17 +680,18 @@ void Interpreter::DoSTP() {
  * 
  * Subtract contents of memory from accumulator.
 **/
-void Interpreter::DoSUB(string addr, string target) {
+template <class Trace>
+void Interpreter<Trace>::DoSUB(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter DoSUB" << endl;
 #endif
-  Utils::log_stream << "EXECUTE:    OPCODE ADDR TARGET " << "SUB        "
-                    << addr << " " << target << endl;
+  if (Trace::kSteps) {
+    LogRecord(kOperandRecord, DABnamespace::kSUB, pc_, 0);
+  }
   // Get the target location. Using Two's Complement Arithmetic, subtract
   // the data at that location from the accumulator.
-  int location = GetTargetLocation(addr, target);
-  string address_bits = memory_.at(location).GetAddressBits();
-  int to_sub = DABnamespace::BitStringToDec(address_bits);
+  int location = GetTargetLocation(inst);
+  int to_sub = OneMemoryWord(memory_[location]).GetAddressBits();
   accum_ = accum_ - to_sub;
 
 #ifdef EBUG
@@ -286,22 +709,150 @@ void Interpreter::DoSUB(string addr, string target) {
  * Note that we actually write more than just the value itself so we can do
  * better tracing. This could/should be fixed in a final version of this code.
 **/
-void Interpreter::DoWRT(ofstream& out_stream) {
+template <class Trace>
+void Interpreter<Trace>::DoWRT(ofstream& out_stream) {
 #ifdef EBUG
   Utils::log_stream << "enter DoWRT" << endl;
 #endif
-  Utils::log_stream << "EXECUTE:    OPCODE             " << "WRT" << endl;
+  if (Trace::kSteps) {
+    LogRecord(kWriteRecord, 0, 0, 0);
+  }
   // This is what controls the output file. Write the accumulator as a 32 bit
   // 2s complement value.
-  int accum_to_write = TwosComplementInteger(accum_);
-  out_stream << "WRITE OUTPUT" << "      " << accum_to_write << " "
-             << DABnamespace::DecToBitString(accum_, 16) << endl;
+  if (is_streaming_) {
+    output_ += DABnamespace::OutputLine(accum_);
+    output_ += '\n';
+    stop_status_ = kRunHasOutput;
+    steps_left_ = 0;
+  } else {
+    out_stream << DABnamespace::OutputLine(accum_) << endl;
+  }
 
 #ifdef EBUG
   Utils::log_stream << "leave DoWRT" << endl;
 #endif
 }
 
+/***************************************************************************
+ * Superinstructions.
+ *
+ * Each of these executes a run of adjacent instructions that was fused by
+ * 'FuseAt', with the PC at the head of the run.  The members are executed
+ * by their own handlers with the PC stepped and the machine traced between
+ * them exactly as 'Interpret' would, and the PC is left on the last member
+ * for the caller to advance.  Only the dispatches in between are saved.
+**/
+
+/***************************************************************************
+ * Function 'DoADDBAN', for 'ADD' followed by 'BAN'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoADDBAN() {
+  DoADD(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoBAN(decoded_[pc_]);
+}
+
+/***************************************************************************
+ * Function 'DoADDSTC', for 'ADD' followed by 'STC'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoADDSTC() {
+  DoADD(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoSTC(decoded_[pc_]);
+}
+
+/***************************************************************************
+ * Function 'DoLDADD', for 'LD' followed by 'ADD'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoLDADD() {
+  DoLD(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoADD(decoded_[pc_]);
+}
+
+/***************************************************************************
+ * Function 'DoLDADDSTC', for 'LD', 'ADD', and 'STC'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoLDADDSTC() {
+  DoLD(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoADD(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoSTC(decoded_[pc_]);
+}
+
+/***************************************************************************
+ * Function 'DoLDWRT', for 'LD' followed by 'WRT'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoLDWRT(ofstream& out_stream) {
+  DoLD(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoWRT(out_stream);
+}
+
+/***************************************************************************
+ * Function 'DoRDSTC', for 'RD' followed by 'STC'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoRDSTC(Scanner& data_scanner) {
+  if (!DoRD(data_scanner)) return;
+  ++pc_;
+  TraceMachine();
+  DoSTC(decoded_[pc_]);
+}
+
+/***************************************************************************
+ * Function 'DoSUBBAN', for 'SUB' followed by 'BAN'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DoSUBBAN() {
+  DoSUB(decoded_[pc_]);
+  ++pc_;
+  TraceMachine();
+  DoBAN(decoded_[pc_]);
+}
+
+/***************************************************************************
+ * Function 'DrainLog'.
+ * Wait for the writer thread of an asynchronous trace policy to write all
+ * it has been handed, so that a line written to the log now comes after.
+**/
+template <class Trace>
+void Interpreter<Trace>::DrainLog() {
+  if (Trace::kAsync) {
+    log_sink_->Drain();
+  }
+}
+
+/***************************************************************************
+ * Function 'DropTraces'.
+ * Forget every trace, and any trace being recorded, and start counting
+ * loops again from nothing.  This is done when a word that a trace has a
+ * copy of is written; 'RunTrace' notices the change of 'trace_generation_'.
+**/
+template <class Trace>
+void Interpreter<Trace>::DropTraces() {
+#ifdef EBUG
+  Utils::log_stream << "enter DropTraces" << endl;
+#endif
+  ++trace_generation_;
+  hot_.reset();
+#ifdef EBUG
+  Utils::log_stream << "leave DropTraces" << endl;
+#endif
+}
+
 /***************************************************************************
  * Function 'DumpProgram'.
  * This top level function dumps the ASCII of the machine code from memory.
@@ -309,12 +860,13 @@ void Interpreter::DoWRT(ofstream& out_stream) {
  * Parameters:
  *   out_stream - the scanner to read for source code
 **/
-void Interpreter::DumpProgram(ofstream& out_stream) {
+template <class Trace>
+void Interpreter<Trace>::DumpProgram(ofstream& out_stream) {
 #ifdef EBUG
   Utils::log_stream << "enter DumpProgram" << endl;
 #endif
   // This loop prints all of the onememoryword objects to the log stream.
-  for (unsigned int i = 0; i < memory_.size(); ++i) {
+  for (int i = 0; Trace::kSteps && i < memory_size_; ++i) {
     Utils:: log_stream << "WRITE OUTPUT" << Utils::Format(accum_, 8)
        << " " << Utils::Format(TwosComplementInteger(accum_)) << endl;
   }
@@ -324,53 +876,80 @@ void Interpreter::DumpProgram(ofstream& out_stream) {
 #endif
 }
 
+/***************************************************************************
+ * Function 'EndRun'.
+ * Finish the logs of the run, which ended with 'status'.
+**/
+template <class Trace>
+void Interpreter<Trace>::EndRun(RunStatus status) {
+  is_running_ = false;
+  if (Trace::kAsync) {
+    log_sink_->Stop();
+  }
+  if (Trace::kBinary) {
+    trace_writer_->Finish(accum_, status == kRunFinished ? kTraceFinished
+                                  : status == kRunWaitingForInput
+                                    ? kTraceOutOfData
+                                  : status == kRunError ? kTraceLooping
+                                  : kTraceTruncated);
+  }
+  if (Trace::kSummary) {
+    Utils::log_stream << "SUMMARY: "
+                      << DABnamespace::Summary(executed_count_, pc_, accum_);
+    if (status == kRunWaitingForInput) {
+      Utils::log_stream << ", ran out of data";
+    } else if (status == kRunOutOfBudget || status == kRunHasOutput) {
+      Utils::log_stream << ", given up";
+    } else if (status == kRunError) {
+      Utils::log_stream << ", stopped by an error";
+    }
+    Utils::log_stream << endl;
+  }
+}
+
 /***************************************************************************
  * Function 'Execute'.
  * This top level function executes the code.
  *
- * Execution is basically a switch statement based on the opcode value.
+ * Execution is basically a switch statement based on the handler value.
+ * The instruction was decoded by 'DecodeWord' when the program was loaded
+ * (or when an 'STC' last wrote to its word), so the 'EEE' group has
+ * already been split into 'STP', 'RD', and 'WRT' and nothing here looks
+ * at bits or strings.  The handler may be a superinstruction that runs
+ * this instruction and the one or two after it.
  *
  * Parameters:
- *   this_word - the instance of 'OneMemoryWord' to be executed.
+ *   inst - the decoded instruction at the current PC
  *   data_scanner - the 'Scanner', needed for the 'RD' instruction
  *   out_stream - the output stream , needed for the 'WRT' instruction
 **/
-void Interpreter::Execute(OneMemoryWord this_word, Scanner& data_scanner,
-                          ofstream& out_stream) {
+template <class Trace>
+void Interpreter<Trace>::Execute(const DecodedInstruction& inst,
+                                 Scanner& data_scanner,
+                                 ofstream& out_stream) {
 #ifdef EBUG
   Utils::log_stream << "enter Execute" << endl;
 #endif
-  Utils::log_stream << ToString() << endl;
-  // Get opcode, direct/indirect flag (0/1), and address bits from the
-  // OneMemoryWord object (a bit string). Using the opcode, look up the
-  // respective command, then call the respective command's function.
-  string opcode = this_word.GetMnemonicBits();
-  string address = this_word.GetAddressBits();
-  string is_direct = this_word.GetIndirectFlag();
-  assert(opcode.length() == 3);
-  // Find the command to execute using the first three bits of this_word.
-  // Combinations registered in the code_to_mnemonic_ class map.
-  string cmd = code_to_mnemonic_.find(opcode) -> second;
-  if (cmd == "EEE") {  // "EEE" indictates a RD/WRT/STP.
-    // The last three address bits will delinate the commmand.
-    string last_three = this_word.GetAddressBits().substr(9);
-    if (last_three == "010") DoSTP();
-    else if (last_three == "001") DoRD(data_scanner);
-    else if (last_three == "011") DoWRT(out_stream);
-  } else if (cmd == "BAN") {
-    DoBAN(is_direct, address);
-  } else if (cmd == "SUB") {
-    DoSUB(is_direct, address);
-  } else if (cmd == "STC") {
-    DoSTC(is_direct, address);
-  } else if (cmd == "AND") {
-    DoAND(is_direct, address);
-  } else if (cmd == "ADD") {
-    DoADD(is_direct, address);
-  } else if (cmd == "LD ") {
-    DoLD(is_direct, address);
-  } else if (cmd == "BR ") {
-    DoBR(is_direct, address);
+  TraceMachine();
+  switch (inst.handler) {
+    case DABnamespace::kBAN: DoBAN(inst); break;
+    case DABnamespace::kSUB: DoSUB(inst); break;
+    case DABnamespace::kSTC: DoSTC(inst); break;
+    case DABnamespace::kAND: DoAND(inst); break;
+    case DABnamespace::kADD: DoADD(inst); break;
+    case DABnamespace::kLD:  DoLD(inst); break;
+    case DABnamespace::kBR:  DoBR(inst); break;
+    case DABnamespace::kSTP: DoSTP(); break;
+    case DABnamespace::kRD:  DoRD(data_scanner); break;
+    case DABnamespace::kWRT: DoWRT(out_stream); break;
+    case DABnamespace::kRDSTC: DoRDSTC(data_scanner); break;
+    case DABnamespace::kLDADDSTC: DoLDADDSTC(); break;
+    case DABnamespace::kLDADD: DoLDADD(); break;
+    case DABnamespace::kADDSTC: DoADDSTC(); break;
+    case DABnamespace::kSUBBAN: DoSUBBAN(); break;
+    case DABnamespace::kADDBAN: DoADDBAN(); break;
+    case DABnamespace::kLDWRT: DoLDWRT(out_stream); break;
+    default: break;  // an 'EEE' word with no defined function
   }
 
 #ifdef EBUG
@@ -379,60 +958,59 @@ void Interpreter::Execute(OneMemoryWord this_word, Scanner& data_scanner,
 }
 
 /***************************************************************************
- * Function 'FlagAddressOutOfBounds'.
- * Check to see if an address is between 0 and 'kMaxMemory' inclusive and
- * die with an error if this isn't the case.
+ * Function 'Feed'.
+ * Give a streaming machine one more line of input, for an 'RD' to read.
+**/
+template <class Trace>
+void Interpreter<Trace>::Feed(const string& line) {
+  input_lines_.push_back(line);
+}
+
+/***************************************************************************
+ * Function 'FuseAt'.
+ * Set the handler of the instruction at 'address' to the superinstruction
+ * that the run starting there can be fused into, if fusion is on and there
+ * is one, and otherwise to the instruction's own opcode.
  *
  * Parameter:
- *   address - the address to check for out of bounds
+ *   address - the address of the head of the run
 **/
-void Interpreter::FlagAddressOutOfBounds(int address) {
-#ifdef EBUG
-  Utils::log_stream << "enter FlagAddressOutOfBounds" << endl;
-#endif
-  // Mark the address as outside of memory if the requested address is too
-  // large.
-  if (!(address > 0 && address <= DABnamespace::kMaxMemory)) {
-    Utils::log_stream << "The address was out of bounds" << endl;
-    exit(1);
+template <class Trace>
+void Interpreter<Trace>::FuseAt(int address) {
+  DecodedInstruction& head = decoded_[address];
+  if (fusion_) {
+    head.handler = static_cast<uint8_t>(DABnamespace::FuseInstructions(
+                     &decoded_[address], std::min(3, memory_size_ - address)));
+  } else {
+    head.handler = head.opcode;
   }
-#ifdef EBUG
-  Utils::log_stream << "leave FlagAddressOutOfBounds" << endl;
-#endif
 }
 
 /***************************************************************************
  * Function 'GetTargetLocation'.
  * Get the target location, perhaps through indirect addressing.
  *
- * Note that this function crashes the program if the target location is out
- * of bounds for this simulated computer.
+ * The decoder has already replaced a target that lies beyond the
+ * instruction's own address by a direct reference to location zero, so
+ * all that remains at run time is the indirect lookup.
  *
  * Parameter:
- *   label - the label for our tracing output (debugging purposes)
- *   addr - is this indirect or not?
- *   target - the target to look up
+ *   inst - the decoded instruction whose target we want
 **/
-int Interpreter::GetTargetLocation(string addr, string target) {
+template <class Trace>
+int Interpreter<Trace>::GetTargetLocation(const DecodedInstruction& inst) {
 #ifdef EBUG
   Utils::log_stream << "enter GetTargetLocation" << endl;
 #endif
-  /* If fourth bit (addr) is 0, then there is direct addressing. Therefore,
-   * convert target to decimal, and that is the target location. If addr is 
-   * 1, then there is indirect addressing. Therefore, convert the target to 
-   * decimal, then go to that location, and get that location's target data 
-   * to convert.
+  /* If fourth bit (addr) is 0, then there is direct addressing, and the
+   * operand is the target location. If addr is 1, then there is indirect
+   * addressing. Therefore, go to the operand's location, and use that
+   * location's address bits.
   */
-  int location = 0;
-  int converted_value = DABnamespace::BitStringToDec(target);
-  assert(addr == "0" || addr == "1");
-  if (addr == "0" && converted_value <= pc_) {
-    location = converted_value;
-  } else if (addr == "1" && converted_value <= pc_) {
-    string memory_bits = memory_.at(converted_value).GetAddressBits();
-    int memory_decimal = DABnamespace::BitStringToDec(memory_bits);
-    location = memory_decimal;
-    }
+  int location = inst.operand;
+  if (inst.indirect) {
+    location = OneMemoryWord(memory_[location]).GetAddressBits();
+  }
 
 #ifdef EBUG
   Utils::log_stream << "leave GetTargetLocation" << endl;
@@ -441,84 +1019,994 @@ int Interpreter::GetTargetLocation(string addr, string target) {
   return location;
 }
 
+/***************************************************************************
+ * Function 'Interpret'.
+ * Run the loaded program to its end, for as many calls as it takes; see
+ * the one with a budget.
+**/
+template <class Trace>
+RunStatus Interpreter<Trace>::Interpret(Scanner& data_scanner,
+                                        ofstream& out_stream) {
+  return Interpret(data_scanner, out_stream, INT64_MAX);
+}
+
 /***************************************************************************
  * Function 'Interpret'.
  * This top level function interprets the code.
  *
- * Note that errors in execution will result in the program being terminated
- * from functions other than this one.
+ * Note that errors in execution stop the run from functions other than
+ * this one, which set 'steps_left_' to zero and 'stop_status_' to say so.
  *
- * We run a loop until we either hit the bogus PC value for the STP or we
- * encounter an error, which can include having the PC go past 4095.
+ * We run a loop until we either hit the bogus PC value for the STP, run
+ * the 'budget' of instructions, or stop for some other reason.
  * So the interpreter runs a logically infinite loop:
  *
  * while true (execution should stop with a 'STP' instruction)
  *   decode the instruction pointed to by the PC
  *   execute the instruction
  *   check for invalid PC or infinite loop
+ *
+ * The check for an infinite loop is 'CheckLoop', made on branches back by
+ * every engine but the 'jit' one, whose native code does not check.
+ *
+ * The first call after a program is loaded starts the run at its entry; a
+ * call after one that was out of budget or waiting for input goes on from
+ * where that stopped.  The 'jit' engine runs only when the budget is
+ * unlimited, since its native code counts instructions but does not stop
+ * when a budget is used up, and only on the first call; after that the
+ * program is interpreted.  The budget counts instructions, and a
+ * superinstruction can take it one or two past.
+ *
+ * Parameters:
+ *   data_scanner - the 'Scanner', needed for the 'RD' instruction
+ *   out_stream - the output stream , needed for the 'WRT' instruction
+ *   budget - the most instructions to run in this call
+ *
+ * Returns:
+ *   why this call stopped; only a finished run or an error ends the run
 **/
-void Interpreter::Interpret(Scanner& data_scanner, ofstream& out_stream) {
+template <class Trace>
+RunStatus Interpreter<Trace>::Interpret(Scanner& data_scanner,
+                                        ofstream& out_stream,
+                                        int64_t budget) {
 #ifdef EBUG
   Utils::log_stream << "enter Interpret" << endl;
 #endif
 
+  steps_left_ = budget;
+  stop_status_ = kRunOutOfBudget;
+  bool is_true = true;
+  if (!is_running_) {
+    is_running_ = true;
+    pc_ = entry_pc_;
+    executed_count_ = entry_executed_count_;
+    next_keyframe_ = 1;
+    next_sample_ = (sample_every_ > 0) ? sample_every_ : INT64_MAX;
+    next_sample_time_ = std::chrono::steady_clock::now()
+                        + std::chrono::milliseconds(sample_milliseconds_);
+    if (Trace::kAsync) {
+      log_sink_->Start(Utils::log_stream, memory_, memory_size_);
+    }
+    if (Trace::kBinary && trace_stream_ != nullptr) {
+      trace_writer_->Start(*trace_stream_, memory_, memory_size_);
+    }
+    StartLoopCheck();
+    // The binary trace must have every instruction, and the snapshots must
+    // count them, so no native code.  Nor can native code stop in an
+    // infinite loop, so it runs only when there are no looks for one.
+    if (engine_ == kJitEngine && !Trace::kBinary && !Trace::kSampled
+        && budget == INT64_MAX && loop_check_every_ == 0) {
+      InterpretJit(data_scanner, out_stream);
+    }
+  }
+  if (engine_ == kThreadedEngine) {
+    InterpretThreaded(data_scanner, out_stream);
+    is_true = false;
+  }
+
   // Run a loop to control the hardware. This loop will call Execute() to
   // decode the needed bits and run further instruction.
-  bool is_true = true;
-  pc_ = 0;
+  //
+  // A branch to a lower address counts one more trip around the loop that
+  // starts there.  When a loop is hot, the instructions of its next trip
+  // are recorded and compiled as a trace, and after that the loop is run
+  // by 'RunTrace' whenever the PC comes back to its head.  This is only
+  // for a trace policy that does not write every instruction.
   while (is_true) {
-    if (pc_ < memory_.size()) {
+    if (pc_ < memory_size_ && steps_left_ > 0) {
       if (pc_ > DABnamespace::kMaxMemory) {
+        DrainLog();
         Utils::log_stream << "crashing. pc too big" << endl;
-        exit(1);
+        stop_status_ = kRunError;
+        break;
+      }
+      if (hot_ && hot_->recording_head == kNoTrace
+          && hot_->trace_at[pc_] >= 0
+          && RunTrace(hot_->trace_at[pc_], data_scanner, out_stream)) {
+        continue;
       }
-      Execute(memory_.at(pc_), data_scanner, out_stream);
+      int address = pc_;
+      Execute(decoded_[pc_], data_scanner, out_stream);
       ++pc_;
+      if (steps_left_ <= 0 && (stop_status_ == kRunWaitingForInput
+                               || stop_status_ == kRunError)) {
+        break;  // the instruction did not finish
+      }
+      if (hot_ && hot_->recording_head != kNoTrace) {
+        RecordStep(address);
+      } else if (!kTracesEachStep && hot_traces_ && pc_ <= address
+                 && pc_ < memory_size_) {
+        CountLoop(pc_);
+      }
     } else {
     is_true = false;
     }
   }
 
+  status_ = (pc_ < memory_size_) ? stop_status_ : kRunFinished;
+  if (status_ == kRunFinished || status_ == kRunError) {
+    EndRun(status_);
+  }
+
 #ifdef EBUG
   Utils::log_stream << "leave Interpret" << endl;
 #endif
+  return status_;
+}
+
+/***************************************************************************
+ * Function 'InterpretJit'.
+ * This function runs the program as native code from a 'JitCompiler', for
+ * 'SetEngine(kJitEngine)'.
+ *
+ * The compiled code calls back into 'DoRD' and 'DoWRT' through 'JitRead'
+ * and 'JitWrite', so input, output, and their log lines are as usual, but
+ * the machine is not traced before every instruction.  The compiled code
+ * counts the instructions it runs, so the summary's count is as usual.
+ *
+ * The code is compiled again only when memory at the start differs from
+ * what it was compiled from.  If the code cannot be compiled here, or if
+ * execution reaches a word that an 'STC' has changed since it was
+ * compiled, this returns with the PC at the word still to execute, and
+ * 'Interpret' carries on from there.
+ *
+ * Parameters:
+ *   data_scanner - the 'Scanner', needed for the 'RD' instruction
+ *   out_stream - the output stream , needed for the 'WRT' instruction
+**/
+template <class Trace>
+void Interpreter<Trace>::InterpretJit(Scanner& data_scanner,
+                                      ofstream& out_stream) {
+#ifdef EBUG
+  Utils::log_stream << "enter InterpretJit" << endl;
+#endif
+  // Each run of a 'Pullet16Machine' starts from the memory it loaded, so
+  // the code compiled for its first run serves them all.
+  if (jit_ != nullptr && jit_->IsCompiledFrom(memory_, memory_size_)) {
+    jit_->Unpatch();
+  } else {
+    jit_.reset(new JitCompiler());
+    if (!jit_->Compile(memory_, memory_size_)) {
+      jit_.reset();
+      DrainLog();
+      Utils::log_stream << "JIT: cannot compile here, interpreting" << endl;
+      return;
+    }
+  }
+
+  JitContext context;
+  context.memory = memory_;
+  context.accum = accum_;
+  context.pc = pc_;
+  // As 'DoSTP' and then the '++pc_'.
+  context.stop_pc = DABnamespace::kPCForStop + 1;
+  context.read = &Interpreter::JitRead;
+  context.write = &Interpreter::JitWrite;
+  context.owner = this;
+  context.input = &data_scanner;
+  context.output = &out_stream;
+  context.executed_count = executed_count_;
+  jit_->Run(&context);
+  accum_ = context.accum;
+  pc_ = context.pc;
+  executed_count_ = context.executed_count;
+
+  // The compiled code stores into 'memory_' without decoding, so decode
+  // everything again for whatever is left to interpret.
+  if (pc_ < memory_size_) {
+    DrainLog();
+    if (Trace::kAsync) {
+      log_sink_->Load(memory_, memory_size_);
+    }
+    next_keyframe_ = executed_count_ + 1;  // its stores were not seen
+    if (stop_status_ != kRunWaitingForInput) {
+      Utils::log_stream << "JIT: interpreting from PC " << pc_ << endl;
+    }
+    StartLoopCheck();
+    for (int address = 0; address < memory_size_; ++address) {
+      decoded_[address] = DABnamespace::DecodeWord(memory_[address], address);
+    }
+    for (int address = 0; address < memory_size_; ++address) {
+      FuseAt(address);
+    }
+  }
+
+#ifdef EBUG
+  Utils::log_stream << "leave InterpretJit" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'InterpretThreaded'.
+ * This function is the direct-threaded alternative to the loop in
+ * 'Interpret', selected with 'SetEngine(kThreadedEngine)'.
+ *
+ * With GNU compilers the program is first threaded into an array holding,
+ * for each word, the address of the code that executes it, and each
+ * handler ends by jumping straight to the handler for the next PC
+ * (computed 'goto'), so there is no central loop or switch to go through.
+ * Superinstructions get handlers of their own, and anything that stores
+ * rethreads the words whose handlers the store may have changed.  Other
+ * compilers get the dense switch of 'Execute'.
+ *
+ * The trace written to the log is exactly that of 'Interpret'.
+ *
+ * Parameters:
+ *   data_scanner - the 'Scanner', needed for the 'RD' instruction
+ *   out_stream - the output stream , needed for the 'WRT' instruction
+**/
+template <class Trace>
+void Interpreter<Trace>::InterpretThreaded(Scanner& data_scanner,
+                                           ofstream& out_stream) {
+#ifdef EBUG
+  Utils::log_stream << "enter InterpretThreaded" << endl;
+#endif
+#if defined(__GNUC__)
+  // Indexed by 'DABnamespace::Opcode' and then 'Superinstruction'.
+  static void* const kHandlers[DABnamespace::kHandlerCount] = {
+    &&do_ban, &&do_sub, &&do_stc, &&do_and, &&do_add, &&do_ld, &&do_br,
+    &&do_stp, &&do_rd, &&do_wrt, &&do_nop,
+    &&do_rdstc, &&do_ldaddstc, &&do_ldadd, &&do_addstc, &&do_subban,
+    &&do_addban, &&do_ldwrt
+  };
+
+  void* threaded[DABnamespace::kMaxMemory];
+  for (int address = 0; address < memory_size_; ++address) {
+    threaded[address] = kHandlers[decoded_[address].handler];
+  }
+  int address = 0;
+
+#define DISPATCH()                            \
+  do {                                        \
+    if (pc_ >= memory_size_) goto done;       \
+    if (steps_left_ <= 0) goto done;          \
+    TraceMachine();                           \
+    goto *threaded[pc_];                      \
+  } while (0)
+
+  // An 'STC' can change the handler of the word it wrote and of the two
+  // words before it, which may have been fused with it.
+#define RETHREAD()                                                   \
+  do {                                                               \
+    if (last_store_ < memory_size_) {                                \
+      for (address = std::max(0, last_store_ - 2);                   \
+           address <= last_store_; ++address) {                      \
+        threaded[address] = kHandlers[decoded_[address].handler];    \
+      }                                                              \
+    }                                                                \
+  } while (0)
+
+  DISPATCH();
+
+do_ban:
+  DoBAN(decoded_[pc_]);
+  ++pc_;
+  DISPATCH();
+do_sub:
+  DoSUB(decoded_[pc_]);
+  ++pc_;
+  DISPATCH();
+do_stc:
+  DoSTC(decoded_[pc_]);
+  RETHREAD();
+  ++pc_;
+  DISPATCH();
+do_and:
+  DoAND(decoded_[pc_]);
+  ++pc_;
+  DISPATCH();
+do_add:
+  DoADD(decoded_[pc_]);
+  ++pc_;
+  DISPATCH();
+do_ld:
+  DoLD(decoded_[pc_]);
+  ++pc_;
+  DISPATCH();
+do_br:
+  DoBR(decoded_[pc_]);
+  ++pc_;
+  DISPATCH();
+do_stp:
+  DoSTP();
+  ++pc_;
+  goto done;  // the PC is past any program
+do_rd:
+  DoRD(data_scanner);
+  ++pc_;
+  DISPATCH();
+do_wrt:
+  DoWRT(out_stream);
+  ++pc_;
+  DISPATCH();
+do_nop:
+  ++pc_;
+  DISPATCH();
+do_rdstc:
+  DoRDSTC(data_scanner);
+  RETHREAD();
+  ++pc_;
+  DISPATCH();
+do_ldaddstc:
+  DoLDADDSTC();
+  RETHREAD();
+  ++pc_;
+  DISPATCH();
+do_ldadd:
+  DoLDADD();
+  ++pc_;
+  DISPATCH();
+do_addstc:
+  DoADDSTC();
+  RETHREAD();
+  ++pc_;
+  DISPATCH();
+do_subban:
+  DoSUBBAN();
+  ++pc_;
+  DISPATCH();
+do_addban:
+  DoADDBAN();
+  ++pc_;
+  DISPATCH();
+do_ldwrt:
+  DoLDWRT(out_stream);
+  ++pc_;
+  DISPATCH();
+
+done:
+#undef RETHREAD
+#undef DISPATCH
+  ;
+#else
+  while (pc_ < memory_size_ && steps_left_ > 0) {
+    Execute(decoded_[pc_], data_scanner, out_stream);
+    ++pc_;
+  }
+#endif
+
+#ifdef EBUG
+  Utils::log_stream << "leave InterpretThreaded" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Functions 'JitRead' and 'JitWrite'.
+ * The 'RD' and 'WRT' call outs for code compiled by 'InterpretJit'.
+**/
+template <class Trace>
+int Interpreter<Trace>::JitRead(JitContext* context) {
+  Interpreter* self = static_cast<Interpreter*>(context->owner);
+  self->accum_ = context->accum;
+  self->executed_count_ = context->executed_count;
+  if (!self->DoRD(*static_cast<Scanner*>(context->input))) {
+    // The compiled code had counted the 'RD', which 'DoRD' took back, but
+    // not traced it, so it is traced when it is run again.
+    context->executed_count = self->executed_count_;
+    self->is_resuming_ = false;
+    return 1;
+  }
+  context->accum = self->accum_;
+  return 0;
+}
+
+template <class Trace>
+void Interpreter<Trace>::JitWrite(JitContext* context) {
+  Interpreter* self = static_cast<Interpreter*>(context->owner);
+  self->accum_ = context->accum;
+  self->DoWRT(*static_cast<ofstream*>(context->output));
+}
+
+/***************************************************************************
+ * Function 'LoadProgram'.
+ * This top level function puts a program into memory in place of whatever
+ * was there, so that one interpreter can run one program after another.
+ * The machine is cleared, with memory back to zero and every trace
+ * dropped, and the words are then loaded, each logged as the 'READ' line
+ * of the word it was read from.
+ *
+ * Parameters:
+ *   image - the words of the program, as from 'ReadImage'
+**/
+template <class Trace>
+void Interpreter<Trace>::LoadProgram(const vector<uint16_t>& image) {
+#ifdef EBUG
+  Utils::log_stream << "enter LoadProgram" << endl;
+#endif
+
+  ResetMachine();
+  std::fill(memory_, memory_ + DABnamespace::kMaxMemory, 0);
+  for (size_t address = 0; address < image.size(); ++address) {
+    memory_[memory_size_++] = image[address];
+  }
+  pc_ = memory_size_;
+
+  // Decode every word once, so that 'Interpret' never has to look at
+  // the bits of an instruction again, and then fuse superinstructions.
+  decoded_.resize(memory_size_);
+  for (int address = 0; address < memory_size_; ++address) {
+    decoded_[address] = DABnamespace::DecodeWord(memory_[address], address);
+  }
+  for (int address = 0; address < memory_size_; ++address) {
+    FuseAt(address);
+  }
+
+  if (Trace::kSteps) {
+    LogLoad();
+  }
+
+#ifdef EBUG
+  Utils::log_stream << "leave LoadProgram" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'LogLoad'.
+ * Write the lines for a program as it is loaded: each word as it was read,
+ * and then the machine.
+**/
+template <class Trace>
+void Interpreter<Trace>::LogLoad() {
+  for (int address = 0; address < memory_size_; ++address) {
+    Utils::log_stream << "READ " << address + 1 << " " << address + 1 << " "
+                      << DABnamespace::DecToBitString(memory_[address], 16)
+                      << endl;
+  }
+  Utils::log_stream << this->ToString() << endl;
+}
+
+/***************************************************************************
+ * Function 'LogRecord'.
+ * Write one line of the trace, or hand it to the writer thread if the
+ * trace policy is asynchronous.  A 'kStoreRecord' writes nothing; it only
+ * keeps the writer's copy of memory up to date.
+**/
+template <class Trace>
+void Interpreter<Trace>::LogRecord(int kind, int flag, int address,
+                                   int value) {
+  TraceRecord record = { static_cast<uint8_t>(kind),
+                         static_cast<uint8_t>(flag),
+                         static_cast<uint16_t>(address), value };
+  if (Trace::kAsync) {
+    log_sink_->Put(record);
+  } else {
+    string line = "";
+    AsyncLogSink::AppendLine(record, memory_, line);
+    Utils::log_stream << line;
+  }
+}
+
+/***************************************************************************
+ * Function 'ReadImage'.
+ * This reads the ASCII of the machine code, one line at a time, uses the
+ * input to create an instance of 'OneMemoryWord', and appends its bits to
+ * 'image'.  It writes nothing to the log, so an image can be read once and
+ * then loaded into any number of interpreters with 'LoadProgram'.
+ *
+ * Parameters:
+ *   in_scanner - the scanner to read for source code
+ *   image - the words of the program, in order
+ *
+ * Returns:
+ *   false if the program is too big for memory, with only what fits read
+**/
+template <class Trace>
+bool Interpreter<Trace>::ReadImage(Scanner& in_scanner,
+                                   vector<uint16_t>& image) {
+  image.clear();
+  while (in_scanner.HasNext()) {
+    string line = in_scanner.NextLine();
+    if (image.size() >= static_cast<size_t>(DABnamespace::kMaxMemory)) {
+      Utils::log_stream << "The program is too big for memory" << endl;
+      return false;
+    }
+    OneMemoryWord one_word = OneMemoryWord(line);
+    image.push_back(one_word.GetBitPattern());
+  }
+  return true;
 }
 
 /***************************************************************************
  * Function 'ReadProgram'.
- * This top level function reads the ASCII of the machine code, one line
- * at a time, uses the input to create an instance of 'OneMemoryWord', and
- * stores that instance into memory.
+ * This top level function reads the ASCII of the machine code with
+ * 'ReadImage' and loads it with 'LoadProgram'.
  *
  * Parameters:
  *   in_scanner - the scanner to read for source code
+ *
+ * Returns:
+ *   false if the program is too big for memory, and nothing is loaded
 **/
-void Interpreter::ReadProgram(Scanner& in_scanner) {
+template <class Trace>
+bool Interpreter<Trace>::ReadProgram(Scanner& in_scanner) {
 #ifdef EBUG
   Utils::log_stream << "enter ReadProgram" << endl;
 #endif
 
+  vector<uint16_t> image;
+  bool is_whole = ReadImage(in_scanner, image);
+  if (is_whole) {
+    LoadProgram(image);
+  }
+
+#ifdef EBUG
+  Utils::log_stream << "leave ReadProgram" << endl;
+#endif
+  return is_whole;
+}
+
+/***************************************************************************
+ * Function 'RecordStep'.
+ * Add the handler just executed at 'address' to the trace being recorded,
+ * and compile the trace when the PC is back at its head.
+ *
+ * Recording is given up if the trace gets too long or execution leaves
+ * the program; the loop is then not tried again.
+ *
+ * Parameter:
+ *   address - the address of the handler, with 'pc_' now its successor
+**/
+template <class Trace>
+void Interpreter<Trace>::RecordStep(int address) {
+#ifdef EBUG
+  Utils::log_stream << "enter RecordStep" << endl;
+#endif
+  HotTraces& hot = *hot_;
+  if (pc_ >= memory_size_
+      || hot.recording.size() >= static_cast<size_t>(kMaxTraceLength)) {
+    hot.trace_at[hot.recording_head] = kUntraceable;
+    hot.recording.clear();
+    hot.recording_head = kNoTrace;
+  } else {
+    TraceStep step;
+    step.address = static_cast<uint16_t>(address);
+    step.next = static_cast<uint16_t>(pc_);
+    hot.recording.push_back(step);
+    hot.in_trace[address] = true;
+    if (pc_ == hot.recording_head) {
+      CompileTrace();
+    }
+  }
+#ifdef EBUG
+  Utils::log_stream << "leave RecordStep" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'ResetLoopCheck'.
+ * Start 'CheckLoop' over, after an 'RD' has changed the machine in a way
+ * that does not follow from what it was.
+**/
+template <class Trace>
+void Interpreter<Trace>::ResetLoopCheck() {
+  loop_countdown_ = loop_check_every_;
+  loop_power_ = 1;
+  loop_length_ = 0;
+  saved_pc_ = -1;
+}
+
+/***************************************************************************
+ * Function 'ResetMachine'.
+ * Start over with an empty machine, with no words written and no traces,
+ * for a program to be loaded.  Memory itself is left for the caller.
+**/
+template <class Trace>
+void Interpreter<Trace>::ResetMachine() {
   accum_ = 0;
   pc_ = 0;
+  entry_pc_ = 0;
+  entry_executed_count_ = 0;
+  memory_size_ = 0;
+  decoded_.clear();
+  last_store_ = 0;
+  for (size_t sub = 0; sub < written_words_.size(); ++sub) {
+    is_written_[written_words_[sub]] = false;
+  }
+  written_words_.clear();
+  input_lines_.clear();
+  output_.clear();
+  is_running_ = false;
+  is_resuming_ = false;
+  DropTraces();
+}
 
-  // Read the lines of the ASCII version of the executable and put the
-  // ASCII into a 'vector' of 'OneMemoryWord' instances.
-  int linesub = 0;
-  while (in_scanner.HasNext()) {
-    string line = in_scanner.NextLine();
-    OneMemoryWord one_word = OneMemoryWord(line);
-    memory_.push_back(one_word);
-    ++linesub;
+/***************************************************************************
+ * Function 'RestoreSnapshot'.
+ * Load the machine saved in 'snapshot' by 'SaveSnapshot', leaving this
+ * interpreter as 'LoadProgram' would have, with the same lines in the log,
+ * except that 'Interpret' starts at the PC and accumulator of the snapshot.
+ *
+ * The decoded instructions are copied as they are, fused or not as they
+ * were when the snapshot was saved.
+ *
+ * Parameter:
+ *   snapshot - the machine to load
+**/
+template <class Trace>
+void Interpreter<Trace>::RestoreSnapshot(const MachineSnapshot& snapshot) {
+#ifdef EBUG
+  Utils::log_stream << "enter RestoreSnapshot" << endl;
+#endif
+
+  ResetMachine();
+  memory_size_ = snapshot.memory_size;
+  pc_ = memory_size_;
+  entry_pc_ = snapshot.pc;
+  entry_executed_count_ = snapshot.executed_count;
+  accum_ = snapshot.accum;
+  std::memcpy(memory_, snapshot.memory, sizeof(memory_));
+  decoded_.assign(snapshot.decoded, snapshot.decoded + memory_size_);
+
+  if (Trace::kSteps) {
+    LogLoad();
+  }
+
+#ifdef EBUG
+  Utils::log_stream << "leave RestoreSnapshot" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'RunPrefix'.
+ * Run the loaded program on from its entry as far as the first 'RD' or
+ * 'WRT', or for 'limit' instructions, and make where it stops the entry
+ * for 'Interpret', so that whatever a program does before it reads or
+ * writes is done once here, and once only for every run that starts from
+ * a snapshot saved after this.
+ *
+ * Those instructions are not in the log of the run, so for a trace policy
+ * that logs each instruction this does nothing.  Superinstructions are
+ * run one instruction at a time, so the prefix can stop inside one.  If
+ * 'CheckLoop' finds the prefix in an infinite loop, the machine is put
+ * back as it was loaded, so that the run finds the loop, and logs it,
+ * after the same instructions that every trace policy counts.
+ *
+ * Parameter:
+ *   limit - the most instructions to run
+**/
+template <class Trace>
+void Interpreter<Trace>::RunPrefix(int64_t limit) {
+  if (kTracesEachStep) {
+    return;
+  }
+#ifdef EBUG
+  Utils::log_stream << "enter RunPrefix" << endl;
+#endif
+
+  // Neither is used, since no 'RD' or 'WRT' is run.
+  Scanner no_data_scanner;
+  ofstream no_out_stream;
+
+  std::unique_ptr<MachineSnapshot> loaded;
+  if (loop_check_every_ > 0) {
+    loaded.reset(new MachineSnapshot());
+    SaveSnapshot(*loaded);
+    StartLoopCheck();
+  }
+  is_in_prefix_ = true;
+  steps_left_ = INT64_MAX;
+  pc_ = entry_pc_;
+  int64_t count = 0;
+  while (count < limit && steps_left_ > 0 && pc_ < memory_size_
+         && decoded_[pc_].opcode != DABnamespace::kRD
+         && decoded_[pc_].opcode != DABnamespace::kWRT) {
+    DecodedInstruction inst = decoded_[pc_];
+    inst.handler = inst.opcode;
+    Execute(inst, no_data_scanner, no_out_stream);
     ++pc_;
-    Utils::log_stream << "READ " << linesub << " " << pc_ << " "
-                      << line << endl;
+    ++count;
+  }
+  is_in_prefix_ = false;
+  if (steps_left_ > 0) {
+    entry_pc_ = pc_;
+    entry_executed_count_ += count;
+  } else {
+    RestoreSnapshot(*loaded);
   }
 
-  Utils::log_stream << this->ToString() << endl;
+  // The loaded machine shows its PC as the size of the program.
+  pc_ = memory_size_;
+  executed_count_ = 0;
 
 #ifdef EBUG
-  Utils::log_stream << "leave ReadProgram" << endl;
+  Utils::log_stream << "leave RunPrefix" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'RunTrace'.
+ * Run the compiled trace 'index', round and round, until it is left.
+ *
+ * The accumulator is kept in a local, and the instructions are done here
+ * as their handlers would do them, without looking up the PC, checking it
+ * against the size of the program, or tracing the machine; the budget and
+ * the count of instructions are kept a trip at a time, and only a trip
+ * that fits in what is left of the budget is started.  The trace is left
+ * where a guard finds the PC not where it was when the trace was recorded,
+ * after a store that dropped the traces, or where an 'RD' finds no data
+ * or a streaming 'WRT' has output, with the PC where execution goes next.
+ * Each branch back is checked by 'CheckLoop' as it is made, with the PC
+ * and accumulator that 'DoBAN' and 'DoBR' would give it, so that a loop
+ * is found at the same instruction with hot traces on or off, and the
+ * trace is left there if it is.
+ *
+ * Parameters:
+ *   index - the trace, in 'hot_->traces'
+ *   data_scanner - the 'Scanner', needed for the 'RD' instruction
+ *   out_stream - the output stream , needed for the 'WRT' instruction
+ *
+ * Returns:
+ *   false if not even one trip fits the budget, and nothing was run
+**/
+template <class Trace>
+bool Interpreter<Trace>::RunTrace(int index, Scanner& data_scanner,
+                                  ofstream& out_stream) {
+#ifdef EBUG
+  Utils::log_stream << "enter RunTrace" << endl;
 #endif
+  const CompiledTrace& trace = hot_->traces[index];
+  if (steps_left_ < trace.length) {
+    return false;
+  }
+  const TraceOp* ops = trace.ops.data();
+  const int op_count = static_cast<int>(trace.ops.size());
+  const int generation = trace_generation_;
+  const int head = pc_;
+  int accum = accum_;
+  int counted = 0;  // instructions of this trip already counted
+  int done = 0;  // instructions of this trip run, once it is left
+  int next = head;  // the PC, once it is left
+  is_resuming_ = false;  // an 'RD' at the head is counted here
+
+  while (steps_left_ >= trace.length) {
+    int sub = 0;
+    for (; sub < op_count; ++sub) {
+      const TraceOp& op = ops[sub];
+      switch (op.inst.opcode) {
+        case DABnamespace::kLD:
+          accum = memory_[GetTargetLocation(op.inst)] & 0x0FFF;
+          continue;
+        case DABnamespace::kADD:
+          accum = TwosComplementInteger(accum)
+                  + TwosComplementInteger(memory_[GetTargetLocation(op.inst)]);
+          continue;
+        case DABnamespace::kSUB:
+          accum -= memory_[GetTargetLocation(op.inst)] & 0x0FFF;
+          continue;
+        case DABnamespace::kAND:
+          accum &= memory_[GetTargetLocation(op.inst)];
+          continue;
+        case DABnamespace::kBAN:
+        case DABnamespace::kBR:  // a direct one only if it goes back
+          next = (op.inst.opcode == DABnamespace::kBR || accum < 0)
+                   ? GetTargetLocation(op.inst) + 1 : op.address + 1;
+          if (next <= op.address && loop_check_every_ > 0) {
+            accum_ = accum;
+            pc_ = next - 1;  // as 'DoBAN' and 'DoBR' leave it
+            CheckLoop();
+            if (steps_left_ == 0) {  // stopped in a loop
+              done = op.step;
+              break;
+            }
+          }
+          if (next == op.next) continue;
+          done = op.step;
+          break;
+        case DABnamespace::kSTC: {
+          int location = GetTargetLocation(op.inst);
+          if (loop_check_every_ > 0) {
+            memory_hash_ += HashWord(location, static_cast<uint16_t>(accum))
+                            - HashWord(location, memory_[location]);
+          }
+          memory_[location] = static_cast<uint16_t>(accum);
+          accum = 0;
+          last_store_ = location;
+          if (location >= memory_size_) continue;
+          // This may drop the traces, 'op' with them.
+          next = op.address + 1;
+          done = op.step;
+          DecodeAt(location);
+          if (trace_generation_ == generation) continue;
+          break;
+        }
+        case DABnamespace::kRD:
+          CountSteps(op.step - counted);
+          counted = op.step;
+          accum_ = accum;
+          pc_ = op.address;
+          if (DoRD(data_scanner)) {
+            accum = accum_;
+            continue;
+          }
+          next = op.address;  // to be read again, and counted then
+          done = op.step;
+          break;
+        case DABnamespace::kWRT:
+          CountSteps(op.step - counted);
+          counted = op.step;
+          accum_ = accum;
+          DoWRT(out_stream);
+          if (!is_streaming_) continue;
+          next = op.address + 1;
+          done = op.step;
+          break;
+        default:
+          continue;
+      }
+      break;  // the trace is left
+    }
+    if (sub < op_count) {
+      CountSteps(done - counted);
+      break;
+    }
+
+    CountSteps(trace.length - counted);
+    counted = 0;
+    next = head;
+  }
+
+  accum_ = accum;
+  pc_ = next;
+#ifdef EBUG
+  Utils::log_stream << "leave RunTrace" << endl;
+#endif
+  return true;
+}
+
+/***************************************************************************
+ * Function 'SaveSnapshot'.
+ * Save the loaded machine in 'snapshot', as the next 'Interpret' would
+ * start it, for 'RestoreSnapshot'.  This is meant for a machine that has
+ * been loaded and not yet run.
+ *
+ * Parameter:
+ *   snapshot - where to save the machine
+**/
+template <class Trace>
+void Interpreter<Trace>::SaveSnapshot(MachineSnapshot& snapshot) const {
+  snapshot.memory_size = memory_size_;
+  snapshot.pc = entry_pc_;
+  snapshot.executed_count = entry_executed_count_;
+  snapshot.accum = accum_;
+  std::memcpy(snapshot.memory, memory_, sizeof(memory_));
+  std::copy(decoded_.begin(), decoded_.end(), snapshot.decoded);
+}
+
+/***************************************************************************
+ * Function 'StartLoopCheck'.
+ * Hash all of memory for 'CheckLoop', and start it over.
+**/
+template <class Trace>
+void Interpreter<Trace>::StartLoopCheck() {
+  memory_hash_ = 0;
+  for (int address = 0; address < DABnamespace::kMaxMemory; ++address) {
+    memory_hash_ += HashWord(address, memory_[address]);
+  }
+  ResetLoopCheck();
+}
+
+/***************************************************************************
+ * Function 'TakeOutput'.
+ * Move what a streaming machine has written into 'output'.
+**/
+template <class Trace>
+void Interpreter<Trace>::TakeOutput(string& output) {
+  output.swap(output_);
+  output_.clear();
+}
+
+/***************************************************************************
+ * Function 'TraceDiff'.
+ * Write what has changed in the machine since the last instruction, for a
+ * 'kDiff' trace policy:  a 'STEP' line with the count of instructions so
+ * far, the PC, and the accumulator as it is held, and then a 'WROTE' line
+ * with each word that has been written.  Every 'kKeyframeInterval'
+ * instructions this is instead a 'KEYFRAME' line and the whole machine,
+ * as 'ToString' prints it.
+ *
+ * 'Tprog -step' puts the machine at any step back together from this.
+**/
+template <class Trace>
+void Interpreter<Trace>::TraceDiff() {
+  if (executed_count_ >= next_keyframe_) {
+    Utils::log_stream << "KEYFRAME STEP " << executed_count_ << " PC " << pc_
+                      << " ACC " << accum_ << '\n' << ToString() << '\n';
+    next_keyframe_ = executed_count_ + kKeyframeInterval;
+  } else {
+    Utils::log_stream << "STEP " << executed_count_ << " PC " << pc_
+                      << " ACC " << accum_ << '\n';
+    for (size_t sub = 0; sub < written_words_.size(); ++sub) {
+      int address = written_words_[sub];
+      Utils::log_stream << "WROTE " << address << " "
+                        << DABnamespace::DecToBitString(memory_[address], 16)
+                        << '\n';
+    }
+  }
+  for (size_t sub = 0; sub < written_words_.size(); ++sub) {
+    is_written_[written_words_[sub]] = false;
+  }
+  written_words_.clear();
+}
+
+/***************************************************************************
+ * Function 'TraceMachine'.
+ * This is done before every instruction that is interpreted: write the
+ * whole machine to the log, or count the instruction for the summary, as
+ * the trace policy says.  An 'RD' that waited for input was traced when
+ * it first ran, so when it is run again it is only counted.
+**/
+template <class Trace>
+void Interpreter<Trace>::TraceMachine() {
+  --steps_left_;
+  if (is_resuming_) {
+    is_resuming_ = false;
+    if (Trace::kSummary || Trace::kDiff || Trace::kSampled) {
+      ++executed_count_;
+    }
+    return;
+  }
+  if (Trace::kMachine && Trace::kAsync) {
+    LogRecord(kMachineRecord, 0, pc_, accum_);
+  } else if (Trace::kMachine) {
+    Utils::log_stream << ToString() << '\n';
+  }
+  if (Trace::kSummary || Trace::kDiff || Trace::kSampled) {
+    ++executed_count_;
+  }
+  if (Trace::kDiff) {
+    TraceDiff();
+  }
+  if (Trace::kSampled
+      && (executed_count_ >= next_sample_
+          || (!is_snapshot_pc_.empty() && is_snapshot_pc_[pc_])
+          || (sample_milliseconds_ > 0
+              && executed_count_ % kClockInterval == 0
+              && std::chrono::steady_clock::now() >= next_sample_time_))) {
+    TraceSnapshot();
+  }
+  if (Trace::kBinary) {
+    trace_writer_->Instruction(pc_, memory_[pc_], accum_,
+                               GetTargetLocation(decoded_[pc_]));
+  }
+}
+
+/***************************************************************************
+ * Function 'TraceSnapshot'.
+ * Write a 'SNAPSHOT' line with the count of instructions so far and then
+ * the whole machine, for a 'kSampled' trace policy, and work out when the
+ * next one is due.  The log is flushed so that a long run can be watched.
+**/
+template <class Trace>
+void Interpreter<Trace>::TraceSnapshot() {
+  Utils::log_stream << "SNAPSHOT STEP " << executed_count_ << '\n'
+                    << ToString() << endl;
+  if (executed_count_ >= next_sample_) {
+    next_sample_ = executed_count_ + sample_every_;
+  }
+  if (sample_milliseconds_ > 0) {
+    next_sample_time_ = std::chrono::steady_clock::now()
+                        + std::chrono::milliseconds(sample_milliseconds_);
+  }
 }
 
 /***************************************************************************
@@ -532,35 +2020,18 @@ void Interpreter::ReadProgram(Scanner& in_scanner) {
  * Returns:
  *   the prettyprint string for printing
 **/
-string Interpreter::ToString() {
+template <class Trace>
+string Interpreter<Trace>::ToString() {
 #ifdef EBUG
   Utils::log_stream << "enter ToString" << endl;
 #endif
 
-  string stars40 = "********* ********* ********* ********* ";
-  string sss = "\n" + stars40 + stars40 + "\n";
-  sss += "MACHINE IS NOW\n";
-
-  sss += "PC    " + Utils::Format(pc_, 8) + "\n";
-
-  int twoscomplement = this->TwosComplementInteger(accum_);
-  sss += "ACCUM " + Utils::Format(twoscomplement, 8)
-                  + " " + DABnamespace::DecToBitString(accum_, 16)
-                  + "\n\n";
-
-  int memorysize = memory_.size();
-  for (int outersub = 0; outersub < memorysize; outersub += 4) {
-    sss += "MEM " + Utils::Format(outersub, 4)
-                + "-"
-                + Utils::Format(outersub+3, 4);
-    for (int innersub = outersub; innersub < outersub + 4; ++innersub) {
-      if (innersub < memorysize) {
-        sss += " " + memory_.at(innersub).GetBitPattern();
-      }
-    }
-    sss += "\n";
+  string sss = "";
+  AsyncLogSink::AppendMachineHeader(pc_, accum_, sss);
+  for (int outersub = 0; outersub < memory_size_; outersub += 4) {
+    AsyncLogSink::AppendMemoryLine(outersub, memory_, memory_size_, sss);
   }
-  sss += "\n" + stars40 + stars40;
+  sss += AsyncLogSink::kMachineTrailer;
 
 #ifdef EBUG
   Utils::log_stream << "leave ToString" << endl;
@@ -581,12 +2052,13 @@ string Interpreter::ToString() {
  * Returns:
  *   the converted value
 **/
-int Interpreter::TwosComplementInteger(int what) {
+template <class Trace>
+int Interpreter<Trace>::TwosComplementInteger(int what) {
 #ifdef EBUG
   Utils::log_stream << "enter TwosComplementInteger" << endl;
 #endif
 
-  int twoscomplement = (what > 32768) ? what - 65536 : what;
+  int twoscomplement = DABnamespace::TwosComplement(what);
 
 #ifdef EBUG
   Utils::log_stream << "leave TwosComplementInteger" << endl;
@@ -594,3 +2066,43 @@ int Interpreter::TwosComplementInteger(int what) {
 
   return twoscomplement;
 }
+
+/***************************************************************************
+ * Function 'WriteCpp'.
+ * Write the program as it was read in as a C++ translation unit that runs
+ * it natively; see 'Recompiler'.
+ *
+ * Parameters:
+ *   cpp_stream - the stream for the C++ source
+ *   source_name - the name of the 'a.out' file the program came from
+**/
+template <class Trace>
+void Interpreter<Trace>::WriteCpp(ofstream& cpp_stream,
+                                  string source_name) const {
+#ifdef EBUG
+  Utils::log_stream << "enter WriteCpp" << endl;
+#endif
+
+  Recompiler recompiler;
+  recompiler.Translate(memory_, memory_size_);
+  recompiler.WriteCpp(cpp_stream, source_name);
+
+#ifdef EBUG
+  Utils::log_stream << "leave WriteCpp" << endl;
+#endif
+}
+
+// The trace policies that 'main' can choose from.
+template class Interpreter<FullTrace>;
+template class Interpreter<AsyncFullTrace>;
+template class Interpreter<SummaryTrace>;
+template class Interpreter<NoTrace>;
+template class Interpreter<BinaryTrace>;
+template class Interpreter<DiffTrace>;
+template class Interpreter<SampledTrace>;
+
+// Everything a trace policy or an option needs beyond memory itself is
+// made only when it is used, so a plain interpreter stays small.
+static_assert(sizeof(Interpreter<NoTrace>)
+                <= DABnamespace::kMaxMemory * sizeof(uint16_t) + 1024,
+              "Interpreter<NoTrace> should be little more than its memory");
@@ -9,8 +9,15 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -25,66 +32,243 @@ using std::vector;
 #include "./Utilities/scanline.h"
 #include "./Utilities/utils.h"
 
+#include "asynclogsink.h"
+#include "bintrace.h"
 #include "dabnamespace.h"
 #include "onememoryword.h"
 #include "hex.h"
+#include "jitcompiler.h"
+#include "machinesnapshot.h"
+#include "recompiler.h"
+#include "tracepolicy.h"
 
+using DABnamespace::DecodedInstruction;
+using DABnamespace::HashWord;
+
+// The execution engines that 'Interpret' can use.
+enum Engine { kSwitchEngine, kThreadedEngine, kJitEngine };
+
+// How a call to 'Interpret' ended.  A run that is out of budget or
+// waiting for input goes on with the next call, or is ended with
+// 'AbandonRun'.
+enum RunStatus {
+  kRunFinished,         // past the end of the program, as after 'STP'
+  kRunOutOfBudget,      // the instructions allowed have been run
+  kRunWaitingForInput,  // an 'RD' found no data, and the PC is at it
+  kRunHasOutput,        // a 'WRT' left output for 'TakeOutput', if streaming
+  kRunError             // it cannot go on, as in an infinite loop
+};
+
+/****************************************************************
+ * The interpreter, for a trace policy from 'tracepolicy.h' that
+ * says what it writes to the log.  The member functions are
+ * compiled for each of those policies in 'pullet16interpreter.cc'.
+**/
+template <class Trace>
 class Interpreter {
  public:
   Interpreter();
   virtual ~Interpreter();
 
+  int GetAccum() const;
+  int64_t GetExecutedCount() const;
+  int GetPC() const;
+
+  void SetEngine(Engine engine);
+  void SetFusion(bool fusion);
+  void SetHotTraces(bool hot_traces);
+  void SetLoopCheck(int64_t every);
+  void SetSampling(int64_t every, int milliseconds);
+  void SetSnapshotAt(int address);
+  void SetStreaming(bool is_streaming);
+  void SetTraceStream(std::ostream& trace_stream);
+
+  void AbandonRun();
+  void AbandonRun(RunStatus status);
   void DumpProgram(ofstream& out_stream);
-  void Interpret(Scanner& data_scanner, ofstream& out_stream);
-  void ReadProgram(Scanner& infile_scanner);
+  void Feed(const string& line);
+  RunStatus Interpret(Scanner& data_scanner, ofstream& out_stream);
+  RunStatus Interpret(Scanner& data_scanner, ofstream& out_stream,
+                      int64_t budget);
+  void LoadProgram(const vector<uint16_t>& image);
+  bool ReadProgram(Scanner& infile_scanner);
+  void RestoreSnapshot(const MachineSnapshot& snapshot);
+  void RunPrefix(int64_t limit);
+  void SaveSnapshot(MachineSnapshot& snapshot) const;
+  void TakeOutput(string& output);
+  void WriteCpp(ofstream& cpp_stream, string source_name) const;
+
+  static bool ReadImage(Scanner& in_scanner, vector<uint16_t>& image);
 
  private:
   static const int kMaxInstrCount = 128;
-  static const int kPCForStop = 65537;  // 16-bit overflow value
+  static const int kHotLoopCount = 64;  // backward branches to a hot loop
+  static const int kMaxTraceLength = 512;
+  static const int kNoTrace = -1;
+  static const int kUntraceable = -2;
+  static const int kKeyframeInterval = 1024;  // instructions, for 'kDiff'
+  static const int kClockInterval = 4096;  // instructions between clocks
+  static const int64_t kDefaultLoopCheck = 16;  // branches back per check
+
+  // Whether the trace policy writes something for every instruction,
+  // which must then go through 'TraceMachine' one at a time.
+  static constexpr bool kTracesEachStep = Trace::kMachine || Trace::kSteps
+                                          || Trace::kBinary || Trace::kDiff
+                                          || Trace::kSampled;
+
+  /****************************************************************
+   * One step of a trace being recorded: the address of the handler
+   * that was dispatched, and 'next', the PC that followed it.
+  **/
+  struct TraceStep {
+    uint16_t address;
+    uint16_t next;
+  };
+
+  /****************************************************************
+   * One instruction of a compiled trace, with superinstructions
+   * taken apart: the instruction at 'address' as it was decoded,
+   * 'next', the PC that followed it when it was recorded, and
+   * 'step', how many instructions of the trip are done with it.
+   * Only a branch whose successor depends on the accumulator or on
+   * memory, or an 'STC', 'RD', or 'WRT', can leave the trace.
+  **/
+  struct TraceOp {
+    DecodedInstruction inst;
+    uint16_t address;
+    uint16_t next;
+    uint16_t step;
+  };
+
+  // One trip around a hot loop, compiled by 'CompileTrace'.
+  struct CompiledTrace {
+    vector<TraceOp> ops;
+    int length;  // instructions in a trip
+  };
+
+  /****************************************************************
+   * What the 'switch' loop keeps to find, record, and run hot loops,
+   * one entry to a word of the program.  It is only made once a loop
+   * is seen with hot traces on and a trace policy that does not write
+   * every instruction, and is thrown away by 'DropTraces'.
+  **/
+  struct HotTraces {
+    vector<uint8_t> loop_counts;
+    vector<int16_t> trace_at;
+    vector<uint8_t> in_trace;
+    int recording_head;
+    vector<TraceStep> recording;
+    vector<CompiledTrace> traces;
+  };
+
+  Engine engine_;
+  bool fusion_;
+  bool hot_traces_;
 
   int pc_;
+  int entry_pc_;  // where 'Interpret' starts
   int accum_;
+  int memory_size_;
+  int last_store_;
+  int64_t executed_count_;
+  int64_t entry_executed_count_;  // run before 'entry_pc_'
+  int64_t steps_left_;  // of the budget, counted down by 'TraceMachine'
+  RunStatus stop_status_;  // why 'steps_left_' is zero
+  RunStatus status_;  // as last returned by 'Interpret'
+  bool is_running_;
+  bool is_resuming_;  // at an 'RD' that waited for input
+  int64_t next_keyframe_;
+
+  int64_t sample_every_;
+  int64_t next_sample_;
+  int sample_milliseconds_;
+  std::chrono::steady_clock::time_point next_sample_time_;
+  vector<bool> is_snapshot_pc_;  // made by the first 'SetSnapshotAt'
+  std::unique_ptr<AsyncLogSink> log_sink_;  // only if 'Trace::kAsync'
+  std::unique_ptr<BinaryTraceWriter> trace_writer_;  // if 'Trace::kBinary'
+  std::ostream* trace_stream_;
+
+  // For streaming: the lines that 'Feed' gave and 'DoRD' has yet to
+  // read, and what 'DoWRT' wrote and 'TakeOutput' has yet to take.
+  bool is_streaming_;
+  std::deque<string> input_lines_;
+  string output_;
 
   string ToString();
+  void TraceDiff();
+  void TraceMachine();
+  void TraceSnapshot();
+
+  uint16_t memory_[DABnamespace::kMaxMemory];
+  vector<DecodedInstruction> decoded_;  // one to a word of the program
 
-  vector<OneMemoryWord> memory_;
-
-  map<string, string> code_to_mnemonic_ = { {"000", "BAN"},
-                                            {"001", "SUB"},
-                                            {"010", "STC"},
-                                            {"011", "AND"},
-                                            {"100", "ADD"},
-                                            {"101", "LD "},
-                                            {"110", "BR "},
-                                            {"111", "EEE"}  // STP, RD, WRT 
-                                          };
-  map<string, string> mnemonic_to_code_ = { {"BAN", "000"},
-                                            {"SUB", "001"},
-                                            {"STC", "010"},
-                                            {"AND", "011"},
-                                            {"ADD", "100"},
-                                            {"LD ", "101"},
-                                            {"BR ", "110"},
-                                            {"STP", "111"},
-                                            {"RD ", "111"},
-                                            {"WRT", "111"}
-                                          };
-
-  string Decode(string the_ascii);
-  void DoADD(string addr, string target);
-  void DoAND(string addr, string target);
-  void DoBAN(string addr, string target);
-  void DoBR(string addr, string target);
-  void DoLD(string addr, string target);
-  void DoRD(Scanner& data_scanner);
-  void DoSTC(string addr, string target);
+  int trace_generation_;
+  std::unique_ptr<HotTraces> hot_;
+
+  // For 'InterpretJit': the code compiled for the last run, kept for the
+  // next run that starts from the same memory.
+  std::unique_ptr<JitCompiler> jit_;
+
+  // For 'kDiff': the words stored into since the last step.
+  vector<int> written_words_;
+  vector<bool> is_written_;  // only if 'Trace::kDiff'
+
+  // For 'CheckLoop': a hash of memory, kept up to date by 'DoSTC', and
+  // the machine that Brent's algorithm compares with, saved after
+  // 'loop_power_' checks.  The saved memory is only made at the first save.
+  // A loop found in 'RunPrefix' is not logged.
+  int64_t loop_check_every_;
+  int64_t loop_countdown_;
+  int64_t loop_power_;
+  int64_t loop_length_;
+  uint64_t memory_hash_;
+  uint64_t saved_hash_;
+  int saved_pc_;
+  int saved_accum_;
+  vector<uint16_t> saved_memory_;
+  bool is_in_prefix_;
+
+  void CheckLoop();
+  void CompileTrace();
+  void CountLoop(int head);
+  void CountSteps(int count);
+  void DecodeAt(int address);
+  void DoADD(const DecodedInstruction& inst);
+  void DoADDBAN();
+  void DoADDSTC();
+  void DoAND(const DecodedInstruction& inst);
+  void DoBAN(const DecodedInstruction& inst);
+  void DoBR(const DecodedInstruction& inst);
+  void DoLD(const DecodedInstruction& inst);
+  void DoLDADD();
+  void DoLDADDSTC();
+  void DoLDWRT(ofstream& out_stream);
+  bool DoRD(Scanner& data_scanner);
+  void DoRDSTC(Scanner& data_scanner);
+  void DoSTC(const DecodedInstruction& inst);
   void DoSTP();
-  void DoSUB(string addr, string target);
+  void DoSUB(const DecodedInstruction& inst);
+  void DoSUBBAN();
   void DoWRT(ofstream& out_stream);
-  void Execute(OneMemoryWord this_word,
+  void DrainLog();
+  void DropTraces();
+  void EndRun(RunStatus status);
+  void Execute(const DecodedInstruction& inst,
                Scanner& data_scanner, ofstream& out_stream);
-  void FlagAddressOutOfBounds(int address);
-  int GetTargetLocation(string address, string target);
+  void FuseAt(int address);
+  void InterpretJit(Scanner& data_scanner, ofstream& out_stream);
+  void InterpretThreaded(Scanner& data_scanner, ofstream& out_stream);
+  int GetTargetLocation(const DecodedInstruction& inst);
+  void LogLoad();
+  void LogRecord(int kind, int flag, int address, int value);
+  void RecordStep(int address);
+  void ResetLoopCheck();
+  void ResetMachine();
+  void StartLoopCheck();
+  bool RunTrace(int index, Scanner& data_scanner, ofstream& out_stream);
   int TwosComplementInteger(int value);
+
+  static int JitRead(JitContext* context);
+  static void JitWrite(JitContext* context);
 };
 #endif
@@ -0,0 +1,173 @@
+#include "pullet16machine.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'Pullet16Machine' for running a program in another program.
+ *
+ * This is what 'libpullet16' offers in place of 'Aprog': the program is
+ * an image in memory, the input is an array of values, the output is
+ * written into a 'string', and how the run ended comes back as a status,
+ * so nothing here reads or writes a file or calls 'exit'.  The output is
+ * the lines 'Aprog' writes to its output file.
+ *
+ * The machine is an 'Interpreter' set to streaming.  The input is fed to
+ * it as the lines of a data file, and each call to 'Interpret' goes on
+ * until a 'WRT', whose line is taken, or until the run is over; an 'RD'
+ * with no more input ends the run as out of data.  The budget, if there
+ * is one, is for the whole run, not for each call.
+ *
+ * 'Load' keeps the machine as loaded, and each 'Run' starts over from a
+ * copy of it, so one machine can run its program on any number of inputs.
+ * What the interpreter logs for a run, its summary line, comes back in
+ * the 'RunResult' rather than going to the log of the calling thread.  A
+ * machine is for one thread at a time; machines on different threads
+ * share nothing.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+Pullet16Machine::Pullet16Machine()
+    : budget_(INT64_MAX) {
+  interpreter_.SetStreaming(true);
+  Load(nullptr, 0);
+}
+
+/***************************************************************************
+ * Destructor
+**/
+Pullet16Machine::~Pullet16Machine() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Mutator for 'budget_', the most instructions a run may take, where
+ * 'INT64_MAX' is no limit.
+**/
+void Pullet16Machine::SetBudget(int64_t budget) {
+  budget_ = budget;
+}
+
+/***************************************************************************
+ * Mutator for the engine that runs the program.  The 'jit' engine runs
+ * only when there is no budget and the looks for an infinite loop have
+ * been turned off; otherwise 'Interpret' runs the 'switch' engine instead.
+**/
+void Pullet16Machine::SetEngine(Engine engine) {
+  interpreter_.SetEngine(engine);
+}
+
+/***************************************************************************
+ * Mutator for how many branches back there are between the looks for an
+ * infinite loop, where zero is never.
+**/
+void Pullet16Machine::SetLoopCheck(int64_t every) {
+  interpreter_.SetLoopCheck(every);
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Load'.
+ * Load the program whose words are 'words[0]' to 'words[count - 1]', as
+ * 'Interpreter::ReadImage' would have read them.
+ *
+ * Returns:
+ *   false if the program is too big for memory, and nothing is loaded
+**/
+bool Pullet16Machine::Load(const uint16_t* words, size_t count) {
+  if (count > static_cast<size_t>(DABnamespace::kMaxMemory)) {
+    return false;
+  }
+  vector<uint16_t> image(words, words + count);
+  interpreter_.LoadProgram(image);
+  interpreter_.SaveSnapshot(loaded_);
+  return true;
+}
+
+/***************************************************************************
+ * Function 'Run'.
+ * Run the loaded program from its start, with the values 'input[0]' to
+ * 'input[input_count - 1]' for its 'RD's, in order.
+ *
+ * Parameters:
+ *   input - the values to read, each of which must be no more than
+ *           'kMaxValue' in magnitude, as in a data file
+ *   input_count - how many values
+ *   output - set to the lines the 'WRT's wrote
+ *   result - set to how the run ended, with its log
+ *
+ * Returns:
+ *   how the run ended, as in 'result'
+**/
+MachineStatus Pullet16Machine::Run(const int* input, size_t input_count,
+                                   string& output, RunResult& result) {
+  output.clear();
+  result.status = kMachineBadInput;
+  result.executed_count = 0;
+  result.pc = 0;
+  result.accum = 0;
+  result.log.clear();
+  for (size_t sub = 0; sub < input_count; ++sub) {
+    if (input[sub] < -kMaxValue || input[sub] > kMaxValue) {
+      return result.status;
+    }
+  }
+
+  // What the interpreter logs goes into 'result' for the caller, and the
+  // caller's log is put back however the run ends.
+  std::stringbuf run_log;
+  LogToBufferGuard to_run_log(&run_log);
+
+  interpreter_.RestoreSnapshot(loaded_);
+  for (size_t sub = 0; sub < input_count; ++sub) {
+    interpreter_.Feed(ToDataLine(input[sub]));
+  }
+
+  RunStatus status = kRunHasOutput;
+  int64_t budget = budget_;
+  string written = "";
+  while (status == kRunHasOutput) {
+    status = interpreter_.Interpret(no_data_scanner_, no_out_stream_,
+                                    budget);
+    interpreter_.TakeOutput(written);
+    output += written;
+    if (budget_ != INT64_MAX) {
+      budget = budget_ - interpreter_.GetExecutedCount();
+    }
+  }
+  if (status == kRunWaitingForInput || status == kRunOutOfBudget) {
+    interpreter_.AbandonRun();
+  }
+  Utils::log_stream.flush();
+
+  result.status = (status == kRunFinished) ? kMachineFinished
+                  : (status == kRunWaitingForInput) ? kMachineOutOfData
+                  : (status == kRunOutOfBudget) ? kMachineOutOfBudget
+                  : kMachineError;
+  result.executed_count = interpreter_.GetExecutedCount();
+  result.pc = interpreter_.GetPC();
+  result.accum = interpreter_.GetAccum();
+  result.log = run_log.str();
+  return result.status;
+}
+
+/***************************************************************************
+ * Function 'ToDataLine'.
+ * Return 'value' as a line of a data file: a sign and four hex digits.
+**/
+string Pullet16Machine::ToDataLine(int value) {
+  char line[16];
+  std::snprintf(line, sizeof(line), "%c%04X", (value < 0) ? '-' : '+',
+                static_cast<unsigned>(std::abs(value)));
+  return string(line);
+}
@@ -0,0 +1,71 @@
+/****************************************************************
+ * Header file for the 'Pullet16Machine' class, the interface of
+ * the 'libpullet16' library for running a program in another
+ * program, with no files and no 'exit'.
+**/
+
+#ifndef PULLET16MACHINE_H
+#define PULLET16MACHINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::ofstream;
+using std::string;
+using std::vector;
+
+#include "./Utilities/scanner.h"
+
+#include "machinesnapshot.h"
+#include "pullet16interpreter.h"
+
+// How a call to 'Pullet16Machine::Run' ended.
+enum MachineStatus {
+  kMachineFinished,     // past the end of the program, as after 'STP'
+  kMachineOutOfData,    // an 'RD' found no more input
+  kMachineOutOfBudget,  // the instructions allowed have been run
+  kMachineError,        // it cannot go on, as in an infinite loop
+  kMachineBadInput      // an input value does not fit in a word
+};
+
+class Pullet16Machine {
+ public:
+  /****************************************************************
+   * How a run ended, and the machine as it was then.  The 'log' is
+   * what 'Aprog' would write to its log for the run: the summary
+   * line, and before it any line on why the run stopped.
+  **/
+  struct RunResult {
+    MachineStatus status;
+    int64_t executed_count;
+    int pc;
+    int accum;
+    string log;
+  };
+
+  Pullet16Machine();
+  virtual ~Pullet16Machine();
+
+  void SetBudget(int64_t budget);
+  void SetEngine(Engine engine);
+  void SetLoopCheck(int64_t every);
+
+  bool Load(const uint16_t* words, size_t count);
+  MachineStatus Run(const int* input, size_t input_count, string& output,
+                    RunResult& result);
+
+ private:
+  static const int kMaxValue = 0xFFFF;  // in magnitude, as in a data file
+
+  int64_t budget_;
+  Interpreter<SummaryTrace> interpreter_;
+  MachineSnapshot loaded_;
+  Scanner no_data_scanner_;  // the files a streaming machine does not use
+  ofstream no_out_stream_;
+
+  static string ToDataLine(int value);
+};
+#endif
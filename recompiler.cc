@@ -0,0 +1,389 @@
+#include "recompiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'Recompiler' for translating a Pullet16 program to C++.
+ *
+ * 'Translate' takes a loaded memory image and 'WriteCpp' writes one C++
+ * translation unit with a 'main' that runs that program the way 'Aprog'
+ * would, given the data file name and the output file name.  It is built
+ * with the same 'g++ -O3' flags as the rest of the code.
+ *
+ * Each word that can be executed becomes a statement, in address order, so
+ * that falling through needs nothing; a word that something branches to
+ * gets a label, branches are 'goto's, and the accumulator is a local.
+ * Words that no path from address zero can reach are left out.
+ *
+ * The translation assumes that the code it was made from does not change.
+ * An 'STC' that writes a new value into a word that control could come back
+ * to therefore leaves the compiled code, and the rest of the run is done by
+ * a small interpreter that is written into the same file.  Indirect
+ * branches go through a 'switch' on the PC; if there are any, every word is
+ * treated as reachable.
+**/
+
+namespace {
+/***************************************************************************
+ * Function 'Label'.
+ * The label for the code of the word at 'address'.
+**/
+string Label(int address) {
+  char label[16];
+  snprintf(label, sizeof(label), "L%04d", address);
+  return string(label);
+}
+
+/***************************************************************************
+ * The parts of the generated file that do not depend on the program.
+**/
+const char kPreamble[] =
+  "#include <bitset>\n"
+  "#include <cstdint>\n"
+  "#include <cstdlib>\n"
+  "#include <fstream>\n"
+  "#include <iostream>\n"
+  "#include <string>\n"
+  "\n"
+  "namespace {\n";
+
+const char kSupport[] =
+  "uint16_t mem[4096];\n"
+  "std::ifstream data_stream;\n"
+  "std::ofstream out_stream;\n"
+  "\n"
+  "inline int Tc(int what) { return (what > 32768) ? what - 65536 : what; }\n"
+  "\n"
+  "// 'RD': the next nonblank line, a sign and four hex digits.  As in\n"
+  "// 'Aprog', running out of data ends the run with status 1.\n"
+  "int ReadValue() {\n"
+  "  std::string line;\n"
+  "  while (std::getline(data_stream, line)) {\n"
+  "    size_t first = line.find_first_not_of(\" \\n\\t\\r\");\n"
+  "    if (first == std::string::npos) continue;\n"
+  "    line = line.substr(first);\n"
+  "    line = line.substr(0, line.find_last_not_of(\" \\n\\t\\r\") + 1);\n"
+  "    int value = static_cast<int>(strtol(line.substr(1).c_str(),\n"
+  "                                        nullptr, 16));\n"
+  "    if (line[0] == '-') value = -value;\n"
+  "    return Tc(value);\n"
+  "  }\n"
+  "  out_stream.flush();\n"
+  "  exit(1);\n"
+  "}\n"
+  "\n"
+  "// 'WRT'.\n"
+  "void WriteValue(int accum) {\n"
+  "  out_stream << \"WRITE OUTPUT      \" << Tc(accum) << \" \"\n"
+  "             << std::bitset<16>(accum).to_string() << '\\n';\n"
+  "}\n"
+  "\n"
+  "// The interpreter for whatever the compiled code cannot run.\n"
+  "void Interpret(int pc, int accum) {\n"
+  "  while (pc < kProgramSize) {\n"
+  "    int word = mem[pc];\n"
+  "    int target = word & 0xFFF;\n"
+  "    int loc = 0;\n"
+  "    if (target <= pc) {\n"
+  "      loc = (word & 0x1000) ? (mem[target] & 0xFFF) : target;\n"
+  "    }\n"
+  "    switch (word >> 13) {\n"
+  "      case 0: if (accum < 0) pc = loc; break;\n"
+  "      case 1: accum -= mem[loc] & 0xFFF; break;\n"
+  "      case 2: mem[loc] = static_cast<uint16_t>(accum); accum = 0; break;\n"
+  "      case 3: accum &= mem[loc]; break;\n"
+  "      case 4: accum = Tc(accum) + Tc(mem[loc]); break;\n"
+  "      case 5: accum = mem[loc] & 0xFFF; break;\n"
+  "      case 6: pc = loc; break;\n"
+  "      case 7:\n"
+  "        if ((word & 0x7) == 1) accum = ReadValue();\n"
+  "        if ((word & 0x7) == 2) pc = kPCForStop;\n"
+  "        if ((word & 0x7) == 3) WriteValue(accum);\n"
+  "        break;\n"
+  "    }\n"
+  "    ++pc;\n"
+  "  }\n"
+  "}\n";
+
+const char kMain[] =
+  "}  // namespace\n"
+  "\n"
+  "int main(int argc, char *argv[]) {\n"
+  "  if (argc != 3) {\n"
+  "    std::cout << \"usage: \" << argv[0] << \" datafilename outfilename\"\n"
+  "              << std::endl;\n"
+  "    return 1;\n"
+  "  }\n"
+  "  data_stream.open(argv[1]);\n"
+  "  out_stream.open(argv[2]);\n"
+  "  if (!data_stream || !out_stream) {\n"
+  "    std::cout << \"cannot open '\" << argv[1] << \"' or '\" << argv[2]\n"
+  "              << \"'\" << std::endl;\n"
+  "    return 1;\n"
+  "  }\n"
+  "\n"
+  "  for (int address = 0; address < kProgramSize; ++address) {\n"
+  "    mem[address] = kImage[address];\n"
+  "  }\n"
+  "  int accum = 0;\n"
+  "  int pc = RunCompiled(accum);\n"
+  "  Interpret(pc, accum);\n"
+  "  return 0;\n"
+  "}\n";
+}  // namespace
+
+/***************************************************************************
+ * Constructor
+**/
+Recompiler::Recompiler() : memory_size_(0), has_indirect_branch_(false) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+Recompiler::~Recompiler() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'FindReachable'.
+ * Follow control flow from address zero to find which words can execute,
+ * which of them are branched to, and which can be come back to at all
+ * (everything but the start, unless something branches there).
+**/
+void Recompiler::FindReachable() {
+#ifdef EBUG
+  Utils::log_stream << "enter FindReachable" << endl;
+#endif
+  is_reachable_.assign(memory_size_, false);
+  is_branch_target_.assign(memory_size_, false);
+  is_reentered_.assign(memory_size_, false);
+  has_indirect_branch_ = false;
+
+  vector<int> to_visit;
+  if (memory_size_ > 0) {
+    is_reachable_[0] = true;
+    to_visit.push_back(0);
+  }
+  while (!to_visit.empty()) {
+    int address = to_visit.back();
+    to_visit.pop_back();
+    const DecodedInstruction& inst = decoded_[address];
+
+    vector<int> next;
+    bool is_branch = inst.opcode == DABnamespace::kBAN
+                     || inst.opcode == DABnamespace::kBR;
+    if (inst.opcode != DABnamespace::kBR
+        && inst.opcode != DABnamespace::kSTP) {
+      next.push_back(address + 1);
+    }
+    if (is_branch && inst.indirect) {
+      has_indirect_branch_ = true;
+    } else if (is_branch) {
+      next.push_back(inst.operand + 1);
+      if (inst.operand + 1 < memory_size_) {
+        is_branch_target_[inst.operand + 1] = true;
+      }
+    }
+
+    for (size_t sub = 0; sub < next.size(); ++sub) {
+      if (next[sub] >= memory_size_) continue;
+      is_reentered_[next[sub]] = true;
+      if (!is_reachable_[next[sub]]) {
+        is_reachable_[next[sub]] = true;
+        to_visit.push_back(next[sub]);
+      }
+    }
+  }
+
+  if (has_indirect_branch_) {
+    is_reachable_.assign(memory_size_, true);
+    is_branch_target_.assign(memory_size_, true);
+    is_reentered_.assign(memory_size_, true);
+  }
+#ifdef EBUG
+  Utils::log_stream << "leave FindReachable" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'Location'.
+ * The C++ expression for the target location of an instruction.
+**/
+string Recompiler::Location(const DecodedInstruction& inst) const {
+  if (inst.indirect) {
+    return "(mem[" + Utils::Format(inst.operand) + "] & 0xFFF)";
+  }
+  return Utils::Format(inst.operand);
+}
+
+/***************************************************************************
+ * Function 'StatementFor'.
+ * The C++ code for the word at 'address'.
+**/
+string Recompiler::StatementFor(int address) const {
+  const DecodedInstruction& inst = decoded_[address];
+  string location = Location(inst);
+  string next = Utils::Format(address + 1);
+  string branch = "";
+  string sss = "";
+
+  if (inst.opcode == DABnamespace::kBAN || inst.opcode == DABnamespace::kBR) {
+    if (inst.indirect) {
+      branch = "{ pc = " + location + " + 1; goto dispatch; }";
+    } else if (inst.operand + 1 < memory_size_) {
+      branch = "goto " + Label(inst.operand + 1) + ";";
+    } else {
+      branch = "{ accum = acc; return " + Utils::Format(inst.operand + 1)
+               + "; }";
+    }
+  }
+
+  switch (inst.opcode) {
+    case DABnamespace::kBAN:
+      sss = "if (acc < 0) " + branch;
+      break;
+    case DABnamespace::kSUB:
+      sss = "acc -= mem[" + location + "] & 0xFFF;";
+      break;
+    case DABnamespace::kSTC:
+      if (!inst.indirect) {
+        sss = "mem[" + location + "] = static_cast<uint16_t>(acc); acc = 0;";
+        if (inst.operand < memory_size_ && is_reentered_[inst.operand]) {
+          sss += "\n  if (mem[" + location + "] != kImage[" + location
+                 + "]) { accum = 0; return " + next + "; }";
+        }
+      } else {
+        sss = "{ int loc = " + location + ";"
+              + " mem[loc] = static_cast<uint16_t>(acc); acc = 0;\n"
+              + "    if (loc < kProgramSize && mem[loc] != kImage[loc]) {"
+              + " accum = 0; return " + next + "; } }";
+      }
+      break;
+    case DABnamespace::kAND:
+      sss = "acc &= mem[" + location + "];";
+      break;
+    case DABnamespace::kADD:
+      sss = "acc = Tc(acc) + Tc(mem[" + location + "]);";
+      break;
+    case DABnamespace::kLD:
+      sss = "acc = mem[" + location + "] & 0xFFF;";
+      break;
+    case DABnamespace::kBR:
+      sss = branch;
+      break;
+    case DABnamespace::kSTP:
+      sss = "{ accum = acc; return "
+            + Utils::Format(DABnamespace::kPCForStop + 1) + "; }";
+      break;
+    case DABnamespace::kRD:
+      sss = "acc = ReadValue();";
+      break;
+    case DABnamespace::kWRT:
+      sss = "WriteValue(acc);";
+      break;
+    default:
+      sss = ";";
+      break;
+  }
+
+  return sss;
+}
+
+/***************************************************************************
+ * Function 'Translate'.
+ * Decode the program and work out what of it can run.
+ *
+ * Parameters:
+ *   memory - the guest memory image
+ *   memory_size - the number of words in the program
+**/
+void Recompiler::Translate(const uint16_t* memory, int memory_size) {
+#ifdef EBUG
+  Utils::log_stream << "enter Translate" << endl;
+#endif
+  memory_size_ = memory_size;
+  image_.assign(memory, memory + memory_size);
+  decoded_.resize(memory_size);
+  for (int address = 0; address < memory_size_; ++address) {
+    decoded_[address] = DABnamespace::DecodeWord(memory[address], address);
+  }
+  FindReachable();
+#ifdef EBUG
+  Utils::log_stream << "leave Translate" << endl;
+#endif
+}
+
+/***************************************************************************
+ * Function 'WriteCpp'.
+ * Write the translation unit.
+ *
+ * Parameters:
+ *   cpp_stream - where to write it
+ *   source_name - the name of the 'a.out' file, for the header comment
+**/
+void Recompiler::WriteCpp(ofstream& cpp_stream, string source_name) const {
+#ifdef EBUG
+  Utils::log_stream << "enter WriteCpp" << endl;
+#endif
+  cpp_stream << "// Pullet16 program '" << source_name
+             << "' translated to C++ by Aprog." << endl;
+  cpp_stream << "// Usage: <binary> datafilename outfilename" << endl;
+  cpp_stream << endl;
+  cpp_stream << kPreamble;
+  cpp_stream << "const int kProgramSize = " << memory_size_ << ";" << endl;
+  cpp_stream << "const int kPCForStop = " << DABnamespace::kPCForStop << ";"
+             << endl;
+  cpp_stream << "const uint16_t kImage[" << std::max(memory_size_, 1)
+             << "] = {";
+  for (int address = 0; address < memory_size_; ++address) {
+    cpp_stream << ((address % 8 == 0) ? "\n  " : " ") << image_[address]
+               << ",";
+  }
+  cpp_stream << endl << "};" << endl << endl;
+  cpp_stream << kSupport << endl;
+
+  cpp_stream << "// Returns the PC at which the interpreter must carry on."
+             << endl;
+  cpp_stream << "int RunCompiled(int& accum) {" << endl;
+  cpp_stream << "  int acc = accum;" << endl;
+  if (has_indirect_branch_) {
+    cpp_stream << "  int pc = 0;" << endl;
+  }
+  for (int address = 0; address < memory_size_; ++address) {
+    if (!is_reachable_[address]) continue;
+    cpp_stream << endl << "  // " << Utils::Format(address, 4) << "  "
+               << DABnamespace::Disassemble(image_[address]) << endl;
+    if (is_branch_target_[address]) {
+      cpp_stream << Label(address) << ":" << endl;
+    }
+    cpp_stream << "  " << StatementFor(address) << endl;
+  }
+  cpp_stream << endl << "  accum = acc;" << endl;
+  cpp_stream << "  return kProgramSize;" << endl;
+  if (has_indirect_branch_) {
+    cpp_stream << endl << "dispatch:" << endl;
+    cpp_stream << "  switch (pc) {" << endl;
+    for (int address = 0; address < memory_size_; ++address) {
+      cpp_stream << "    case " << address << ": goto " << Label(address)
+                 << ";" << endl;
+    }
+    cpp_stream << "  }" << endl;
+    cpp_stream << "  accum = acc;" << endl;
+    cpp_stream << "  return pc;" << endl;
+  }
+  cpp_stream << "}" << endl << endl;
+  cpp_stream << kMain;
+#ifdef EBUG
+  Utils::log_stream << "leave WriteCpp" << endl;
+#endif
+}
@@ -0,0 +1,50 @@
+/****************************************************************
+ * Header file for the 'Recompiler' class that translates a
+ * Pullet16 memory image into a C++ translation unit.
+**/
+
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::cin;
+using std::cout;
+using std::endl;
+using std::ofstream;
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "dabnamespace.h"
+
+using DABnamespace::DecodedInstruction;
+
+class Recompiler {
+ public:
+  Recompiler();
+  virtual ~Recompiler();
+
+  void Translate(const uint16_t* memory, int memory_size);
+  void WriteCpp(ofstream& cpp_stream, string source_name) const;
+
+ private:
+  int memory_size_;
+  bool has_indirect_branch_;
+
+  vector<uint16_t> image_;
+  vector<DecodedInstruction> decoded_;
+  vector<bool> is_reachable_;
+  vector<bool> is_branch_target_;
+  vector<bool> is_reentered_;
+
+  void FindReachable();
+  string Location(const DecodedInstruction& inst) const;
+  string StatementFor(int address) const;
+};
+#endif
@@ -0,0 +1,277 @@
+#include "resultcache.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'ResultCache' for the results of runs, kept on disk.
+ *
+ * A result is the contents of the output file of a run and the lines
+ * it wrote to the log.  It is kept in a file of its own in the cache
+ * directory, named by its key, which is a hash of the program image, of
+ * the bytes of the data file, and of the settings of the run, which are
+ * the kind of log written and every option that changes what it says,
+ * so the same program run the same way on the same data is found again
+ * whatever the files were called.
+ *
+ * An entry is written to a temporary file and renamed into place, so
+ * any number of threads and processes can share a directory: a reader
+ * sees a whole entry or none, and two writers of the same key write the
+ * same thing.  Each entry starts with its key, which is checked when it
+ * is read.
+ *
+ * The modification time of an entry is when it was last used; a hit
+ * touches it.  When the entries come to more than the size cap, the
+ * least recently used are removed until they are down to three quarters
+ * of it.  Each process counts only its own stores between scans of the
+ * directory, so with several processes sharing it the cap can be passed
+ * for a while.
+**/
+
+const char ResultCache::kMagic[] = "PULLET16 RESULT";
+
+/***************************************************************************
+ * Constructor
+**/
+ResultCache::ResultCache()
+    : max_bytes_(0), bytes_(0), temporary_count_(0) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+ResultCache::~ResultCache() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Accessor for whether 'Open' has been called, so that there is a cache.
+**/
+bool ResultCache::IsOpen() const {
+  return !directory_.empty();
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'EntryFilename'.
+ * The name of the file for the entry with 'key'.
+**/
+string ResultCache::EntryFilename(string key) const {
+  return directory_ + "/" + key + ".run";
+}
+
+/***************************************************************************
+ * Function 'Evict'.
+ * Count the entries in the directory, and if they come to more than the
+ * cap, remove the least recently used until they are down to three
+ * quarters of it.  Temporary files left by writers that died are removed
+ * once they are old.  The caller holds 'lock_'.
+**/
+void ResultCache::Evict() {
+  DIR* directory = opendir(directory_.c_str());
+  if (directory == nullptr) return;
+
+  vector<std::pair<time_t, string> > entries;
+  vector<int64_t> sizes;
+  int64_t total = 0;
+  time_t now = time(nullptr);
+  struct dirent* item = nullptr;
+  while ((item = readdir(directory)) != nullptr) {
+    string name = item->d_name;
+    string filename = directory_ + "/" + name;
+    struct stat status;
+    if (stat(filename.c_str(), &status) != 0) continue;
+    if (name.find(".tmp") != string::npos) {
+      if (now - status.st_mtime > kStaleSeconds) {
+        unlink(filename.c_str());
+      }
+    } else if (name.size() > 4
+               && name.compare(name.size() - 4, 4, ".run") == 0) {
+      entries.push_back(std::make_pair(status.st_mtime, filename));
+      sizes.push_back(status.st_size);
+      total += status.st_size;
+    }
+  }
+  closedir(directory);
+
+  if (total > max_bytes_) {
+    vector<size_t> order(entries.size());
+    for (size_t sub = 0; sub < order.size(); ++sub) {
+      order[sub] = sub;
+    }
+    std::sort(order.begin(), order.end(),
+              [&entries](size_t one, size_t two) {
+                return entries[one].first < entries[two].first;
+              });
+    for (size_t sub = 0; sub < order.size() && total > max_bytes_ / 4 * 3;
+         ++sub) {
+      if (unlink(entries[order[sub]].second.c_str()) == 0) {
+        total -= sizes[order[sub]];
+      }
+    }
+  }
+  bytes_ = total;
+}
+
+/***************************************************************************
+ * Function 'Find'.
+ * Look for the entry with 'key', and if it is there, mark it as used.
+ *
+ * Returns:
+ *   true, with the entry in 'output' and 'log', if it was found
+**/
+bool ResultCache::Find(string key, string& output, string& log) {
+  string filename = EntryFilename(key);
+  string contents = "";
+  if (!ReadFile(filename, contents)) return false;
+
+  std::istringstream header(contents);
+  string magic = "";
+  string entry_key = "";
+  size_t output_size = 0;
+  size_t log_size = 0;
+  if (!std::getline(header, magic) || magic != kMagic
+      || !(header >> entry_key >> output_size >> log_size)
+      || entry_key != key || header.get() != '\n') {
+    return false;
+  }
+  size_t start = static_cast<size_t>(header.tellg());
+  if (contents.size() != start + output_size + log_size) return false;
+
+  output = contents.substr(start, output_size);
+  log = contents.substr(start + output_size, log_size);
+  utime(filename.c_str(), nullptr);
+  return true;
+}
+
+/***************************************************************************
+ * Function 'Hash'.
+ * Carry the 64 bit FNV-1a hash 'hash' on over 'length' 'bytes'.
+**/
+uint64_t ResultCache::Hash(const void* bytes, size_t length, uint64_t hash) {
+  const unsigned char* next = static_cast<const unsigned char*>(bytes);
+  for (size_t sub = 0; sub < length; ++sub) {
+    hash = (hash ^ next[sub]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/***************************************************************************
+ * Function 'ImageKey'.
+ * The hash of the program 'image', as 16 hexadecimal digits, which is
+ * the first half of the key of every run of it.
+**/
+string ResultCache::ImageKey(const vector<uint16_t>& image) {
+  uint64_t image_hash = 14695981039346656037ULL;
+  for (size_t sub = 0; sub < image.size(); ++sub) {
+    unsigned char word[2] = { static_cast<unsigned char>(image[sub] >> 8),
+                              static_cast<unsigned char>(image[sub]) };
+    image_hash = Hash(word, 2, image_hash);
+  }
+
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx",
+           static_cast<unsigned long long>(image_hash));
+  return key;
+}
+
+/***************************************************************************
+ * Function 'Key'.
+ * The key of the run of the program 'image' on the data file contents
+ * 'input' with 'settings', the options that its output and log depend
+ * on, such as the '-log' option and the engine: the hashes of the
+ * program and of the rest, as 32 hexadecimal digits.
+**/
+string ResultCache::Key(const vector<uint16_t>& image, const string& input,
+                        string settings) {
+  uint64_t input_hash = Hash(settings.c_str(), settings.size() + 1,
+                             14695981039346656037ULL);
+  input_hash = Hash(input.data(), input.size(), input_hash);
+
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx",
+           static_cast<unsigned long long>(input_hash));
+  return ImageKey(image) + key;
+}
+
+/***************************************************************************
+ * Function 'Open'.
+ * Keep results in 'directory', making it if need be, up to 'max_bytes'.
+**/
+void ResultCache::Open(string directory, int64_t max_bytes) {
+  if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+    std::perror(directory.c_str());
+    exit(1);
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  directory_ = directory;
+  max_bytes_ = max_bytes;
+  Evict();
+}
+
+/***************************************************************************
+ * Function 'ReadFile'.
+ * Read all of the file 'filename' into 'contents'.
+ *
+ * Returns:
+ *   false if the file could not be read
+**/
+bool ResultCache::ReadFile(string filename, string& contents) {
+  std::ifstream in_stream(filename.c_str(), std::ios::binary);
+  if (!in_stream) return false;
+  std::ostringstream buffer;
+  buffer << in_stream.rdbuf();
+  contents = buffer.str();
+  return !in_stream.bad();
+}
+
+/***************************************************************************
+ * Function 'Store'.
+ * Keep 'output' and 'log' as the entry with 'key'.  A cache that cannot
+ * be written is only a cache that misses, so failures are ignored.
+**/
+void ResultCache::Store(string key, const string& output, const string& log) {
+  std::ostringstream temporary;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    temporary << directory_ << "/" << key << ".tmp" << getpid() << "."
+              << temporary_count_++;
+  }
+  std::ostringstream header;
+  header << kMagic << "\n" << key << " " << output.size() << " "
+         << log.size() << "\n";
+  string temporary_filename = temporary.str();
+  std::ofstream out_stream(temporary_filename.c_str(), std::ios::binary);
+  out_stream << header.str() << output << log;
+  out_stream.close();
+  int64_t size = header.str().size() + output.size() + log.size();
+  if (!out_stream
+      || rename(temporary_filename.c_str(), EntryFilename(key).c_str()) != 0) {
+    unlink(temporary_filename.c_str());
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  bytes_ += size;
+  if (bytes_ > max_bytes_) {
+    Evict();
+  }
+}
@@ -0,0 +1,50 @@
+/****************************************************************
+ * Header file for the 'ResultCache' class that keeps the output
+ * and log of runs on disk, by the program and the input they ran
+ * on, so that a run that has been done before need not be done
+ * again.
+**/
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class ResultCache {
+ public:
+  ResultCache();
+  virtual ~ResultCache();
+
+  bool IsOpen() const;
+
+  bool Find(string key, string& output, string& log);
+  void Open(string directory, int64_t max_bytes);
+  void Store(string key, const string& output, const string& log);
+
+  static string ImageKey(const vector<uint16_t>& image);
+  static string Key(const vector<uint16_t>& image, const string& input,
+                    string settings);
+  static bool ReadFile(string filename, string& contents);
+
+ private:
+  static const char kMagic[];
+  static const int kStaleSeconds = 3600;  // before a temporary is removed
+
+  string directory_;
+  int64_t max_bytes_;
+  int64_t bytes_;  // of the entries, as last counted plus stores since
+  int64_t temporary_count_;
+  std::mutex lock_;
+
+  void Evict();
+  string EntryFilename(string key) const;
+
+  static uint64_t Hash(const void* bytes, size_t length, uint64_t hash);
+};
+#endif
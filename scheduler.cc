@@ -0,0 +1,114 @@
+#include "scheduler.h"
+
+/***************************************************************************
+ *3456789 123456789 123456789 123456789 123456789 123456789 123456789 123456
+ * Class 'RoundRobin' for running many machines on one thread.
+ *
+ * The machines wait in a queue.  'RunSlice' runs the one at the front
+ * for a slice of instructions with 'Interpret'; if it used up the slice
+ * it goes to the back, and otherwise it is handed back to the caller, who
+ * ends it.  So a short run waits for at most one slice of each of the
+ * machines ahead of it, not for them to finish, however long they are.
+ *
+ * A machine is an interpreter of its own, so nothing is shared between
+ * them but the thread, and each slice goes on exactly where the last one
+ * stopped.  The log of a machine is switched in with a 'LogToBufferGuard'
+ * for its slice.
+**/
+
+/***************************************************************************
+ * Constructor
+**/
+template <class Trace>
+RoundRobin<Trace>::RoundRobin()
+    : slice_(kDefaultSlice) {
+}
+
+/***************************************************************************
+ * Destructor
+**/
+template <class Trace>
+RoundRobin<Trace>::~RoundRobin() {
+}
+
+/***************************************************************************
+ * Accessors and Mutators
+**/
+
+/***************************************************************************
+ * Accessor for whether there are no machines to run.
+**/
+template <class Trace>
+bool RoundRobin<Trace>::IsEmpty() const {
+  return ready_.empty();
+}
+
+/***************************************************************************
+ * Accessor for how many machines there are to run.
+**/
+template <class Trace>
+int RoundRobin<Trace>::Size() const {
+  return static_cast<int>(ready_.size());
+}
+
+/***************************************************************************
+ * Mutator for 'slice_', how many instructions a machine runs in its turn.
+**/
+template <class Trace>
+void RoundRobin<Trace>::SetSlice(int64_t slice) {
+  slice_ = slice;
+}
+
+/***************************************************************************
+ * General functions.
+**/
+
+/***************************************************************************
+ * Function 'Add'.
+ * Put 'machine', which must be loaded, at the back of the queue.
+**/
+template <class Trace>
+void RoundRobin<Trace>::Add(const Machine& machine) {
+  ready_.push_back(machine);
+}
+
+/***************************************************************************
+ * Function 'RunSlice'.
+ * Run the machine at the front of the queue for one slice.
+ *
+ * Returns:
+ *   true, with the machine in 'stopped', if it stopped for any reason but
+ *   the end of its slice, and so is out of the queue
+**/
+template <class Trace>
+bool RoundRobin<Trace>::RunSlice(Machine& stopped) {
+  if (ready_.empty()) return false;
+  Machine machine = ready_.front();
+  ready_.pop_front();
+
+  {
+    std::unique_ptr<LogToBufferGuard> to_log_buffer;
+    if (machine.log_buffer != nullptr) {
+      to_log_buffer.reset(new LogToBufferGuard(machine.log_buffer));
+    }
+    machine.status = machine.interpreter->Interpret(*machine.data_scanner,
+                                                    *machine.out_stream,
+                                                    slice_);
+  }
+
+  if (machine.status == kRunOutOfBudget) {
+    ready_.push_back(machine);
+    return false;
+  }
+  stopped = machine;
+  return true;
+}
+
+// The trace policies that 'main' can choose from.
+template class RoundRobin<FullTrace>;
+template class RoundRobin<AsyncFullTrace>;
+template class RoundRobin<SummaryTrace>;
+template class RoundRobin<NoTrace>;
+template class RoundRobin<BinaryTrace>;
+template class RoundRobin<DiffTrace>;
+template class RoundRobin<SampledTrace>;
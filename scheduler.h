@@ -0,0 +1,55 @@
+/****************************************************************
+ * Header file for the 'RoundRobin' scheduler that shares one
+ * thread among many interpreters, a slice of instructions each
+ * in turn.
+**/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+
+#include "./Utilities/scanner.h"
+#include "./Utilities/utils.h"
+
+#include "pullet16interpreter.h"
+
+template <class Trace>
+class RoundRobin {
+ public:
+  /****************************************************************
+   * One machine to be run: a loaded interpreter, the files it runs
+   * with, where its log goes (null for the log itself), and what
+   * the caller knows it as.  'status' is set when it is handed
+   * back.
+  **/
+  struct Machine {
+    Interpreter<Trace>* interpreter;
+    Scanner* data_scanner;
+    ofstream* out_stream;
+    std::streambuf* log_buffer;
+    int id;
+    RunStatus status;
+  };
+
+  RoundRobin();
+  virtual ~RoundRobin();
+
+  bool IsEmpty() const;
+  int Size() const;
+  void SetSlice(int64_t slice);
+
+  void Add(const Machine& machine);
+  bool RunSlice(Machine& stopped);
+
+ private:
+  static const int64_t kDefaultSlice = 10000;
+
+  int64_t slice_;
+  std::deque<Machine> ready_;
+};
+#endif
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::string;
+using std::vector;
+
+#include "./Utilities/utils.h"
+
+#include "asynclogsink.h"
+#include "bintrace.h"
+#include "dabnamespace.h"
+
+/****************************************************************
+ * Main program for 'Tprog', which turns a binary trace written by
+ * 'Aprog -bintrace' back into the log that 'Aprog' writes.
+ *
+ * The output is what the interpreter itself writes to the log: the
+ * program as it is read in, the machine after loading, and then the
+ * machine and the lines for each instruction.  The 'MAIN:' lines
+ * that 'Aprog' adds around it are not in the trace.
+ *
+ * Memory is rebuilt from the program in the header and the 'STC'
+ * records, and the lines are formatted by the same functions that
+ * the interpreter uses, so the text is the same.
+ *
+ * With '-step', it instead reads a log written with 'Aprog -log diff'
+ * and prints the whole machine as it was before the instruction of
+ * that step, from the last keyframe at or before it and the changes
+ * after that.
+**/
+
+static const char kTag[] = "TPROG: ";
+static const char kUsage[] =
+    "tracefilename logfilename | -step stepnumber difflogfilename";
+
+/****************************************************************
+ * Function 'AppendMachine'.
+ * Append the machine, with the 'MEM' lines already formatted.
+**/
+static void AppendMachine(int pc, int accum,
+                          const vector<string>& memory_lines, string& out) {
+  AsyncLogSink::AppendMachineHeader(pc, accum, out);
+  for (size_t line = 0; line < memory_lines.size(); ++line) {
+    out += memory_lines[line];
+  }
+  out += AsyncLogSink::kMachineTrailer;
+  out += '\n';
+}
+
+/****************************************************************
+ * Function 'Decode'.
+ * Write the log for the binary trace in 'trace_filename'.
+**/
+static void Decode(string trace_filename, string log_filename) {
+  ifstream trace_stream;
+  ofstream log_stream;
+  Utils::FileOpen(trace_stream, trace_filename);
+  Utils::FileOpen(log_stream, log_filename);
+
+  BinaryTraceReader reader;
+  vector<uint16_t> program;
+  if (!reader.Start(trace_stream, program)) {
+    cout << kTag << "'" << trace_filename << "' is not a Pullet16 trace"
+         << endl;
+    exit(1);
+  }
+  int memory_size = static_cast<int>(program.size());
+  uint16_t memory[DABnamespace::kMaxMemory] = { 0 };
+  std::copy(program.begin(), program.end(), memory);
+
+  vector<string> memory_lines((memory_size + 3) / 4);
+  for (size_t line = 0; line < memory_lines.size(); ++line) {
+    AsyncLogSink::AppendMemoryLine(4 * line, memory, memory_size,
+                                   memory_lines[line]);
+  }
+
+  // What 'ReadProgram' and 'DumpProgram' write.
+  string text = "";
+  for (int address = 0; address < memory_size; ++address) {
+    text += "READ " + std::to_string(address + 1) + " "
+            + std::to_string(address + 1) + " "
+            + DABnamespace::DecToBitString(memory[address], 16) + "\n";
+  }
+  AppendMachine(memory_size, 0, memory_lines, text);
+  for (int address = 0; address < memory_size; ++address) {
+    text += "WRITE OUTPUT       0 0\n";
+  }
+
+  // What the interpreter writes for each instruction.
+  TraceEntry entry;
+  int64_t count = 0;
+  while (reader.Next(entry)) {
+    ++count;
+    AppendMachine(entry.pc, entry.accum_before, memory_lines, text);
+
+    DABnamespace::Opcode opcode = DABnamespace::OpcodeOfWord(entry.word);
+    TraceRecord record = { kOperandRecord, static_cast<uint8_t>(opcode),
+                           static_cast<uint16_t>(entry.pc), 0 };
+    switch (opcode) {
+      case DABnamespace::kNOP:
+        break;
+      case DABnamespace::kRD:
+        record.kind = kReadRecord;
+        record.flag = !(reader.IsAtEnd()
+                        && reader.GetStatus() == kTraceOutOfData);
+        break;
+      case DABnamespace::kSTP:
+        record.kind = kStopRecord;
+        break;
+      case DABnamespace::kWRT:
+        record.kind = kWriteRecord;
+        break;
+      default:
+        break;
+    }
+    if (opcode != DABnamespace::kNOP) {
+      AsyncLogSink::AppendLine(record, memory, text);
+    }
+    if (opcode == DABnamespace::kBAN && entry.accum_before >= 0) {
+      record.kind = kNotNegativeRecord;
+      AsyncLogSink::AppendLine(record, memory, text);
+    }
+
+    if (opcode == DABnamespace::kSTC && entry.effective_address >= 0) {
+      int location = entry.effective_address;
+      memory[location] = static_cast<uint16_t>(entry.accum_before);
+      if (location < memory_size) {
+        memory_lines[location / 4].clear();
+        AsyncLogSink::AppendMemoryLine(4 * (location / 4), memory,
+                                       memory_size,
+                                       memory_lines[location / 4]);
+      }
+    }
+
+    if (text.size() >= (1 << 20)) {
+      log_stream << text;
+      text.clear();
+    }
+  }
+  log_stream << text;
+
+  cout << kTag << count << " instructions";
+  if (reader.GetStatus() == kTraceOutOfData) {
+    cout << ", ran out of data";
+  } else if (reader.GetStatus() == kTraceLooping) {
+    cout << ", stopped in an infinite loop";
+  } else if (reader.GetStatus() == kTraceTruncated) {
+    cout << ", trace is truncated";
+  }
+  cout << endl;
+
+  Utils::FileClose(trace_stream);
+  Utils::FileClose(log_stream);
+}
+
+/****************************************************************
+ * Function 'RebuildStep'.
+ * Print the machine at 'step' from the 'diff' log 'log_filename'.
+**/
+static void RebuildStep(int64_t step, string log_filename) {
+  ifstream log_stream;
+  Utils::FileOpen(log_stream, log_filename);
+
+  bool is_found = false;
+  bool is_in_keyframe = false;
+  int pc = 0;
+  int accum = 0;
+  int memory_size = 0;
+  uint16_t memory[DABnamespace::kMaxMemory] = { 0 };
+
+  string line;
+  while (std::getline(log_stream, line)) {
+    std::istringstream fields(line);
+    string kind;
+    fields >> kind;
+    if (kind == "KEYFRAME" || kind == "STEP") {
+      string word;
+      int64_t this_step = 0;
+      if (kind == "KEYFRAME") fields >> word;
+      fields >> this_step;
+      if (this_step > step) break;
+      fields >> word >> pc >> word >> accum;
+      is_found = this_step == step;
+      is_in_keyframe = kind == "KEYFRAME";
+      if (is_in_keyframe) memory_size = 0;
+    } else if (kind == "MEM" && is_in_keyframe && line.size() > 13) {
+      // Past the fixed-width "MEM nnnn-nnnn".
+      std::istringstream words(line.substr(13));
+      string bits;
+      while (words >> bits && memory_size < DABnamespace::kMaxMemory) {
+        memory[memory_size++] =
+          static_cast<uint16_t>(DABnamespace::BitStringToDec(bits));
+      }
+    } else if (kind == "WROTE") {
+      int address = 0;
+      string bits;
+      fields >> address >> bits;
+      if (address >= 0 && address < DABnamespace::kMaxMemory) {
+        memory[address] =
+          static_cast<uint16_t>(DABnamespace::BitStringToDec(bits));
+      }
+    }
+  }
+  Utils::FileClose(log_stream);
+
+  if (!is_found) {
+    cout << kTag << "step " << step << " is not in '" << log_filename
+         << "'" << endl;
+    exit(1);
+  }
+
+  vector<string> memory_lines((memory_size + 3) / 4);
+  for (size_t line = 0; line < memory_lines.size(); ++line) {
+    AsyncLogSink::AppendMemoryLine(4 * line, memory, memory_size,
+                                   memory_lines[line]);
+  }
+  string text = "STEP " + std::to_string(step) + "\n";
+  AppendMachine(pc, accum, memory_lines, text);
+  cout << text;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 4 && static_cast<string>(argv[1]) == "-step") {
+    RebuildStep(std::atoll(argv[2]), static_cast<string>(argv[3]));
+    return 0;
+  }
+
+  Utils::CheckArgs(2, argc, argv, kUsage);
+  Decode(static_cast<string>(argv[1]), static_cast<string>(argv[2]));
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+/****************************************************************
+ * Header file for the trace policies of the Pullet16 interpreter.
+ *
+ * An 'Interpreter' is instantiated with one of these, and every
+ * line it would write to the log is behind an 'if' on one of the
+ * constants, so whatever a policy turns off is not compiled in.
+ *
+ *   kMachine - the whole machine, before every instruction
+ *   kSteps - the lines for each instruction, and for the program
+ *            as it is read in
+ *   kSummary - a count of the instructions interpreted, and the
+ *              final PC and accumulator, when the program ends
+ *   kAsync - hand the machine and instruction lines to an
+ *            'AsyncLogSink' to be formatted and written on another
+ *            thread, instead of writing them in line
+ *   kBinary - a 'BinaryTraceWriter' record for every instruction
+ *             interpreted, instead of any text
+ *   kDiff - instead of the whole machine before every instruction,
+ *           the PC, the accumulator, and the words written since the
+ *           last instruction, with the whole machine now and then as
+ *           a keyframe to start from
+ *   kSampled - the whole machine only every so many instructions,
+ *              every so many milliseconds, or at chosen PCs, as set
+ *              with 'Interpreter::SetSampling' and 'SetSnapshotAt'
+**/
+
+#ifndef TRACEPOLICY_H
+#define TRACEPOLICY_H
+
+// Everything, which is the log as it has always been written.
+struct FullTrace {
+  static constexpr bool kMachine = true;
+  static constexpr bool kSteps = true;
+  static constexpr bool kSummary = false;
+  static constexpr bool kAsync = false;
+  static constexpr bool kBinary = false;
+  static constexpr bool kDiff = false;
+  static constexpr bool kSampled = false;
+};
+
+// The same, written by another thread.
+struct AsyncFullTrace {
+  static constexpr bool kMachine = true;
+  static constexpr bool kSteps = true;
+  static constexpr bool kSummary = false;
+  static constexpr bool kAsync = true;
+  static constexpr bool kBinary = false;
+  static constexpr bool kDiff = false;
+  static constexpr bool kSampled = false;
+};
+
+// Only what it took and where it ended.
+struct SummaryTrace {
+  static constexpr bool kMachine = false;
+  static constexpr bool kSteps = false;
+  static constexpr bool kSummary = true;
+  static constexpr bool kAsync = false;
+  static constexpr bool kBinary = false;
+  static constexpr bool kDiff = false;
+  static constexpr bool kSampled = false;
+};
+
+// Nothing from the interpreter at all.
+struct NoTrace {
+  static constexpr bool kMachine = false;
+  static constexpr bool kSteps = false;
+  static constexpr bool kSummary = false;
+  static constexpr bool kAsync = false;
+  static constexpr bool kBinary = false;
+  static constexpr bool kDiff = false;
+  static constexpr bool kSampled = false;
+};
+
+// The binary trace, which 'Tprog' turns back into the full text.
+struct BinaryTrace {
+  static constexpr bool kMachine = false;
+  static constexpr bool kSteps = false;
+  static constexpr bool kSummary = false;
+  static constexpr bool kAsync = false;
+  static constexpr bool kBinary = true;
+  static constexpr bool kDiff = false;
+  static constexpr bool kSampled = false;
+};
+
+// The instruction lines, with the machine as keyframes and changes.
+struct DiffTrace {
+  static constexpr bool kMachine = false;
+  static constexpr bool kSteps = true;
+  static constexpr bool kSummary = false;
+  static constexpr bool kAsync = false;
+  static constexpr bool kBinary = false;
+  static constexpr bool kDiff = true;
+  static constexpr bool kSampled = false;
+};
+
+// Snapshots of the machine now and then, and the summary.
+struct SampledTrace {
+  static constexpr bool kMachine = false;
+  static constexpr bool kSteps = false;
+  static constexpr bool kSummary = true;
+  static constexpr bool kAsync = false;
+  static constexpr bool kBinary = false;
+  static constexpr bool kDiff = false;
+  static constexpr bool kSampled = true;
+};
+#endif